@@ -47,6 +47,8 @@ namespace Rpc
             }
             bool Send(const BaseConnection::ptr &conn, const BaseMessage::ptr &msg, AsyncResponse &response)
             {
+                if (CheckConnection(conn) == false)
+                    return false;
                 RequestDescribe::ptr rd = NewDescribe(msg, RType::REQ_ASYNC);
                 if (rd.get() == nullptr)
                     return false;
@@ -72,6 +74,8 @@ namespace Rpc
             }
             bool Send(const BaseConnection::ptr &conn, const BaseMessage::ptr &msg, const RequestCallback &cb)
             {
+                if (CheckConnection(conn) == false)
+                    return false;
                 RequestDescribe::ptr rd = NewDescribe(msg, RType::REQ_CALLBACK, cb);
                 if (rd.get() == nullptr)
                     return false;
@@ -80,6 +84,16 @@ namespace Rpc
             }
 
         private:
+            // 连接超时或断开重连期间客户端没有可用的连接
+            bool CheckConnection(const BaseConnection::ptr &conn)
+            {
+                if (conn.get() == nullptr || conn->Connected() == false)
+                {
+                    LOG(LogLevel::ERROR) << "连接未建立，请求发送失败";
+                    return false;
+                }
+                return true;
+            }
             RequestDescribe::ptr NewDescribe(const BaseMessage::ptr &req, RType rtype,
                                              const RequestCallback &cb = nullptr)
             {
@@ -96,6 +96,34 @@ namespace Rpc
                 return true;
             }
 
+            // 同步调用，参数和结果都是RPC_SCHEMA声明过的结构体，结果缺少字段或者类型不对时返回false
+            template <typename Req, typename Rsp, typename = std::enable_if_t<IsSchema<Req>::value && IsSchema<Rsp>::value>>
+            bool Call(const BaseConnection::ptr &conn, const std::string &method, const Req &params, Rsp &result)
+            {
+                auto req_msg = MessageFactory::CreateMessage<RpcRequest>();
+                req_msg->SetMethod(method);
+                req_msg->SetId(UUID::Uuid());
+                req_msg->SetParamsAs(params);
+                BaseMessage::ptr rsp_msg;
+                if (_requesor->Send(conn, std::dynamic_pointer_cast<BaseMessage>(req_msg), rsp_msg) == false)
+                {
+                    LOG(LogLevel::ERROR) << "请求发送失败";
+                    return false;
+                }
+                auto rpc_rsp = std::dynamic_pointer_cast<RpcResponse>(rsp_msg);
+                if (!rpc_rsp)
+                {
+                    LOG(LogLevel::ERROR) << "向下类型转换失败";
+                    return false;
+                }
+                if (rpc_rsp->GetRcode() != RCode::RCODE_OK)
+                {
+                    LOG(LogLevel::ERROR) << "RPC同步请求失败" << ErrReason(rpc_rsp->GetRcode());
+                    return false;
+                }
+                return rpc_rsp->GetResultAs(result);
+            }
+
         private:
             void CallBack1(const BaseMessage::ptr &msg, const JsonResponseCallback &cb)
             {
@@ -5,6 +5,7 @@
 #include "Rpc_Topic.hpp"
 
 #include <shared_mutex>
+#include <limits>
 namespace Rpc
 {
     namespace Client
@@ -13,7 +14,7 @@ namespace Rpc
         {
         public:
             using ptr = std::shared_ptr<RegistryClient>;
-            RegistryClient(const std::string &ip, int port) : 
+            RegistryClient(const std::string &ip, int port, const ClientOptions &options = ClientOptions()) : 
             _requestor(std::make_shared<Requestor>()),
             _provider(std::make_shared<Provider>(_requestor)),
             _dispatcher(std::make_shared<Dispatcher>())
@@ -22,14 +23,20 @@ namespace Rpc
                 _dispatcher->RegisterHandler<ServiceResponse>(MType::RSP_SERVICE, rsp_cb); // 注册响应处理函数
 
                 auto msg_cb = std::bind(&Dispatcher::OnMessage, _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
-                _client = ClientFactory::Create(ip, port);
+                _client = ClientFactory::Create(ip, port, options);
                 _client->SetMessageCallback(msg_cb); // 注册消息处理函数
-                _client->Connect();
+                if (_client->Connect() == false)
+                    LOG(LogLevel::ERROR) << "连接服务器超时，后台继续重连";
             }
 
-            bool RegisterMethod(const std::string &method, const Address &host)
+            bool RegisterMethod(const std::string &method, const Address &host, const LocalAddress &local = LocalAddress())
             {
-                return _provider->RegistryMethod(_client->Connection(), method, host);
+                return _provider->RegistryMethod(_client->Connection(), method, host, local);
+            }
+            // 断开和注册中心的连接(不再重连)，注册中心随即把这个连接上注册的方法全部下线并通知发现者
+            void Shutdown()
+            {
+                _client->Shutdown();
             }
 
         private:
@@ -43,10 +50,13 @@ namespace Rpc
         {
         public:
             using ptr = std::shared_ptr<DiscoveryClient>;
+            // latency_cb非空时按提供者连接的往返时间选择提供者
             DiscoveryClient(const std::string &ip, int port, 
-                const Discoverer::OfflineCallback &offline_cb)
+                const Discoverer::OfflineCallback &offline_cb,
+                const LatencyCallback &latency_cb = LatencyCallback(),
+                const ClientOptions &options = ClientOptions())
                 : _requestor(std::make_shared<Requestor>()),
-                  _discoverer(std::make_shared<Discoverer>(_requestor, offline_cb)),
+                  _discoverer(std::make_shared<Discoverer>(_requestor, offline_cb, latency_cb)),
                   _dispatcher(std::make_shared<Dispatcher>())
             {
                 auto rsp_cb = std::bind(&Requestor::OnResponse, _requestor.get(),
@@ -60,15 +70,21 @@ namespace Rpc
                 auto msg_cb = std::bind(&Dispatcher::OnMessage, _dispatcher.get(), 
                 std::placeholders::_1, std::placeholders::_2);
                 
-                _client = ClientFactory::Create(ip, port);
+                _client = ClientFactory::Create(ip, port, options);
                 _client->SetMessageCallback(msg_cb); // 注册消息处理函数
-                _client->Connect();
+                if (_client->Connect() == false)
+                    LOG(LogLevel::ERROR) << "连接服务器超时，后台继续重连";
             }
 
             bool ServiceDiscovery(const std::string &method, Address &host)
             {
                 return _discoverer->ServiceDiscovery(_client->Connection(), method, host);
             }
+            // 提供者在同一台机器上并且公布了unix socket时返回true
+            bool LocalPath(const Address &host, std::string &path)
+            {
+                return _discoverer->LocalPath(host, path);
+            }
 
         private:
             Requestor::ptr _requestor;
@@ -82,7 +98,10 @@ namespace Rpc
         public:
             using ptr = std::shared_ptr<RpcClient>;
 
-            RpcClient(bool enablediscovery, const std::string &ip, int port) : _enablediscovery(enablediscovery),
+            // options用于连接服务提供者(或直连的服务端)，比如选择io_uring后端
+            RpcClient(bool enablediscovery, const std::string &ip, int port,
+                      const ClientOptions &options = ClientOptions()) : _enablediscovery(enablediscovery),
+                                                                               _options(options),
                                                                                _requestor(std::make_shared<Requestor>()),
                                                                                _dispatcher(std::make_shared<Dispatcher>()),
                                                                                _caller(std::make_shared<RpcCaller>(_requestor))
@@ -93,14 +112,20 @@ namespace Rpc
                 if (_enablediscovery)
                 {
                     auto offline_cb = std::bind(&RpcClient::DelClient, this, std::placeholders::_1);
-                    _discovery_client = std::make_shared<DiscoveryClient>(ip, port, offline_cb);
+                    auto latency_cb = std::bind(&RpcClient::Latency, this, std::placeholders::_1);
+                    // 注册中心的连接只沿用消息体编码和压缩，其余参数是给提供者连接的
+                    ClientOptions registry_options;
+                    registry_options.codec = _options.codec;
+                    registry_options.compress = _options.compress;
+                    _discovery_client = std::make_shared<DiscoveryClient>(ip, port, offline_cb, latency_cb, registry_options);
                 }
                 else
                 {
                     auto msg_cb = std::bind(&Dispatcher::OnMessage, _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
-                    _rpc_client = ClientFactory::Create(ip, port);
+                    _rpc_client = ClientFactory::Create(ip, port, _options);
                     _rpc_client->SetMessageCallback(msg_cb); // 注册消息处理函数
-                    _rpc_client->Connect();
+                    if (_rpc_client->Connect() == false)
+                        LOG(LogLevel::ERROR) << "连接服务器超时，后台继续重连";
                 }
             }
 
@@ -135,24 +160,41 @@ namespace Rpc
 
                 return _caller->Call(client->Connection(), method, params, cb);
             }
+            template <typename Req, typename Rsp, typename = std::enable_if_t<IsSchema<Req>::value && IsSchema<Rsp>::value>>
+            bool Call(const std::string &method, const Req &params, Rsp &result)
+            {
+                BaseClient::ptr client = GetClient(method);
+                if (client.get() == nullptr)
+                {
+                    return false;
+                }
+
+                return _caller->Call(client->Connection(), method, params, result);
+            }
 
         private:
             BaseClient::ptr CreatClient(const Address &host)
             {
-                // 第一重检查：无锁或共享锁快速路径
-                {
-                    std::shared_lock<std::shared_mutex> lock(_shared_mutex); // 使用共享锁，允许多个读线程
-                    if (auto it = _rpc_clients.find(host); it != _rpc_clients.end())
-                    {
-                        return it->second;
-                    }
-                }
+                // 第一重检查：共享锁快速路径
+                if (BaseClient::ptr client = GetClient(host); client.get() != nullptr)
+                    return client;
 
                 // 只有未找到的线程会进入这个耗时区域，并且此时无锁，不会阻塞其他读线程
-                auto client = ClientFactory::Create(host.first, host.second);
+                // 同一台机器上的提供者的unix socket还在时走unix socket，否则走TCP；连接池中仍然以TCP地址为键
+                std::string ip = host.first;
+                int port = host.second;
+                std::string path;
+                if (_discovery_client && _discovery_client->LocalPath(host, path) && ::access(path.c_str(), F_OK) == 0)
+                {
+                    ip = UnixAddress::Make(path);
+                    port = 0;
+                }
+                auto client = ClientFactory::Create(ip, port, _options);
                 client->SetMessageCallback(std::bind(&Dispatcher::OnMessage,
                                                      _dispatcher.get(), std::placeholders::_1, std::placeholders::_2));
-                client->Connect();
+                // 连不上也放进池中，后台重连成功之后就可以直接使用
+                if (client->Connect() == false)
+                    LOG(LogLevel::ERROR) << "连接服务提供者超时: " << host.first << ":" << host.second;
 
                 // 第二重检查：加独占锁，确保唯一性
                 std::unique_lock<std::shared_mutex> lock(_shared_mutex);
@@ -169,7 +211,7 @@ namespace Rpc
             }
             BaseClient::ptr GetClient(const Address &host)
             {
-                std::unique_lock<std::mutex> lock(_mutex);
+                std::shared_lock<std::shared_mutex> lock(_shared_mutex); // 使用共享锁，允许多个读线程
                 auto it = _rpc_clients.find(host);
                 if (it != _rpc_clients.end())
                 {
@@ -202,14 +244,25 @@ namespace Rpc
                 }
                 return client;
             }
+            // 提供者连接上心跳测得的往返时间；还没有连接时返回-1，连接断开时返回最大值，选择时排在最后
+            int64_t Latency(const Address &host)
+            {
+                BaseClient::ptr client = GetClient(host);
+                if (client.get() == nullptr)
+                    return -1;
+                BaseConnection::ptr conn = client->Connection();
+                if (conn.get() == nullptr || conn->Connected() == false)
+                    return std::numeric_limits<int64_t>::max();
+                return conn->RttUs();
+            }
             void PutClient(const Address &host, const BaseClient::ptr &client)
             {
-                std::unique_lock<std::mutex> lock(_mutex);
+                std::unique_lock<std::shared_mutex> lock(_shared_mutex);
                 _rpc_clients.insert(std::make_pair(host, client));
             }
             void DelClient(const Address &host)
             {
-                std::unique_lock<std::mutex> lock(_mutex);
+                std::unique_lock<std::shared_mutex> lock(_shared_mutex);
                 auto it = _rpc_clients.find(host);
                 if (it != _rpc_clients.end())
                 {
@@ -231,12 +284,13 @@ namespace Rpc
                 }
             };
             bool _enablediscovery;
+            ClientOptions _options;
             Requestor::ptr _requestor;
             Dispatcher::ptr _dispatcher;
             DiscoveryClient::ptr _discovery_client;
             BaseClient::ptr _rpc_client;
             RpcCaller::ptr _caller;
-            std::mutex _mutex;
+            // 保护_rpc_clients：查找用共享锁，插入和删除用独占锁
             std::shared_mutex _shared_mutex;
 
             // 长连接，实例化rpc客户端  rpc客户端池
@@ -248,7 +302,7 @@ namespace Rpc
         {
         public:
             using ptr = std::shared_ptr<TopicClient>;
-            TopicClient(const std::string &ip, int port) : 
+            TopicClient(const std::string &ip, int port, const ClientOptions &options = ClientOptions()) : 
             _requestor(std::make_shared<Requestor>()),
             _dispatcher(std::make_shared<Dispatcher>()),
             _topic_manager(std::make_shared<TopicManager>(_requestor))
@@ -263,9 +317,10 @@ namespace Rpc
                 _dispatcher->RegisterHandler<TopicRequest>(MType::REQ_TOPIC, req_cb); // 注册响应处理函数
 
                 auto msg_cb = std::bind(&Dispatcher::OnMessage, _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
-                _client = ClientFactory::Create(ip, port);
+                _client = ClientFactory::Create(ip, port, options);
                 _client->SetMessageCallback(msg_cb); // 注册消息处理函数
-                _client->Connect();
+                if (_client->Connect() == false)
+                    LOG(LogLevel::ERROR) << "连接服务器超时，后台继续重连";
             }
             bool Creat(const std::string &topic)
             {
@@ -1,6 +1,7 @@
 #pragma once
 #include "Requestor.hpp"
 #include <unordered_set>
+#include <map>
 namespace Rpc
 {
     namespace Client
@@ -10,12 +11,14 @@ namespace Rpc
         public:
             using ptr = std::shared_ptr<Provider>;
             Provider(const Requestor::ptr &requestor) : _requestor(requestor) {}
-            bool RegistryMethod(const BaseConnection::ptr &conn, const std::string &method, const Address &host)
+            // local非空时同时公布本机的unix socket地址，同一台机器上的调用方会优先使用它
+            bool RegistryMethod(const BaseConnection::ptr &conn, const std::string &method, const Address &host,
+                                const LocalAddress &local = LocalAddress())
             {
                 auto msg_req = MessageFactory::CreateMessage<ServiceRequest>();
                 msg_req->SetId(UUID::Uuid());
                 msg_req->SetMethod(method);
-                msg_req->SetHost(host);
+                msg_req->SetHost(host, local);
                 msg_req->SetType(MType::REQ_SERVICE);
                 msg_req->SetOptype(ServiceOptype::SERVICE_REGISTRY);
                 BaseMessage::ptr msg_rsp;
@@ -44,6 +47,9 @@ namespace Rpc
             Requestor::ptr _requestor;
         };
 
+        // 查询到某个提供者连接的往返时间(微秒)，还没有测到时返回-1
+        using LatencyCallback = std::function<int64_t(const Address &)>;
+
         class MethodHost
         {
         public:
@@ -58,13 +64,34 @@ namespace Rpc
                 std::unique_lock<std::mutex> lock(_mutex);
                 _hosts.push_back(host);
             }
-            Address ChooseHost()
+            // 没有latency时轮询；有latency时在轮询到的相邻两个提供者中选往返时间小的
+            // 还没有测到往返时间的提供者按0处理，新上线的提供者也能先分到请求
+            // 没有提供者时返回false：检查和选择在同一次加锁中完成，并发的下线通知不会在两者之间清空_hosts
+            bool ChooseHost(Address &host, const LatencyCallback &latency = LatencyCallback())
+            {
+                Address second;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if (_hosts.empty())
+                        return false;
+                    size_t pos = _index++ % _hosts.size();
+                    host = _hosts[pos];
+                    if (!latency || _hosts.size() < 2)
+                        return true;
+                    second = _hosts[(pos + 1) % _hosts.size()];
+                }
+                // latency会去查调用方的连接池，放在锁外调用
+                int64_t first_rtt = std::max<int64_t>(latency(host), 0);
+                int64_t second_rtt = std::max<int64_t>(latency(second), 0);
+                if (second_rtt < first_rtt)
+                    host = second;
+                return true;
+            }
+            bool Empty() const
             {
                 std::unique_lock<std::mutex> lock(_mutex);
-                size_t pos = _index++ % _hosts.size();
-                return _hosts[pos];
+                return _hosts.empty();
             }
-            bool Empty() const { return _hosts.empty(); };
             void RemoveHost(const Address &host)
             {
                 std::unique_lock<std::mutex> lock(_mutex);
@@ -76,7 +103,7 @@ namespace Rpc
             }
 
         private:
-            std::mutex _mutex;
+            mutable std::mutex _mutex;
             size_t _index;
             std::vector<Address> _hosts;
         };
@@ -85,29 +112,27 @@ namespace Rpc
         public:
             using OfflineCallback = std::function<void(const Address&)>;
             using ptr = std::shared_ptr<Discoverer>;
-            Discoverer(const Requestor::ptr &requestor,const OfflineCallback &offline_callback) :
-            _requestor(requestor),_offline_callback(offline_callback) {}
+            Discoverer(const Requestor::ptr &requestor,const OfflineCallback &offline_callback,
+                       const LatencyCallback &latency_callback = LatencyCallback()) :
+            _offline_callback(offline_callback),_latency_callback(latency_callback),_requestor(requestor) {}
 
             bool ServiceDiscovery(const BaseConnection::ptr &conn, const std::string &method, Address &host)
             {
                 // 在缓存中存在客服端发现的服务，直接从表中调用，使用轮询算法
+                MethodHost::ptr cached;
                 {  
                     std::unique_lock<std::mutex> lock(_mutex);
                     auto it = _method_hosts.find(method);
                     if (it != _method_hosts.end())
-                    {
-                        if(!it->second->Empty())
-                        {
-                            host = it->second->ChooseHost();
-                            return true;
-                        }
-                    }
+                        cached = it->second;
                    
                     // 后续实现一下缓存检查问题
                     //
                     //
                     //
                 }
+                if (cached && cached->ChooseHost(host, _latency_callback))
+                    return true;
                 // 缓冲中没有这个服务，那么就需要去中间服务器发现
                 auto msg_req = MessageFactory::CreateMessage<ServiceRequest>();
                 msg_req->SetId(UUID::Uuid());
@@ -144,14 +169,13 @@ namespace Rpc
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
                     _method_hosts[method] = method_hosts;
+                    auto hosts = msg->GetHosts();
+                    auto locals = msg->GetLocalHosts();
+                    for (size_t i = 0; i < hosts.size() && i < locals.size(); i++)
+                        AddLocalPath(hosts[i], locals[i]);
                 }
-                auto hosts = msg->GetHosts();
-                if (!hosts.empty())
-                {
-                    host = method_hosts->ChooseHost();
-                    return true;
-                }
-                return false;
+                // 缓存之后下线通知可能已经移除了提供者
+                return method_hosts->ChooseHost(host, _latency_callback);
             }
 
             void OnServiceRequest(const BaseConnection::ptr &conn, const ServiceRequest::ptr &msg)
@@ -159,19 +183,22 @@ namespace Rpc
                 //判断是什么请求
                 auto optype = msg->GetOptype();
                 auto method = msg->GetMethod();
+                Address host = msg->GetHost();
                 std::unique_lock<std::mutex> lock(_mutex);
-                if(optype == ServiceOptype::SERVICE_REGISTRY)
+                // 注册中心发来的上线通知是SERVICE_ONLINE
+                if(optype == ServiceOptype::SERVICE_REGISTRY || optype == ServiceOptype::SERVICE_ONLINE)
                 {
+                    AddLocalPath(host, msg->GetLocalHost());
                     auto it = _method_hosts.find(method);
                     if(it == _method_hosts.end())
                     {
                         auto method_hosts = std::make_shared<MethodHost>();
-                        method_hosts->AppendHost(msg->GetHost());
+                        method_hosts->AppendHost(host);
                         _method_hosts[method] = method_hosts;
                     }
                     else
                     {
-                        it->second->AppendHost(msg->GetHost());
+                        it->second->AppendHost(host);
                     }
                 }
                 else if(optype == ServiceOptype::SERVICE_OFFLINE)
@@ -179,18 +206,43 @@ namespace Rpc
                     auto it = _method_hosts.find(method);
                     if(it!= _method_hosts.end())
                     {
-                        it->second->RemoveHost(msg->GetHost());
-                        _offline_callback(msg->GetHost());
+                        it->second->RemoveHost(host);
+                        _offline_callback(host);
                     }
                     else
                         return;
                 }
             }
 
+            // 提供者和自己在同一台机器上、并且公布了unix socket时返回socket的路径
+            // 提供者始终以TCP地址标识，上线、下线通知和连接池都用它；路径是否存在留到连接时再检查，
+            // 提供者退出时先删掉socket文件再下线，按文件是否存在来决定地址的话下线通知会对不上
+            bool LocalPath(const Address &host, std::string &path)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _local_paths.find(host);
+                if (it == _local_paths.end())
+                    return false;
+                path = it->second;
+                return true;
+            }
+
+        private:
+            // 调用时已经持有_mutex
+            void AddLocalPath(const Address &host, const LocalAddress &local)
+            {
+                if (local.second.empty() || local.first != Host::Name())
+                    return;
+                _local_paths[host] = local.second;
+            }
+
         private:
             OfflineCallback _offline_callback;
+            LatencyCallback _latency_callback;
             std::mutex _mutex;
             std::unordered_map<std::string, MethodHost::ptr> _method_hosts;
+            // 同一台机器上的提供者：TCP地址 -> unix socket路径
+            std::map<Address, std::string> _local_paths;
             Requestor::ptr _requestor;
         };
     }
@@ -1,6 +1,9 @@
 #pragma once
+#include <atomic>
 #include <memory>
 #include <functional>
+#include <string_view>
+#include <ostream>
 #include "Fields.hpp"
 
 namespace Rpc
@@ -18,7 +21,18 @@ namespace Rpc
         virtual MType GetType() { return _mytype; }
 
         virtual std::string Serialize() = 0;
-        virtual bool Deserialize(const std::string& data) = 0;
+        // 发送路径用它把消息体直接写进连接的发送缓冲区，默认实现退化为先序列化成字符串再拷贝一次
+        virtual bool SerializeTo(std::ostream &out)
+        {
+            std::string body = Serialize();
+            out.write(body.data(), body.size());
+            return out.good();
+        }
+        // 接收端直接传入协议缓冲区中的视图，实现中不能保存这个视图
+        virtual bool Deserialize(std::string_view data) = 0;
+        // Codec::CODEC_BINARY编码的消息体，追加到out之后；不支持的消息返回false，发送方改用JSON
+        virtual bool SerializeBinary(std::string &) { return false; }
+        virtual bool DeserializeBinary(std::string_view) { return false; }
         virtual bool Check() = 0;
 
     private:
@@ -36,6 +50,15 @@ namespace Rpc
         virtual void  RetrieveInt32() = 0; //删除已经取出的4字节数据
         virtual int32_t ReadInt32() = 0; //读取4字节数据并且指向后面4字节
         virtual std::string RetrieveAsString(size_t len) = 0; //删除已经取出的len字节数据并返回字符串
+        virtual const char *Peek() = 0; //可读区域的起始地址，不取出数据
+        virtual void Retrieve(size_t len) = 0; //删除len字节数据，不做拷贝
+
+        virtual void Append(const void *data, size_t len) = 0; //追加数据
+        virtual void PrependInt32(int32_t val) = 0; //以网络字节序写入可读区域之前的预留空间
+        virtual char *BeginWrite() = 0; //可写区域的起始地址，用于直接在缓冲区中序列化
+        virtual size_t WritableSize() = 0;
+        virtual void EnsureWritable(size_t len) = 0;
+        virtual void HasWritten(size_t len) = 0; //直接写入可写区域之后，提交len字节
     };
 
     class BaseProtocol
@@ -46,6 +69,21 @@ namespace Rpc
         virtual bool IsProcessable(const BaseBuffer::ptr& buffer) = 0;
         virtual bool OnMessage(const BaseBuffer::ptr& buffer, BaseMessage::ptr &msg) = 0;
         virtual std::string Serialize(const BaseMessage::ptr& msg) = 0;     
+        // 把完整的报文直接写进一个空的缓冲区
+        virtual bool Serialize(const BaseMessage::ptr& msg, const BaseBuffer::ptr& buffer) = 0;
+        // 发送时使用的消息体编码，连接上协商完成后设置；接收端按每一帧的标志位解码，不受它影响
+        virtual void SetCodec(Codec) {}
+        virtual Codec GetCodec() { return Codec::CODEC_JSON; }
+        // 压缩协商：发起方用CompressOffer得到想用的算法和字典校验和；接收方用AcceptCompress决定并立即启用，
+        // 返回接受的算法，dict_id改成实际使用的字典(0表示不用)；发起方收到确认后用EnableCompress启用
+        // 接收端按每一帧的标志位解压，不受这些状态影响
+        virtual Compression CompressOffer(uint32_t &) { return Compression::COMPRESS_NONE; }
+        virtual Compression AcceptCompress(Compression, uint32_t &) { return Compression::COMPRESS_NONE; }
+        virtual void EnableCompress(Compression, uint32_t) {}
+        virtual Compression GetCompress() { return Compression::COMPRESS_NONE; }
+        // 客户端在连接建立后、发出任何请求之前调用：想用的编码和本端配置的压缩作为提议附在之后第一条请求上，
+        // 对端确认之后才切换，不认识提议的老版本对端照常处理这条请求
+        virtual void Offer(Codec) {}
     };
 
     class BaseConnection
@@ -56,14 +94,43 @@ namespace Rpc
         virtual void Send(const BaseMessage::ptr& msg) = 0;
         virtual bool Connected() = 0;
         virtual void Shutdown() = 0;
+        // 连接自己的协议对象(保存着该连接的分片重组等状态)
+        virtual const BaseProtocol::ptr &Protocol() = 0;
+
+        using HighWaterMarkCallback = std::function<void(const ptr&, size_t)>;
+        // 发送缓冲区积压超过mark字节时按policy处理，并调用cb(连接, 积压字节数)，mark为0表示不限制
+        virtual void SetHighWaterMark(size_t mark, OverloadPolicy policy, const HighWaterMarkCallback &cb) = 0;
+        // 积压超过高水位且还没有写完
+        virtual bool Overloaded() = 0;
+        // 过载时新请求是否直接以RCODE_OVERLOADED拒绝；OVERLOAD_STOP_PEER_READ只停止读取，已经读进来的请求照常处理
+        virtual bool RejectRequests() { return Overloaded(); }
+        // 还没有写到socket中的字节数，任意线程都可以调用，非IO线程上得到的是最近一次的快照
+        virtual size_t BacklogBytes() = 0;
+        // 连接当前占用的收发缓冲区容量(字节)，任意线程都可以调用，得到的是IO线程最近一次更新的快照
+        virtual size_t BufferBytes() = 0;
+
+        // 心跳测得的平滑往返时间(微秒)，还没有测到时为-1，任意线程都可以调用
+        int64_t RttUs() const { return _rtt_us.load(std::memory_order_relaxed); }
+        // 在连接所属的IO线程中记录一次测量值，和TCP的SRTT一样按1/8的权重平滑
+        void AddRttSample(int64_t us)
+        {
+            int64_t old = _rtt_us.load(std::memory_order_relaxed);
+            _rtt_us.store(old < 0 ? us : old + (us - old) / 8, std::memory_order_relaxed);
+        }
+        // 收到过对端的心跳响应：对端认识心跳消息，可以主动向它发送心跳
+        bool PeerHeartbeat() const { return _peer_heartbeat.load(std::memory_order_relaxed); }
+        void SetPeerHeartbeat() { _peer_heartbeat.store(true, std::memory_order_relaxed); }
 
     private:
         BaseProtocol::ptr _protocol;
+        std::atomic<int64_t> _rtt_us{-1};
+        std::atomic<bool> _peer_heartbeat{false};
     };
 
     using ConnectionCallback = std::function<void(const BaseConnection::ptr&)>;
     using CloseCallback = std::function<void(const BaseConnection::ptr&)>;
     using MessageCallback = std::function<void(const BaseConnection::ptr&, const BaseMessage::ptr&)>;
+    using HighWaterMarkCallback = BaseConnection::HighWaterMarkCallback;
     
     class BaseServer
     {
@@ -71,16 +138,23 @@ namespace Rpc
         using ptr = std::shared_ptr<BaseServer>;
         virtual ~BaseServer() {}
         virtual void Start() = 0;
-        //virtual bool Stop() = 0;
+        // 以下两个函数可以在任意线程中调用
+        // 不再接受新连接，已有连接照常收发
+        virtual void StopAccept() = 0;
+        // 优雅停止：不再接受新连接，已有连接在发送缓冲区写空之后关闭写端，
+        // 等对端关闭连接，最多等timeout_ms之后强制关闭剩下的连接，然后让Start返回
+        virtual void Stop(int timeout_ms) = 0;
         //virtual bool AddConnection(const BaseConnection::ptr& conn) = 0;
         //virtual bool RemoveConnection(const BaseConnection::ptr& conn) = 0;
         virtual void SetConnectionCallback(const ConnectionCallback& cb) { _on_connection = cb; }
         virtual void SetCloseCallback(const CloseCallback& cb) { _on_close = cb; }
         virtual void SetMessageCallback(const MessageCallback& cb) { _on_message = cb; }
+        virtual void SetHighWaterMarkCallback(const HighWaterMarkCallback& cb) { _on_high_water_mark = cb; }
     protected:
         ConnectionCallback _on_connection;
         CloseCallback _on_close;
         MessageCallback _on_message;
+        HighWaterMarkCallback _on_high_water_mark;
     };
 
     class BaseClient {
@@ -90,7 +164,8 @@ namespace Rpc
             virtual void SetCloseCallback(const CloseCallback& cb) {_on_close = cb;}
             virtual void SetMessageCallback(const MessageCallback& cb) {_on_message = cb;}
 
-            virtual void Connect() = 0;
+            // 在超时时间内没有连上返回false
+            virtual bool Connect() = 0;
             virtual void Shutdown() = 0;
             virtual bool Send(const BaseMessage::ptr&) = 0;
             virtual BaseConnection::ptr Connection() = 0;
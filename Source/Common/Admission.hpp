@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "Detail.hpp"
+
+namespace Rpc
+{
+    // 服务端的连接准入控制：连接总数、单个IP的连接数、每秒新建连接数三项上限
+    // 在accept之后、创建任何连接对象之前判断，被拒绝的fd直接关闭，重连风暴时服务端不会为它们分配内存
+    // acceptor_groups大于1时各组共用一个，多个accept线程同时调用，内部加锁
+    class AdmissionControl
+    {
+    public:
+        using ptr = std::shared_ptr<AdmissionControl>;
+        // 参数为0表示该项不限制；新建连接数允许一秒的突发
+        AdmissionControl(size_t max_connections, size_t max_per_ip, int accept_rate)
+            : _max_connections(max_connections), _max_per_ip(max_per_ip), _accept_rate(accept_rate),
+              _tokens(accept_rate), _refill_us(Clock::NowUs()), _connections(0),
+              _rejected(0), _rejected_since_log(0), _last_log_us(0) {}
+
+        // 三项都不限制时返回空，服务端跳过准入判断
+        static ptr Create(size_t max_connections, size_t max_per_ip, int accept_rate)
+        {
+            if (max_connections == 0 && max_per_ip == 0 && accept_rate <= 0)
+                return ptr();
+            return std::make_shared<AdmissionControl>(max_connections, max_per_ip, accept_rate);
+        }
+        // ip是网络字节序的IPv4地址，0表示不按IP限制(unix域套接字)；返回true时连接关闭后必须调用Release
+        bool Admit(uint32_t ip)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            const char *reason = nullptr;
+            if (_max_connections > 0 && _connections >= _max_connections)
+                reason = "连接数达到上限";
+            else if (_max_per_ip > 0 && ip != 0 && PerIp(ip) >= _max_per_ip)
+                reason = "单个IP的连接数达到上限";
+            else if (_accept_rate > 0 && TakeToken() == false)
+                reason = "新建连接速率超过上限";
+            if (reason != nullptr)
+            {
+                _rejected++;
+                LogRejected(reason);
+                return false;
+            }
+            _connections++;
+            if (ip != 0 && _max_per_ip > 0)
+                _per_ip[ip]++;
+            return true;
+        }
+        void Release(uint32_t ip)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_connections > 0)
+                _connections--;
+            if (ip == 0 || _max_per_ip == 0)
+                return;
+            auto it = _per_ip.find(ip);
+            if (it != _per_ip.end() && --it->second == 0)
+                _per_ip.erase(it);
+        }
+        // 当前被接受、还没有关闭的连接数
+        size_t Connections()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _connections;
+        }
+        // 累计拒绝的连接数
+        uint64_t Rejected()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _rejected;
+        }
+
+    private:
+        size_t PerIp(uint32_t ip) const
+        {
+            auto it = _per_ip.find(ip);
+            return it == _per_ip.end() ? 0 : it->second;
+        }
+        // 令牌桶，容量为一秒的配额
+        bool TakeToken()
+        {
+            int64_t now = Clock::NowUs();
+            _tokens = std::min<double>(_accept_rate, _tokens + (now - _refill_us) * _accept_rate / 1e6);
+            _refill_us = now;
+            if (_tokens < 1)
+                return false;
+            _tokens -= 1;
+            return true;
+        }
+        // 风暴中每个被拒绝的连接都打日志本身就是负担，每秒最多汇总一条
+        void LogRejected(const char *reason)
+        {
+            _rejected_since_log++;
+            int64_t now = Clock::NowUs();
+            if (now - _last_log_us < logIntervalUs)
+                return;
+            LOG(LogLevel::WARNING) << "拒绝新连接(" << reason << ")，最近一段时间共拒绝" << _rejected_since_log
+                                   << "个，当前连接数" << _connections;
+            _rejected_since_log = 0;
+            _last_log_us = now;
+        }
+
+    private:
+        static constexpr int64_t logIntervalUs = 1000000;
+        const size_t _max_connections;
+        const size_t _max_per_ip;
+        const int _accept_rate;
+        std::mutex _mutex;
+        double _tokens;
+        int64_t _refill_us;
+        size_t _connections;
+        std::unordered_map<uint32_t, size_t> _per_ip;
+        uint64_t _rejected;
+        uint64_t _rejected_since_log;
+        int64_t _last_log_us;
+    };
+}
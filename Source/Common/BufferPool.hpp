@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <muduo/net/Buffer.h>
+
+namespace Rpc
+{
+    // 连接缓冲区的内存统计(字节)，任意线程都可以读取
+    class BufferStats
+    {
+    public:
+        // 所有连接当前占用的收发缓冲区容量之和
+        static std::atomic<int64_t> &ConnectionBytes()
+        {
+            static std::atomic<int64_t> bytes(0);
+            return bytes;
+        }
+        // 各线程缓冲区池中空闲缓冲区的容量之和
+        static std::atomic<int64_t> &PooledBytes()
+        {
+            static std::atomic<int64_t> bytes(0);
+            return bytes;
+        }
+    };
+
+    // 一个连接的缓冲区占用：在连接所属的线程中更新，任意线程读取，变化量同时累加到BufferStats::ConnectionBytes
+    class BufferUsage
+    {
+    public:
+        BufferUsage() : _bytes(0) {}
+        ~BufferUsage() { Set(0); }
+        void Set(size_t bytes)
+        {
+            size_t old = _bytes.exchange(bytes, std::memory_order_relaxed);
+            if (old != bytes)
+                BufferStats::ConnectionBytes().fetch_add((int64_t)bytes - (int64_t)old, std::memory_order_relaxed);
+        }
+        size_t Get() const { return _bytes.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<size_t> _bytes;
+    };
+
+    // 按容量分档的缓冲区池，每个线程一个，只在本线程中使用
+    // 连接只在有数据时借一个缓冲区，读空、写空之后还回来，大量空闲连接不再各自占着峰值大小的缓冲区
+    // 超过最大一档的缓冲区不入池直接释放，相当于峰值过后自动收缩
+    class BufferPool
+    {
+    public:
+        using BufferPtr = std::unique_ptr<muduo::net::Buffer>;
+        // 容量超过它、而可读数据不到容量1/4的缓冲区在Shrink时收缩
+        static constexpr size_t shrinkThreshold = (64 << 10);
+
+        static BufferPool &Local()
+        {
+            static thread_local BufferPool pool;
+            return pool;
+        }
+        ~BufferPool()
+        {
+            for (auto &free_list : _free)
+            {
+                for (auto &buf : free_list)
+                    BufferStats::PooledBytes().fetch_sub(buf->internalCapacity(), std::memory_order_relaxed);
+            }
+        }
+
+        // 取一个至少能放下hint字节的缓冲区，池中没有时新建
+        BufferPtr Get(size_t hint = 0)
+        {
+            for (size_t i = ClassFor(hint); i < classCount; i++)
+            {
+                if (_free[i].empty())
+                    continue;
+                BufferPtr buf = std::move(_free[i].back());
+                _free[i].pop_back();
+                BufferStats::PooledBytes().fetch_sub(buf->internalCapacity(), std::memory_order_relaxed);
+                return buf;
+            }
+            BufferPtr buf(new muduo::net::Buffer());
+            buf->ensureWritableBytes(hint);
+            return buf;
+        }
+        // 归还的缓冲区中的数据会被丢弃
+        void Put(BufferPtr buf)
+        {
+            if (buf.get() == nullptr)
+                return;
+            size_t capacity = buf->internalCapacity();
+            if (capacity > classSizes[classCount - 1])
+                return;
+            // 放进容量不小于该档大小的最大一档，Get从某一档取出的缓冲区一定放得下该档大小
+            size_t index = 0;
+            while (index + 1 < classCount && capacity >= classSizes[index + 1])
+                index++;
+            if (_free[index].size() >= classLimits[index])
+                return;
+            buf->retrieveAll();
+            BufferStats::PooledBytes().fetch_add(capacity, std::memory_order_relaxed);
+            _free[index].push_back(std::move(buf));
+        }
+        // 峰值过后收缩：换成一个刚好放下剩余数据的小缓冲区
+        static void Shrink(muduo::net::Buffer *buf)
+        {
+            if (buf->internalCapacity() > shrinkThreshold && buf->readableBytes() < buf->internalCapacity() / 4)
+                buf->shrink(0);
+        }
+        static size_t Capacity(const BufferPtr &buf)
+        {
+            return buf ? buf->internalCapacity() : 0;
+        }
+
+    private:
+        static constexpr size_t classCount = 4;
+        static constexpr size_t classSizes[classCount] = {1 << 10, 4 << 10, 16 << 10, 64 << 10};
+        // 每一档最多缓存的个数，大的档少留一些
+        static constexpr size_t classLimits[classCount] = {256, 256, 64, 16};
+
+        static size_t ClassFor(size_t hint)
+        {
+            size_t index = 0;
+            while (index + 1 < classCount && classSizes[index] < hint)
+                index++;
+            return index;
+        }
+
+    private:
+        std::vector<BufferPtr> _free[classCount];
+    };
+}
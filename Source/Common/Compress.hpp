@@ -0,0 +1,248 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <arpa/inet.h>
+
+#include "Fields.hpp"
+
+namespace Rpc
+{
+    // 一端的压缩配置：客户端在ClientOptions中设置想用的算法，服务端在ServerOptions中设置接受的算法
+    struct CompressOptions
+    {
+        Compression compression = Compression::COMPRESS_NONE;
+        // 消息体小于这么多字节时不压缩，压缩后没有变小的也按原样发送
+        size_t threshold = 1024;
+        // 预置字典，两端内容相同(协商时比较校验和)才会使用，为空表示不用字典
+        // 消息体大多是键名固定的小JSON，字典让第一次出现的键名也能被压缩
+        std::shared_ptr<const std::string> dictionary = DefaultDictionary();
+
+        // 协议字段拼成的字典，和JSON::Serialize的紧凑输出一致；两端版本相同时校验和一致
+        static std::shared_ptr<const std::string> DefaultDictionary()
+        {
+            static const std::shared_ptr<const std::string> dict = std::make_shared<const std::string>(
+                "{\"host\":[{\"hostname\":\"\",\"ip\":\"\",\"port\":0,\"unix_path\":\"\"}],"
+                "\"method\":\"\",\"optype\":0,\"rcode\":0}"
+                "{\"method\":\"\",\"optype\":0,\"host\":{\"ip\":\"\",\"port\":0}}"
+                "{\"optype\":4,\"topic_key\":\"\",\"topic_msg\":{\"\":\"\"}}"
+                "{\"method\":\"\",\"parameters\":{\"\":\"\"}}"
+                "{\"rcode\":0,\"result\":{\"\":\"\"}}"
+                "true,false,null,");
+            return dict;
+        }
+        // 字典内容的校验和，0表示没有字典
+        static uint32_t DictionaryId(const std::shared_ptr<const std::string> &dict)
+        {
+            if (dict.get() == nullptr || dict->empty())
+                return 0;
+            uint32_t hash = 2166136261u; // FNV-1a
+            for (unsigned char c : *dict)
+                hash = (hash ^ c) * 16777619u;
+            return hash == 0 ? 1 : hash;
+        }
+    };
+
+    // LZ4块格式的压缩和解压，不依赖liblz4；压缩是单遍贪心匹配，和LZ4_compress_fast的默认档位相当
+    // 压缩结果前面带4字节网络字节序的原始长度，解压时据此一次分配好输出
+    class Lz4
+    {
+    public:
+        // 结果写进out；压缩后没有变小时返回false，调用者按原样发送
+        static bool Compress(std::string_view src, std::string_view dict, std::string &out)
+        {
+            if (src.size() > UINT32_MAX || dict.size() > maxOffset)
+                return false;
+            // 匹配可以引用字典，把字典和数据放在一段连续的内存中，位置统一按这段内存计算
+            const uint8_t *base = (const uint8_t *)src.data();
+            size_t start = 0;
+            if (dict.empty() == false)
+            {
+                static thread_local std::string work;
+                work.assign(dict.data(), dict.size());
+                work.append(src.data(), src.size());
+                base = (const uint8_t *)work.data();
+                start = dict.size();
+            }
+            out.resize(headerLength + src.size() + src.size() / 255 + 16);
+            uint32_t be32 = htonl((uint32_t)src.size());
+            memcpy(&out[0], &be32, headerLength);
+            size_t len = CompressBlock(base, start, start + src.size(), (uint8_t *)&out[headerLength]);
+            out.resize(headerLength + len);
+            return out.size() < src.size();
+        }
+        // 数据不合法或者原始长度超过max_len时返回false
+        static bool Decompress(std::string_view src, std::string_view dict, size_t max_len, std::string &out)
+        {
+            if (src.size() < headerLength)
+                return false;
+            uint32_t be32 = 0;
+            memcpy(&be32, src.data(), headerLength);
+            size_t len = ntohl(be32);
+            if (len > max_len)
+                return false;
+            out.resize(len);
+            return DecompressBlock((const uint8_t *)src.data() + headerLength, src.size() - headerLength,
+                                   (uint8_t *)&out[0], len, dict);
+        }
+
+    private:
+        static constexpr size_t headerLength = 4;
+        static constexpr size_t minMatch = 4;
+        // 块的最后5个字节必须是字面量，最后一个匹配必须在结尾12字节之前开始
+        static constexpr size_t lastLiterals = 5;
+        static constexpr size_t matchFindLimit = 12;
+        static constexpr size_t maxOffset = 65535;
+        static constexpr int hashLog = 12;
+
+        static uint32_t Read32(const uint8_t *p)
+        {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        static uint32_t Hash(uint32_t seq)
+        {
+            return (seq * 2654435761u) >> (32 - hashLog);
+        }
+        static uint8_t *PutLength(uint8_t *op, size_t len)
+        {
+            for (; len >= 255; len -= 255)
+                *op++ = 255;
+            *op++ = (uint8_t)len;
+            return op;
+        }
+        static uint8_t *PutSequence(uint8_t *op, const uint8_t *literals, size_t literal_len, size_t offset, size_t match_len)
+        {
+            uint8_t *token = op++;
+            *token = (uint8_t)((literal_len >= 15 ? 15 : literal_len) << 4);
+            if (literal_len >= 15)
+                op = PutLength(op, literal_len - 15);
+            memcpy(op, literals, literal_len);
+            op += literal_len;
+            if (match_len == 0) // 最后一段只有字面量
+                return op;
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+            match_len -= minMatch;
+            *token |= (uint8_t)(match_len >= 15 ? 15 : match_len);
+            if (match_len >= 15)
+                op = PutLength(op, match_len - 15);
+            return op;
+        }
+        // 压缩base[start, end)，base[0, start)是字典；返回写入dst的字节数
+        static size_t CompressBlock(const uint8_t *base, size_t start, size_t end, uint8_t *dst)
+        {
+            uint8_t *op = dst;
+            size_t anchor = start;
+            if (end - start >= matchFindLimit + 1)
+            {
+                uint32_t table[1 << hashLog];
+                memset(table, 0xFF, sizeof(table));
+                for (size_t p = (start > maxOffset ? start - maxOffset : 0); p + minMatch <= start; p++)
+                    table[Hash(Read32(base + p))] = (uint32_t)p;
+                size_t match_limit = end - lastLiterals;
+                size_t find_limit = end - matchFindLimit;
+                size_t ip = start;
+                // 连续找不到匹配时逐渐加大步长，不可压缩的数据很快扫过去
+                unsigned misses = 0;
+                while (ip < find_limit)
+                {
+                    uint32_t seq = Read32(base + ip);
+                    uint32_t h = Hash(seq);
+                    uint32_t ref = table[h];
+                    table[h] = (uint32_t)ip;
+                    if (ref == UINT32_MAX || ip - ref > maxOffset || Read32(base + ref) != seq)
+                    {
+                        ip += 1 + (misses++ >> 6);
+                        continue;
+                    }
+                    misses = 0;
+                    size_t len = minMatch;
+                    while (ip + len < match_limit && base[ref + len] == base[ip + len])
+                        len++;
+                    op = PutSequence(op, base + anchor, ip - anchor, ip - ref, len);
+                    ip += len;
+                    anchor = ip;
+                    if (ip < find_limit)
+                        table[Hash(Read32(base + ip - 2))] = (uint32_t)(ip - 2);
+                }
+            }
+            op = PutSequence(op, base + anchor, end - anchor, 0, 0);
+            return op - dst;
+        }
+        static bool GetLength(const uint8_t *&ip, const uint8_t *end, size_t &len)
+        {
+            uint8_t byte;
+            do
+            {
+                if (ip >= end)
+                    return false;
+                byte = *ip++;
+                len += byte;
+            } while (byte == 255);
+            return true;
+        }
+        // 输出必须正好填满len字节；偏移超出已经输出的部分时从字典末尾取
+        static bool DecompressBlock(const uint8_t *ip, size_t n, uint8_t *dst, size_t len, std::string_view dict)
+        {
+            const uint8_t *end = ip + n;
+            uint8_t *op = dst;
+            uint8_t *out_end = dst + len;
+            while (true)
+            {
+                if (ip >= end)
+                    return false;
+                uint8_t token = *ip++;
+                size_t literal_len = token >> 4;
+                if (literal_len == 15 && GetLength(ip, end, literal_len) == false)
+                    return false;
+                if (literal_len > (size_t)(end - ip) || literal_len > (size_t)(out_end - op))
+                    return false;
+                memcpy(op, ip, literal_len);
+                op += literal_len;
+                ip += literal_len;
+                if (ip == end)
+                    return op == out_end;
+                if (end - ip < 2)
+                    return false;
+                size_t offset = ip[0] | (ip[1] << 8);
+                ip += 2;
+                size_t match_len = token & 15;
+                if (match_len == 15 && GetLength(ip, end, match_len) == false)
+                    return false;
+                match_len += minMatch;
+                if (offset == 0 || match_len > (size_t)(out_end - op))
+                    return false;
+                size_t produced = op - dst;
+                if (offset > produced)
+                {
+                    size_t back = offset - produced;
+                    if (back > dict.size())
+                        return false;
+                    size_t from_dict = std::min(back, match_len);
+                    memcpy(op, dict.data() + dict.size() - back, from_dict);
+                    op += from_dict;
+                    match_len -= from_dict;
+                    if (match_len == 0)
+                        continue;
+                }
+                // 偏移小于长度时源和目的重叠，只能逐字节复制
+                const uint8_t *match = op - offset;
+                if (offset >= match_len)
+                {
+                    memcpy(op, match, match_len);
+                    op += match_len;
+                }
+                else
+                {
+                    for (size_t i = 0; i < match_len; i++)
+                        *op++ = *match++;
+                }
+            }
+        }
+    };
+}
@@ -2,52 +2,486 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <jsoncpp/json/json.h>
 #include <sstream>
+#include <streambuf>
+#include <memory>
 #include <iomanip>
 #include <atomic>
+#include <chrono>
 #include <random>
+#include <vector>
+#include <cstring>
+#include <unistd.h>
 
 #include "Log.hpp"
+#include "Fields.hpp"
+#include "SimdJson.hpp"
 
 namespace Rpc
 {
     using namespace LogModule;
+    // 把std::string包装成streambuf，序列化的结果直接追加到调用者的字符串中，不经过stringstream再拷贝一次
+    class StringStreamBuf : public std::streambuf
+    {
+    public:
+        StringStreamBuf(std::string &str) : _str(str) {}
+
+    protected:
+        virtual int overflow(int ch) override
+        {
+            if (ch != traits_type::eof())
+                _str.push_back((char)ch);
+            return traits_type::not_eof(ch);
+        }
+        virtual std::streamsize xsputn(const char *s, std::streamsize n) override
+        {
+            _str.append(s, n);
+            return n;
+        }
+
+    private:
+        std::string &_str;
+    };
+
+    // 每个线程复用一个writer和reader，不再每次调用都创建builder和new一个对象
+    // 输出为不带缩进和换行的紧凑格式，非ASCII字符按UTF-8原样输出；解析端对两种格式都兼容
+    // 编译时定义RPC_SIMD_JSON时解析改用SimdJson，见SimdJson.hpp
     class JSON
     {
     public:
+        // 结果写进body，body原有的内容被覆盖，容量保留下来可以复用
         static bool Serialize(const Json::Value &val, std::string &body)
         {
-            std::stringstream ss;
-
-            Json::StreamWriterBuilder builder;
+            body.clear();
+            StringStreamBuf streambuf(body);
+            std::ostream out(&streambuf);
+            return Serialize(val, out);
+        }
 
-            // 这里是一个new出来的对象所以选择智能指针去管理起来
-            std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
-            int ret = writer->write(val, &ss);
-            if (ret != 0)
+        // 直接写到输出流中，发送路径上用来把消息体写进发送缓冲区
+        static bool Serialize(const Json::Value &val, std::ostream &out)
+        {
+            int ret = Writer().write(val, &out);
+            if (ret != 0 || out.good() == false)
             {
                 LOG(LogLevel::ERROR) << "Failed to serialize JSON object: " << ret;
                 return false;
             }
-
-            body = ss.str();
             return true;
         }
 
-        static bool Deserialize(const std::string &body, Json::Value &val)
+        static bool Deserialize(std::string_view body, Json::Value &val)
         {
-            std::string ss;
-            Json::CharReaderBuilder builder;
-            std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
-            bool ret = reader->parse(body.c_str(), body.c_str() + body.size(), &val, &ss);
+            std::string errs;
+#ifdef RPC_SIMD_JSON
+            bool ret = SimdJson::Parse(body, val, errs);
+#else
+            bool ret = Reader().parse(body.data(), body.data() + body.size(), &val, &errs);
+#endif
             if (ret == false)
             {
-                LOG(LogLevel::ERROR) << "Failed to parse JSON object: " << ss.c_str();
+                LOG(LogLevel::ERROR) << "Failed to parse JSON object: " << errs.c_str();
                 return false;
             }
             return true;
         }
+
+    private:
+        static Json::StreamWriter &Writer()
+        {
+            static thread_local std::unique_ptr<Json::StreamWriter> writer([]()
+                                                                          {
+                                                                              Json::StreamWriterBuilder builder;
+                                                                              builder["indentation"] = "";
+                                                                              builder["emitUTF8"] = true;
+                                                                              return builder.newStreamWriter(); }());
+            return *writer;
+        }
+        static Json::CharReader &Reader()
+        {
+            static thread_local std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+            return *reader;
+        }
+    };
+
+    class SchemaCodec;
+
+    // Json::Value的紧凑二进制编码，连接协商出Codec::CODEC_BINARY之后代替JSON文本传输消息体
+    // 每个值以一个字节的类型开头，整数用zigzag变长编码，字符串、数组、对象以变长编码的长度开头；
+    // 对象的键是协议字段(KEY_*)时只写它在KeyTable中的序号，省掉键名和文本解析
+    class JsonBinary
+    {
+    public:
+        static void Encode(const Json::Value &val, std::string &out)
+        {
+            switch (val.type())
+            {
+            case Json::nullValue:
+                out.push_back(TAG_NULL);
+                break;
+            case Json::booleanValue:
+                out.push_back(val.asBool() ? TAG_TRUE : TAG_FALSE);
+                break;
+            case Json::intValue:
+                PutInt(out, val.asInt64());
+                break;
+            case Json::uintValue:
+                out.push_back(TAG_UINT);
+                PutVarint(out, val.asUInt64());
+                break;
+            case Json::realValue:
+                PutDouble(out, val.asDouble());
+                break;
+            case Json::stringValue:
+            {
+                const char *begin = nullptr, *end = nullptr;
+                val.getString(&begin, &end);
+                out.push_back(TAG_STRING);
+                PutString(out, begin, end - begin);
+                break;
+            }
+            case Json::arrayValue:
+                out.push_back(TAG_ARRAY);
+                PutVarint(out, val.size());
+                for (Json::ArrayIndex i = 0; i < val.size(); i++)
+                    Encode(val[i], out);
+                break;
+            case Json::objectValue:
+                out.push_back(TAG_OBJECT);
+                PutVarint(out, val.size());
+                EncodeMembers(val, out);
+                break;
+            }
+        }
+        // 编码对象obj，并在最后追加一个已经是JsonBinary编码的成员raw_key: raw
+        static void Encode(const Json::Value &obj, const char *raw_key, std::string_view raw, std::string &out)
+        {
+            out.push_back(TAG_OBJECT);
+            PutVarint(out, obj.size() + 1);
+            EncodeMembers(obj, out);
+            PutKey(out, raw_key, strlen(raw_key));
+            out.append(raw.data(), raw.size());
+        }
+        // 数据不完整、类型未知、嵌套过深时返回false
+        static bool Decode(std::string_view data, Json::Value &val)
+        {
+            const char *pos = data.data();
+            if (DecodeValue(pos, data.data() + data.size(), val, 0) == false)
+            {
+                LOG(LogLevel::ERROR) << "Failed to decode binary message body";
+                return false;
+            }
+            return pos == data.data() + data.size();
+        }
+        // 和Decode相同，但顶层对象中键为raw_key的成员不展开，原样(JsonBinary编码)拷进raw；没有这个成员时raw为空
+        static bool Decode(std::string_view data, Json::Value &val, const char *raw_key, std::string &raw)
+        {
+            raw.clear();
+            const char *pos = data.data();
+            const char *end = data.data() + data.size();
+            if (raw_key == nullptr || pos == end || *pos != TAG_OBJECT)
+                return Decode(data, val);
+            pos++;
+            uint64_t n = 0;
+            if (GetVarint(pos, end, n) == false || n > (uint64_t)(end - pos))
+                return false;
+            size_t raw_key_len = strlen(raw_key);
+            val = Json::Value(Json::objectValue);
+            for (uint64_t i = 0; i < n; i++)
+            {
+                const char *key = nullptr;
+                size_t len = 0;
+                if (GetKey(pos, end, key, len) == false)
+                    return false;
+                if (len == raw_key_len && memcmp(key, raw_key, len) == 0)
+                {
+                    const char *begin = pos;
+                    if (Skip(pos, end, 1) == false)
+                        return false;
+                    raw.assign(begin, pos - begin);
+                    continue;
+                }
+                if (DecodeValue(pos, end, *val.demand(key, key + len), 1) == false)
+                {
+                    LOG(LogLevel::ERROR) << "Failed to decode binary message body";
+                    return false;
+                }
+            }
+            return pos == end;
+        }
+        // 编码后的值是不是一个对象，不需要解码
+        static bool IsObject(std::string_view data)
+        {
+            return data.empty() == false && data[0] == TAG_OBJECT;
+        }
+
+    private:
+        // SchemaCodec直接按这个格式编解码类型化的结构体，和Json::Value的编码互通
+        friend class SchemaCodec;
+        enum : char
+        {
+            TAG_NULL = 0,
+            TAG_FALSE,
+            TAG_TRUE,
+            TAG_INT,
+            TAG_UINT,
+            TAG_DOUBLE,
+            TAG_STRING,
+            TAG_ARRAY,
+            TAG_OBJECT
+        };
+        static constexpr int maxDepth = 64;
+
+        // 序号从1开始，0表示后面跟着键名；两端必须一致，只能在末尾追加
+        static const std::vector<std::string> &KeyTable()
+        {
+            static const std::vector<std::string> table = {
+                KEY_METHOD, KEY_PARAMS, KEY_TOPIC_KEY, KEY_TOPIC_MSG, KEY_OPTYPE, KEY_HOST, KEY_HOST_IP,
+                KEY_HOST_PORT, KEY_HOST_NAME, KEY_HOST_UNIX, KEY_RCODE, KEY_RESULT, KEY_TIMESTAMP};
+            return table;
+        }
+        static size_t KeyIndex(const char *name, size_t len)
+        {
+            const std::vector<std::string> &table = KeyTable();
+            for (size_t i = 0; i < table.size(); i++)
+            {
+                if (table[i].size() == len && memcmp(table[i].data(), name, len) == 0)
+                    return i + 1;
+            }
+            return 0;
+        }
+        static void EncodeMembers(const Json::Value &obj, std::string &out)
+        {
+            for (auto it = obj.begin(); it != obj.end(); ++it)
+            {
+                const char *end = nullptr;
+                const char *name = it.memberName(&end);
+                PutKey(out, name, end - name);
+                Encode(*it, out);
+            }
+        }
+        static void PutVarint(std::string &out, uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                out.push_back((char)(v | 0x80));
+                v >>= 7;
+            }
+            out.push_back((char)v);
+        }
+        static void PutInt(std::string &out, int64_t v)
+        {
+            out.push_back(TAG_INT);
+            PutVarint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+        }
+        static void PutDouble(std::string &out, double d)
+        {
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(bits));
+            out.push_back(TAG_DOUBLE);
+            for (int i = 0; i < 8; i++)
+                out.push_back((char)(bits >> (i * 8)));
+        }
+        static void PutString(std::string &out, const char *data, size_t len)
+        {
+            PutVarint(out, len);
+            out.append(data, len);
+        }
+        static void PutKey(std::string &out, const char *name, size_t len)
+        {
+            size_t index = KeyIndex(name, len);
+            PutVarint(out, index);
+            if (index == 0)
+                PutString(out, name, len);
+        }
+        static bool GetVarint(const char *&pos, const char *end, uint64_t &v)
+        {
+            v = 0;
+            for (int shift = 0; shift < 64 && pos < end; shift += 7)
+            {
+                uint8_t byte = (uint8_t)*pos++;
+                v |= (uint64_t)(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                    return true;
+            }
+            return false;
+        }
+        static int64_t ZigZag(uint64_t n)
+        {
+            return (int64_t)((n >> 1) ^ (~(n & 1) + 1));
+        }
+        static bool GetDouble(const char *&pos, const char *end, double &d)
+        {
+            if (end - pos < 8)
+                return false;
+            uint64_t bits = 0;
+            for (int i = 0; i < 8; i++)
+                bits |= (uint64_t)(uint8_t)pos[i] << (i * 8);
+            pos += 8;
+            memcpy(&d, &bits, sizeof(d));
+            return true;
+        }
+        static bool GetString(const char *&pos, const char *end, const char *&data, size_t &len)
+        {
+            uint64_t n = 0;
+            if (GetVarint(pos, end, n) == false || n > (uint64_t)(end - pos))
+                return false;
+            data = pos;
+            len = n;
+            pos += n;
+            return true;
+        }
+        static bool GetKey(const char *&pos, const char *end, const char *&key, size_t &len)
+        {
+            uint64_t index = 0;
+            if (GetVarint(pos, end, index) == false)
+                return false;
+            if (index == 0)
+                return GetString(pos, end, key, len);
+            const std::vector<std::string> &table = KeyTable();
+            if (index > table.size())
+                return false;
+            key = table[index - 1].data();
+            len = table[index - 1].size();
+            return true;
+        }
+        // 跳过一个值，不解码
+        static bool Skip(const char *&pos, const char *end, int depth)
+        {
+            if (pos >= end || depth > maxDepth)
+                return false;
+            char tag = *pos++;
+            uint64_t n = 0;
+            const char *str = nullptr;
+            size_t len = 0;
+            switch (tag)
+            {
+            case TAG_NULL:
+            case TAG_FALSE:
+            case TAG_TRUE:
+                return true;
+            case TAG_INT:
+            case TAG_UINT:
+                return GetVarint(pos, end, n);
+            case TAG_DOUBLE:
+                if (end - pos < 8)
+                    return false;
+                pos += 8;
+                return true;
+            case TAG_STRING:
+                return GetString(pos, end, str, len);
+            case TAG_ARRAY:
+            case TAG_OBJECT:
+                if (GetVarint(pos, end, n) == false || n > (uint64_t)(end - pos))
+                    return false;
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    if (tag == TAG_OBJECT && GetKey(pos, end, str, len) == false)
+                        return false;
+                    if (Skip(pos, end, depth + 1) == false)
+                        return false;
+                }
+                return true;
+            }
+            return false;
+        }
+        static bool DecodeValue(const char *&pos, const char *end, Json::Value &val, int depth)
+        {
+            if (pos >= end || depth > maxDepth)
+                return false;
+            char tag = *pos++;
+            uint64_t n = 0;
+            double d = 0;
+            const char *str = nullptr;
+            size_t len = 0;
+            switch (tag)
+            {
+            case TAG_NULL:
+                val = Json::Value();
+                return true;
+            case TAG_FALSE:
+            case TAG_TRUE:
+                val = (tag == TAG_TRUE);
+                return true;
+            case TAG_INT:
+                if (GetVarint(pos, end, n) == false)
+                    return false;
+                val = (Json::Int64)ZigZag(n);
+                return true;
+            case TAG_UINT:
+                if (GetVarint(pos, end, n) == false)
+                    return false;
+                val = (Json::UInt64)n;
+                return true;
+            case TAG_DOUBLE:
+                if (GetDouble(pos, end, d) == false)
+                    return false;
+                val = d;
+                return true;
+            case TAG_STRING:
+                if (GetString(pos, end, str, len) == false)
+                    return false;
+                val = Json::Value(str, str + len);
+                return true;
+            case TAG_ARRAY:
+                // 每个元素至少一个字节，数量不可能超过剩余的字节数
+                if (GetVarint(pos, end, n) == false || n > (uint64_t)(end - pos))
+                    return false;
+                val = Json::Value(Json::arrayValue);
+                if (n > 0)
+                    val.resize(n);
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    if (DecodeValue(pos, end, val[(Json::ArrayIndex)i], depth + 1) == false)
+                        return false;
+                }
+                return true;
+            case TAG_OBJECT:
+                if (GetVarint(pos, end, n) == false || n > (uint64_t)(end - pos))
+                    return false;
+                val = Json::Value(Json::objectValue);
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    if (GetKey(pos, end, str, len) == false)
+                        return false;
+                    if (DecodeValue(pos, end, *val.demand(str, str + len), depth + 1) == false)
+                        return false;
+                }
+                return true;
+            }
+            return false;
+        }
+    };
+
+    class Clock
+    {
+    public:
+        // 单调时钟的微秒数，只用于计算时间间隔
+        static int64_t NowUs()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+    };
+
+    class Host
+    {
+    public:
+        // 本机的主机名，用来判断服务提供者是否和自己在同一台机器上
+        static const std::string &Name()
+        {
+            static std::string name = []()
+            {
+                char buf[256] = {0};
+                if (gethostname(buf, sizeof(buf) - 1) < 0)
+                    return std::string();
+                return std::string(buf);
+            }();
+            return name;
+        }
     };
 
     class UUID
@@ -56,12 +56,18 @@ namespace Rpc
 
         void OnMessage(const BaseConnection::ptr& conn, const BaseMessage::ptr& msg)
         {
-            std::unique_lock<std::mutex> lock(_mutex);
             //找到该消息类型的回调函数，传参
-            auto it = _handlers.find(msg->GetType());
-            if (it!= _handlers.end())
+            //多个IO线程会并发进入这里，锁只保护查表，回调在锁外执行，否则所有连接的业务处理都会被串行化
+            Callback::ptr cb;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _handlers.find(msg->GetType());
+                if (it != _handlers.end())
+                    cb = it->second;
+            }
+            if (cb)
             {
-                it->second->onMessage(conn, msg);
+                cb->onMessage(conn, msg);
             }
             else
             {
@@ -0,0 +1,105 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <thread>
+
+#include "Log.hpp"
+
+namespace Rpc
+{
+    using namespace LogModule;
+    // 有界的业务线程池
+    // IO线程只负责收发和解析，耗时的业务回调投递到这里执行，避免一个慢请求卡住同一个loop上的所有连接
+    class WorkerPool
+    {
+    public:
+        using ptr = std::shared_ptr<WorkerPool>;
+        using Task = std::function<void()>;
+
+        WorkerPool(size_t thread_num, size_t max_queue) : _max_queue(max_queue), _running(true)
+        {
+            for (size_t i = 0; i < thread_num; i++)
+            {
+                _threads.emplace_back(&WorkerPool::Routine, this);
+            }
+        }
+        ~WorkerPool()
+        {
+            Stop();
+        }
+
+        // 队列已满或者线程池已经停止时返回false，由调用者决定如何拒绝这个任务
+        bool Submit(Task task)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_running == false || _tasks.size() >= _max_queue)
+                    return false;
+                _tasks.push_back(std::move(task));
+            }
+            _cond.notify_one();
+            return true;
+        }
+
+        // 停止接收新任务，已经入队的任务执行完之后线程退出
+        void Stop()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_running == false)
+                    return;
+                _running = false;
+            }
+            _cond.notify_all();
+            for (auto &thread : _threads)
+            {
+                if (thread.joinable())
+                    thread.join();
+            }
+        }
+
+        size_t QueueSize()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _tasks.size();
+        }
+
+    private:
+        void Routine()
+        {
+            while (true)
+            {
+                Task task;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _cond.wait(lock, [this]()
+                               { return _running == false || _tasks.empty() == false; });
+                    if (_tasks.empty())
+                        return; // 已停止且任务已经取完
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                }
+                try
+                {
+                    task();
+                }
+                catch (const std::exception &e)
+                {
+                    LOG(LogLevel::ERROR) << "业务任务执行异常: " << e.what();
+                }
+            }
+        }
+
+    private:
+        size_t _max_queue;
+        bool _running;
+        std::mutex _mutex;
+        std::condition_variable _cond;
+        std::deque<Task> _tasks;
+        std::vector<std::thread> _threads;
+    };
+}
@@ -11,8 +11,17 @@ namespace Rpc {
     #define KEY_HOST        "host"
     #define KEY_HOST_IP     "ip"
     #define KEY_HOST_PORT   "port"
+    #define KEY_HOST_NAME   "hostname"
+    #define KEY_HOST_UNIX   "unix_path"
     #define KEY_RCODE       "rcode"
     #define KEY_RESULT      "result"
+    #define KEY_TIMESTAMP   "timestamp"
+    #define KEY_CODECS      "codecs"
+    #define KEY_CODEC       "codec"
+    #define KEY_COMPRESSIONS "compressions"
+    #define KEY_COMPRESSION "compression"
+    #define KEY_COMPRESS_DICT "compress_dict"
+    #define KEY_NEGOTIATE   "negotiate"
 
     enum class MType {
         REQ_RPC = 0,
@@ -20,7 +29,9 @@ namespace Rpc {
         REQ_TOPIC,
         RSP_TOPIC,
         REQ_SERVICE,
-        RSP_SERVICE
+        RSP_SERVICE,
+        REQ_HEARTBEAT, // 协议层心跳，在网络层处理，不会交给Dispatcher
+        RSP_HEARTBEAT
     };
 
     enum class RCode {
@@ -33,7 +44,8 @@ namespace Rpc {
         RCODE_NOT_FOUND_SERVICE,
         RCODE_INVALID_OPTYPE,
         RCODE_NOT_FOUND_TOPIC,
-        RCODE_INTERNAL_ERROR
+        RCODE_INTERNAL_ERROR,
+        RCODE_OVERLOADED
     };
     static std::string ErrReason(RCode code) {
         static std::unordered_map<RCode, std::string> err_map = {
@@ -46,7 +58,8 @@ namespace Rpc {
             {RCode::RCODE_NOT_FOUND_SERVICE, "没有找到对应的服务！"},
             {RCode::RCODE_INVALID_OPTYPE, "无效的操作类型"},
             {RCode::RCODE_NOT_FOUND_TOPIC, "没有找到对应的主题！"},
-            {RCode::RCODE_INTERNAL_ERROR, "内部错误！"}
+            {RCode::RCODE_INTERNAL_ERROR, "内部错误！"},
+            {RCode::RCODE_OVERLOADED, "服务端繁忙，请求被拒绝！"}
         };
         auto it = err_map.find(code);
         if (it == err_map.end()) {
@@ -68,6 +81,32 @@ namespace Rpc {
         TOPIC_PUBLISH
     };
 
+    // 连接发送积压超过高水位时的处理策略，都只作用于积压的这个连接本身
+    // 不会反压给产生这些数据的其他连接：TopicServer中发布者照常发布，发往过载订阅者的消息被丢弃
+    enum class OverloadPolicy {
+        OVERLOAD_STOP_PEER_READ = 0, // 停止读取积压的这个对端，它不再有新请求进来，积压写完后恢复
+        OVERLOAD_REJECT,         // 继续读取，但新请求直接以RCODE_OVERLOADED拒绝
+        OVERLOAD_DISCONNECT      // 直接断开连接，丢弃积压的数据
+    };
+
+    // 消息体的编码，报文头中的标志位标明每一帧用的是哪一种，发送方只有在协商之后才会使用JSON之外的编码
+    enum class Codec {
+        CODEC_JSON = 0,  // jsoncpp文本
+        CODEC_BINARY     // JsonBinary：带类型标记的紧凑二进制，协议字段名压缩成序号
+    };
+
+    // 消息体的压缩算法，和编码一样按连接协商，压缩过的帧在报文头中带标志位
+    enum class Compression {
+        COMPRESS_NONE = 0,
+        COMPRESS_LZ4       // LZ4块格式，可以带预置字典
+    };
+
+    // 网络传输的实现，创建服务端/客户端时通过选项选择
+    enum class NetBackend {
+        BACKEND_MUDUO = 0, // muduo的epoll reactor
+        BACKEND_IO_URING   // io_uring：多路accept/recv、内核提供的接收缓冲区、批量提交
+    };
+
     enum class ServiceOptype {
         SERVICE_REGISTRY = 0,
         SERVICE_DISCOVERY,
@@ -2,10 +2,13 @@
 #include "Detail.hpp"
 #include "Fields.hpp"
 #include "Abstract.hpp"
+#include "Schema.hpp"
 
 namespace Rpc
 {
     typedef std::pair<std::string, int> Address;
+    // 服务提供者在本机监听的unix域套接字：<主机名, socket路径>，没有时两者都为空
+    typedef std::pair<std::string, std::string> LocalAddress;
     
     class JsonMessage : public BaseMessage
     {
@@ -15,18 +18,106 @@ namespace Rpc
         virtual std::string Serialize() override
         {
             std::string body;
-            bool ret = JSON::Serialize(_body, body);
+            Json::Value full;
+            bool ret = JSON::Serialize(Body(full), body);
             if (ret == false)
                 return std::string();
             return body;
         }
-        virtual bool Deserialize(const std::string &data) override
+        virtual bool SerializeTo(std::ostream &out) override
         {
+            Json::Value full;
+            return JSON::Serialize(Body(full), out);
+        }
+        virtual bool Deserialize(std::string_view data) override
+        {
+            _raw.clear();
             return JSON::Deserialize(data, _body);
         }
+        // 消息的内容都在_body中，二进制编码直接编码整个_body，Check等逻辑和JSON完全一样
+        // 唯一的例外是RawKey()成员，见_raw
+        virtual bool SerializeBinary(std::string &out) override
+        {
+            if (_raw.empty())
+                JsonBinary::Encode(_body, out);
+            else
+                JsonBinary::Encode(_body, RawKey(), _raw, out);
+            return true;
+        }
+        virtual bool DeserializeBinary(std::string_view data) override
+        {
+            return JsonBinary::Decode(data, _body, RawKey(), _raw);
+        }
+        // 编码和压缩的协商提议(内容和心跳请求的消息体相同)作为可选的KEY_NEGOTIATE成员附在消息体中，
+        // 老版本的对端不认识这个成员，会照常处理消息；消息本身不被修改
+        bool SerializeWithOffer(const JsonMessage &offer, std::ostream &out) const
+        {
+            Json::Value full;
+            Json::Value body = Body(full);
+            body[KEY_NEGOTIATE] = offer._body;
+            return JSON::Serialize(body, out);
+        }
+        // 取出消息体中的协商提议放进offer，没有时返回false
+        bool TakeOffer(JsonMessage &offer)
+        {
+            if (_body.isObject() == false || _body.isMember(KEY_NEGOTIATE) == false)
+                return false;
+            offer._body = std::move(_body[KEY_NEGOTIATE]);
+            _body.removeMember(KEY_NEGOTIATE);
+            return true;
+        }
+
+    protected:
+        // 承载业务数据的成员(Rpc的参数、结果)，二进制编码下收发时不展开成Json::Value，没有时为空
+        virtual const char *RawKey() const { return nullptr; }
+        Json::Value RawField() const
+        {
+            if (_raw.empty())
+                return _body[RawKey()];
+            Json::Value val;
+            JsonBinary::Decode(_raw, val);
+            return val;
+        }
+        void SetRawField(const Json::Value &val)
+        {
+            _raw.clear();
+            _body[RawKey()] = val;
+        }
+        bool RawFieldIsObject() const
+        {
+            return _raw.empty() ? _body[RawKey()].isObject() : JsonBinary::IsObject(_raw);
+        }
+        // 类型化的结构体直接编码成JsonBinary格式保存，二进制编码的连接上原样发出；JSON编码时才转换一次
+        template <typename T>
+        void SetRawFieldAs(const T &obj)
+        {
+            _body.removeMember(RawKey());
+            _raw.clear();
+            SchemaCodec::Encode(obj, _raw);
+        }
+        template <typename T>
+        bool GetRawFieldAs(T &obj) const
+        {
+            if (_raw.empty())
+                return SchemaCodec::FromJson(_body[RawKey()], obj);
+            return SchemaCodec::Decode(_raw, obj);
+        }
+
+    private:
+        // JSON编码需要完整的_body，_raw非空时把它解码后和_body拼成一份放进full
+        const Json::Value &Body(Json::Value &full) const
+        {
+            if (_raw.empty())
+                return _body;
+            full = _body;
+            JsonBinary::Decode(_raw, full[RawKey()]);
+            return full;
+        }
 
     protected:
         Json::Value _body;
+        // RawKey()成员的JsonBinary编码，非空时_body中没有这个成员
+        std::string _raw;
     };
 
     class JsonRequest : public JsonMessage
@@ -74,7 +165,7 @@ namespace Rpc
                 LOG(LogLevel::ERROR) << "non-existent or invalid method field in request";
                 return false;
             }
-            if (_body[KEY_PARAMS].isNull() == true || _body[KEY_PARAMS].isObject() == false)
+            if (RawFieldIsObject() == false)
             {
                 LOG(LogLevel::ERROR) << "non-existent or invalid parameters field in request";
                 return false;
@@ -84,8 +175,16 @@ namespace Rpc
         std::string GetMethod() const { return _body[KEY_METHOD].asString(); }
         void SetMethod(const std::string &method) { _body[KEY_METHOD] = method; }
 
-        Json::Value GetParams() const { return _body[KEY_PARAMS]; }
-        void SetParams(const Json::Value &params) { _body[KEY_PARAMS] = params; }
+        Json::Value GetParams() const { return RawField(); }
+        void SetParams(const Json::Value &params) { SetRawField(params); }
+        // 参数是RPC_SCHEMA声明过的结构体时使用，缺少字段或者类型不对时返回false
+        template <typename T>
+        void SetParamsAs(const T &params) { SetRawFieldAs(params); }
+        template <typename T>
+        bool GetParamsAs(T &params) const { return GetRawFieldAs(params); }
+
+    protected:
+        virtual const char *RawKey() const override { return KEY_PARAMS; }
     };
     class TopicRequest : public JsonRequest
     {
@@ -175,11 +274,24 @@ namespace Rpc
             addr.second = _body[KEY_HOST][KEY_HOST_PORT].asInt();
             return addr;
         }
-        void SetHost(const Address &addr)
+        // 本地地址是host中可选的字段，老版本的对端会直接忽略
+        LocalAddress GetLocalHost() const
+        {
+            LocalAddress local;
+            local.first = _body[KEY_HOST][KEY_HOST_NAME].asString();
+            local.second = _body[KEY_HOST][KEY_HOST_UNIX].asString();
+            return local;
+        }
+        void SetHost(const Address &addr, const LocalAddress &local = LocalAddress())
         {
             Json::Value val;
             val[KEY_HOST_IP] = addr.first;
             val[KEY_HOST_PORT] = addr.second;
+            if (local.second.empty() == false)
+            {
+                val[KEY_HOST_NAME] = local.first;
+                val[KEY_HOST_UNIX] = local.second;
+            }
             _body[KEY_HOST] = val;
         }
     };
@@ -190,8 +302,7 @@ namespace Rpc
         using ptr = std::shared_ptr<RpcResponse>;
         virtual bool Check() override
         {
-            if (_body[KEY_RESULT].isNull() == true ||
-                _body[KEY_RESULT].isObject() == false)
+            if (RawFieldIsObject() == false)
             {
                 LOG(LogLevel::ERROR) << "non-existent or invalid result field in Rpc response";
                 return false;
@@ -205,8 +316,15 @@ namespace Rpc
             return true;
         }
 
-        Json::Value GetResult() const { return _body[KEY_RESULT]; }
-        void SetResult(const Json::Value &result) { _body[KEY_RESULT] = result; }
+        Json::Value GetResult() const { return RawField(); }
+        void SetResult(const Json::Value &result) { SetRawField(result); }
+        template <typename T>
+        void SetResultAs(const T &result) { SetRawFieldAs(result); }
+        template <typename T>
+        bool GetResultAs(T &result) const { return GetRawFieldAs(result); }
+
+    protected:
+        virtual const char *RawKey() const override { return KEY_RESULT; }
     };
 
     class TopicResponse : public JsonResponse
@@ -265,13 +383,19 @@ namespace Rpc
         {
             _body[KEY_METHOD] = method;
         }
-        void SetHost(std::vector<Address> addrs)
+        // locals为空或者和addrs一一对应
+        void SetHost(std::vector<Address> addrs, const std::vector<LocalAddress> &locals = std::vector<LocalAddress>())
         {
-            for (auto &addr : addrs)
+            for (size_t i = 0; i < addrs.size(); i++)
             {
                 Json::Value val;
-                val[KEY_HOST_IP] = addr.first;
-                val[KEY_HOST_PORT] = addr.second;
+                val[KEY_HOST_IP] = addrs[i].first;
+                val[KEY_HOST_PORT] = addrs[i].second;
+                if (i < locals.size() && locals[i].second.empty() == false)
+                {
+                    val[KEY_HOST_NAME] = locals[i].first;
+                    val[KEY_HOST_UNIX] = locals[i].second;
+                }
                 _body[KEY_HOST].append(val);
             }
         }
@@ -288,6 +412,85 @@ namespace Rpc
             }
             return addrs;
         }
+        // 和GetHosts一一对应，没有公布本地地址的提供者对应空值
+        std::vector<LocalAddress> GetLocalHosts()
+        {
+            std::vector<LocalAddress> locals;
+            int sz = _body[KEY_HOST].size();
+            for (int i = 0; i < sz; i++)
+            {
+                LocalAddress local;
+                local.first = _body[KEY_HOST][i][KEY_HOST_NAME].asString();
+                local.second = _body[KEY_HOST][i][KEY_HOST_UNIX].asString();
+                locals.push_back(local);
+            }
+            return locals;
+        }
+    };
+
+    // 心跳请求和响应共用：请求带上发送方单调时钟的时间戳，对端原样带回，发送方据此算出往返时间
+    class HeartbeatMessage : public JsonMessage
+    {
+    public:
+        using ptr = std::shared_ptr<HeartbeatMessage>;
+        virtual bool Check() override
+        {
+            if (_body[KEY_TIMESTAMP].isNull() == true || _body[KEY_TIMESTAMP].isIntegral() == false)
+            {
+                LOG(LogLevel::ERROR) << "non-existent or invalid timestamp field in heartbeat";
+                return false;
+            }
+            return true;
+        }
+        int64_t GetTimestamp() const { return _body[KEY_TIMESTAMP].asInt64(); }
+        void SetTimestamp(int64_t us) { _body[KEY_TIMESTAMP] = (Json::Int64)us; }
+
+        // 编码协商：提议带上发送方想用的编码(codecs)，支持的一端在心跳响应中写入选定的编码(codec)
+        // 提议附在客户端的第一条请求中(见JsonMessage::SerializeWithOffer)，老版本的对端不会应答，发送方继续使用JSON
+        bool GetCodecOffer(Codec &codec) const { return GetCodecField(KEY_CODECS, codec); }
+        void SetCodecOffer(Codec codec) { _body[KEY_CODECS] = (int)codec; }
+        bool GetCodec(Codec &codec) const { return GetCodecField(KEY_CODEC, codec); }
+        void SetCodec(Codec codec) { _body[KEY_CODEC] = (int)codec; }
+        // 压缩协商和编码一样：提议带上想用的算法和字典校验和，响应写入接受的算法和实际使用的字典(0表示不用)
+        bool GetCompressOffer(Compression &compression, uint32_t &dict_id) const
+        {
+            return GetCompressField(KEY_COMPRESSIONS, compression, dict_id);
+        }
+        void SetCompressOffer(Compression compression, uint32_t dict_id)
+        {
+            _body[KEY_COMPRESSIONS] = (int)compression;
+            _body[KEY_COMPRESS_DICT] = (Json::UInt)dict_id;
+        }
+        bool GetCompress(Compression &compression, uint32_t &dict_id) const
+        {
+            return GetCompressField(KEY_COMPRESSION, compression, dict_id);
+        }
+        void SetCompress(Compression compression, uint32_t dict_id)
+        {
+            _body[KEY_COMPRESSION] = (int)compression;
+            _body[KEY_COMPRESS_DICT] = (Json::UInt)dict_id;
+        }
+
+    private:
+        bool GetCompressField(const char *key, Compression &compression, uint32_t &dict_id) const
+        {
+            const Json::Value &val = _body[key];
+            const Json::Value &dict = _body[KEY_COMPRESS_DICT];
+            if (val.isInt() == false || val.asInt() < (int)Compression::COMPRESS_NONE ||
+                val.asInt() > (int)Compression::COMPRESS_LZ4 || dict.isUInt() == false)
+                return false;
+            compression = (Compression)val.asInt();
+            dict_id = dict.asUInt();
+            return true;
+        }
+        bool GetCodecField(const char *key, Codec &codec) const
+        {
+            const Json::Value &val = _body[key];
+            if (val.isInt() == false || val.asInt() < (int)Codec::CODEC_JSON || val.asInt() > (int)Codec::CODEC_BINARY)
+                return false;
+            codec = (Codec)val.asInt();
+            return true;
+        }
     };
 
     class MessageFactory
@@ -309,6 +512,9 @@ namespace Rpc
                 return std::make_shared<ServiceRequest>();
             case MType::RSP_SERVICE:
                 return std::make_shared<ServiceResponse>();
+            case MType::REQ_HEARTBEAT:
+            case MType::RSP_HEARTBEAT:
+                return std::make_shared<HeartbeatMessage>();
             }
             return BaseMessage::ptr();
         }
@@ -1,211 +1,449 @@
 #pragma once
+// muduo后端(默认)的连接、服务端和客户端，以及按参数选择传输的工厂；其他传输在ShmNet.hpp、UringNet.hpp中
 
-#include <muduo/net/TcpServer.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/TcpConnection.h>
 #include <muduo/net/Buffer.h>
 #include <muduo/base/CountDownLatch.h>
 #include <muduo/net/EventLoopThread.h>
-#include <muduo/net/TcpClient.h>
-#include "Detail.hpp"
-#include "Fields.hpp"
-#include "Abstract.hpp"
-#include "Message.hpp"
+#include <muduo/net/Channel.h>
+#include <muduo/net/EventLoopThreadPool.h>
+#include "Protocol.hpp"
+#include "Socket.hpp"
+#include "Options.hpp"
+#include "ShmNet.hpp"
+#include "UringNet.hpp"
+#include "TimingWheel.hpp"
+#include "BufferPool.hpp"
+#include "Admission.hpp"
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
 
 namespace Rpc
 {
-    class MuduoBuffer : public BaseBuffer
+    class MuduoConnection : public BaseConnection, public std::enable_shared_from_this<MuduoConnection>
     {
     public:
-        using ptr = std::shared_ptr<MuduoBuffer>;
-        MuduoBuffer(muduo::net::Buffer *buf) : _buf(buf) {}
-        virtual size_t ReadableSize() override
+        using ptr = std::shared_ptr<MuduoConnection>;
+
+        // cork为true时开启写合并：同一轮事件循环中产生的报文先攒在_pending中，本轮结束时一次写出
+        MuduoConnection(const muduo::net::TcpConnectionPtr &conn,
+                        const BaseProtocol::ptr &protocol, bool cork = false)
+            : _conn(conn), _protocol(protocol), _cork(cork), _flush_queued(false), _quickack_fd(-1), _idle_wheel(nullptr),
+              _last_send_us(Clock::NowUs()), _last_recv_us(_last_send_us),
+              _policy(OverloadPolicy::OVERLOAD_REJECT), _overloaded(false), _backlog(0)
         {
-            return _buf->readableBytes();
+            UpdateUsage();
         }
-        virtual int32_t PeekInt32() override
+        // 每次读到数据后在fd上重新开启TCP_QUICKACK，fd小于0表示不开启
+        void EnableQuickAck(int fd)
         {
-            // muduo库是网络库，从缓冲区取出4字节整形，会进行网络字节序的转换，变成host字节序
-            return _buf->peekInt32();
+            _quickack_fd = fd;
         }
-        virtual void RetrieveInt32() override
+        // 加入所属IO线程的空闲检测，之后每次收到数据都刷新一次
+        void SetIdleWheel(TimingWheel *wheel, const TimingWheel::WeakEntry &entry)
         {
-            _buf->retrieveInt32();
+            _idle_wheel = wheel;
+            _idle_entry = entry;
         }
-        virtual int32_t ReadInt32() override
+
+        virtual void Send(const BaseMessage::ptr &msg) override
         {
-            return _buf->readInt32();
+            muduo::net::EventLoop *loop = _conn->getLoop();
+            if (loop->isInLoopThread())
+            {
+                // IO线程上：报文直接序列化进线程局部的缓冲区再交给muduo，
+                // socket能一次写完时数据不会再经过连接的outputBuffer
+                static thread_local muduo::net::Buffer frame;
+                MuduoBuffer buf(&frame);
+                if (_protocol->Serialize(msg, BufferFactory::Borrow(buf)))
+                    SendInLoop(&frame);
+                // 连接已断开时send不会取走数据，这里统一清空
+                frame.retrieveAll();
+                return;
+            }
+            // 业务线程上产生的响应：序列化在当前线程完成，真正的发送交回连接所属的IO线程
+            // 报文缓冲区直接交给IO线程，避免muduo跨线程send时再拷贝一次
+            auto frame = std::make_shared<muduo::net::Buffer>();
+            MuduoBuffer buf(frame.get());
+            if (_protocol->Serialize(msg, BufferFactory::Borrow(buf)) == false)
+                return;
+            auto self = shared_from_this();
+            loop->queueInLoop([self, frame]()
+                              { self->SendInLoop(frame.get()); });
         }
-        virtual std::string RetrieveAsString(size_t len) override
+        virtual bool Connected() override
         {
-            return _buf->retrieveAsString(len);
+            return _conn->connected();
         }
-
-    private:
-        // 这个指针的资源管理并不是由muduobuffer来进行的，muduobuffer目的是实现功能向外提供接口，并不负责资源的释放
-        muduo::net::Buffer *_buf;
-    };
-    class BufferFactory
-    {
-    public:
-        template <typename... Args>
-        static BaseBuffer::ptr Create(Args &&...args)
+        virtual const BaseProtocol::ptr &Protocol() override
         {
-            return std::make_shared<MuduoBuffer>(std::forward<Args>(args)...);
+            return _protocol;
         }
-    };
-
-    class LVProtocol : public BaseProtocol
-    {
-    public:
-        using ptr = std::shared_ptr<LVProtocol>;
-
-        // 判断缓冲区的数据是否够一条消息
-        virtual bool IsProcessable(const BaseBuffer::ptr &buffer) override
+        // 最近一次发送、收到数据的时间(Clock::NowUs)，只能在IO线程中调用，客户端用来决定何时发心跳
+        int64_t LastSendUs() const { return _last_send_us; }
+        int64_t LastRecvUs() const { return _last_recv_us; }
+        // 从muduo的输入缓冲区中解析出所有完整的消息交给cb
+        void OnMessage(muduo::net::Buffer *buf, const MessageCallback &cb)
         {
-            if (buffer->ReadableSize() < lenFieldLength)
-            {
-                return false;
-            }
-            int32_t total_len = buffer->PeekInt32();
-            if (buffer->ReadableSize() < total_len + lenFieldLength)
-            {
-                return false;
-            }
-            return true;
+            LOG(LogLevel::DEBUG) << "有数据到来";
+            _last_recv_us = Clock::NowUs();
+            if (_quickack_fd >= 0)
+                SocketOps::QuickAck(_quickack_fd);
+            if (_idle_wheel != nullptr)
+                _idle_wheel->Touch(_idle_entry);
+            MuduoBuffer muduo_buf(buf);
+            if (FrameReader::Process(shared_from_this(), BufferFactory::Borrow(muduo_buf), cb) == false)
+                _conn->shutdown();
+            // muduo的输入缓冲区是连接的成员，只能在大报文过后收缩
+            BufferPool::Shrink(buf);
+            UpdateUsage();
         }
-        virtual bool OnMessage(const BaseBuffer::ptr &buffer, BaseMessage::ptr &msg) override
+        // 需要在连接所属的IO线程中、发送任何数据之前调用(MuduoServer在onConnection中设置)
+        virtual void SetHighWaterMark(size_t mark, OverloadPolicy policy, const HighWaterMarkCallback &cb) override
         {
-            // 调用OnMessage默认是至少有一个完整的数据报文才会被处理，所以这里不需要判断数据是否够一条消息
-            int32_t total_len = buffer->ReadInt32();    // 读取总长度
-            MType mtype = (MType)(buffer->ReadInt32()); // 读取数据类型
-            int32_t idlen = buffer->ReadInt32();        // 读取id长度
-            int32_t body_len = total_len - idlen - mtypeFieldLength - lenFieldLength;
-            std::string id = buffer->RetrieveAsString(idlen);      // 读取id
-            std::string body = buffer->RetrieveAsString(body_len); // 读取body
-            // msg = MessageFactory::CreateMessage(static_cast<MType>(mtype));
-            msg = MessageFactory::CreateMessage(mtype);
-            if (msg.get() == nullptr)
-            {
-                LOG(LogLevel::ERROR) << "message type error,creat message failed";
-                return false;
-            }
-            bool ret = msg->Deserialize(body);
-            if (!ret)
-            {
-                LOG(LogLevel::ERROR) << "deserialize message failed";
-                return false;
-            }
-            msg->SetId(id);
-            msg->SetType(mtype);
-
-            return true;
+            // 不限制高水位时不注册写完回调，输出缓冲区在下一次发送时收缩(见AfterSend)
+            if (mark == 0)
+                return;
+            // muduo连接持有这两个回调，用weak_ptr避免和MuduoConnection互相引用
+            std::weak_ptr<MuduoConnection> weak = shared_from_this();
+            _conn->setWriteCompleteCallback([weak](const muduo::net::TcpConnectionPtr &)
+                                            {
+                                                if (auto self = weak.lock())
+                                                    self->OnWriteComplete(); });
+            _policy = policy;
+            _on_high_water_mark = cb;
+            _conn->setHighWaterMarkCallback([weak](const muduo::net::TcpConnectionPtr &, size_t bytes)
+                                            {
+                                                if (auto self = weak.lock())
+                                                    self->OnHighWaterMark(bytes); },
+                                            mark);
         }
-        virtual std::string Serialize(const BaseMessage::ptr &msg) override
+        virtual bool Overloaded() override
         {
-            // |--Len--|--mtype--|--idlen--|--id--|--body--|
-            std::string body = msg->Serialize();
-            std::string id = msg->GetId();
-            auto mtype = htonl((int32_t)msg->GetType());
-            int32_t idlen = htonl(id.size());
-            int32_t h_total_len = mtypeFieldLength + idlenFieldLength + id.size() + body.size();
-            int32_t n_total_len = htonl(h_total_len);
-
-            std::string result;
-            result.reserve(h_total_len);
-            result.append((char *)&n_total_len, lenFieldLength);
-            result.append((char *)&mtype, mtypeFieldLength);
-            result.append((char *)&idlen, idlenFieldLength);
-            result.append(id);
-            result.append(body);
-            return result;
+            return _overloaded;
+        }
+        virtual bool RejectRequests() override
+        {
+            return _overloaded && _policy != OverloadPolicy::OVERLOAD_STOP_PEER_READ;
+        }
+        virtual size_t BacklogBytes() override
+        {
+            if (_conn->getLoop()->isInLoopThread())
+                UpdateBacklog();
+            return _backlog;
+        }
+        virtual size_t BufferBytes() override
+        {
+            return _usage.Get();
+        }
+        virtual void Shutdown() override
+        {
+            if (_cork == false)
+                return _conn->shutdown();
+            // 先把攒着的报文写出去，否则关闭写端之后它们就丢了
+            auto self = shared_from_this();
+            _conn->getLoop()->runInLoop([self]()
+                                        {
+                                            self->Flush();
+                                            self->_conn->shutdown(); });
         }
 
     private:
-        const size_t lenFieldLength = 4;
-        const size_t mtypeFieldLength = 4;
-        const size_t idlenFieldLength = 4;
-    };
-
-    class ProtocolFactory
-    {
-    public:
-        template <typename... Args>
-        static BaseProtocol::ptr Create(Args &&...args)
+        void SendInLoop(muduo::net::Buffer *frame)
         {
-            return std::make_shared<LVProtocol>(std::forward<Args>(args)...);
+            _last_send_us = Clock::NowUs();
+            if (_cork == false)
+            {
+                _conn->send(frame);
+                return AfterSend();
+            }
+            // 写合并的缓冲区从IO线程的池中借，写出去之后归还；攒着的报文本轮就会写出，积压在Flush之后再统计
+            if (_pending.get() == nullptr)
+                _pending = BufferPool::Local().Get(frame->readableBytes());
+            _pending->append(frame->peek(), frame->readableBytes());
+            if (_flush_queued)
+                return;
+            // 在IO线程中queueInLoop的任务会在本轮所有事件回调处理完之后执行，
+            // 这一轮里解析出的多个请求产生的响应就会合并成一次write
+            _flush_queued = true;
+            auto self = shared_from_this();
+            _conn->getLoop()->queueInLoop([self]()
+                                          { self->Flush(); });
         }
-    };
-
-    class MuduoConnection : public BaseConnection
-    {
-    public:
-        using ptr = std::shared_ptr<MuduoConnection>;
-
-        MuduoConnection(const muduo::net::TcpConnectionPtr &conn,
-                        const BaseProtocol::ptr &protocol) : _conn(conn), _protocol(protocol)
+        void Flush()
         {
+            _flush_queued = false;
+            if (_pending.get() != nullptr && _pending->readableBytes() > 0)
+                _conn->send(_pending.get());
+            BufferPool::Local().Put(std::move(_pending));
+            AfterSend();
         }
-
-        virtual void Send(const BaseMessage::ptr &msg) override
+        // socket一次写完、之前也没有积压是最常见的情况，这时积压和缓冲区占用都没有变化，不再重新统计
+        // 输出缓冲区里有数据或者上次统计时还有积压才更新：积压写空之后的第一次发送会收缩输出缓冲区
+        void AfterSend()
         {
-            LOG(LogLevel::DEBUG)<<"发送数据包";
-            LOG(LogLevel::DEBUG)<<"发送数据包";
-            LOG(LogLevel::DEBUG)<<"发送数据包";
-
-            std::string body = _protocol->Serialize(msg);
-            _conn->send(body);
+            if (_conn->outputBuffer()->readableBytes() != 0 || _backlog.load(std::memory_order_relaxed) != 0)
+                UpdateBacklog();
         }
-        virtual bool Connected() override
+        void UpdateBacklog()
         {
-            return _conn->connected();
+            muduo::net::Buffer *output = _conn->outputBuffer();
+            // 输出缓冲区写空之后收缩，慢订阅者的积压写完不再一直占着峰值大小
+            if (output->readableBytes() == 0)
+                BufferPool::Shrink(output);
+            _backlog = output->readableBytes() + (_pending.get() != nullptr ? _pending->readableBytes() : 0);
+            UpdateUsage();
         }
-        virtual void Shutdown() override
+        void UpdateUsage()
+        {
+            _usage.Set(_conn->inputBuffer()->internalCapacity() + _conn->outputBuffer()->internalCapacity() +
+                       BufferPool::Capacity(_pending));
+        }
+        // muduo在outputBuffer增长越过高水位的那一次send之后回调，只会在IO线程中执行
+        void OnHighWaterMark(size_t bytes)
+        {
+            _backlog = bytes;
+            if (_overloaded)
+                return;
+            _overloaded = true;
+            LOG(LogLevel::WARNING) << "连接发送积压超过高水位: " << bytes << " 字节";
+            switch (_policy)
+            {
+            case OverloadPolicy::OVERLOAD_STOP_PEER_READ:
+                _conn->stopRead();
+                break;
+            case OverloadPolicy::OVERLOAD_DISCONNECT:
+                // shutdown要等积压写完才关闭，这里必须强制关闭
+                _conn->forceClose();
+                break;
+            default:
+                break;
+            }
+            if (_on_high_water_mark)
+                _on_high_water_mark(shared_from_this(), bytes);
+        }
+        // outputBuffer写空时回调
+        void OnWriteComplete()
         {
-            _conn->shutdown();
+            UpdateBacklog();
+            if (_overloaded == false)
+                return;
+            _overloaded = false;
+            LOG(LogLevel::INFO) << "连接发送积压已写完，解除过载状态";
+            if (_policy == OverloadPolicy::OVERLOAD_STOP_PEER_READ)
+                _conn->startRead();
         }
 
     private:
-        BaseProtocol::ptr _protocol;
         muduo::net::TcpConnectionPtr _conn;
+        BaseProtocol::ptr _protocol;
+        // 以下成员只在连接所属的IO线程中访问
+        bool _cork;
+        bool _flush_queued;
+        BufferPool::BufferPtr _pending;
+        int _quickack_fd;
+        TimingWheel *_idle_wheel;
+        TimingWheel::WeakEntry _idle_entry;
+        int64_t _last_send_us;
+        int64_t _last_recv_us;
+        OverloadPolicy _policy;
+        HighWaterMarkCallback _on_high_water_mark;
+        // 以下成员在IO线程中更新，其他线程读取
+        std::atomic<bool> _overloaded;
+        std::atomic<size_t> _backlog;
+        BufferUsage _usage;
     };
 
     class ConnectionFactory
     {
     public:
         template <typename... Args>
-        static BaseConnection::ptr Create(Args &&...args)
+        static MuduoConnection::ptr Create(Args &&...args)
         {
             return std::make_shared<MuduoConnection>(std::forward<Args>(args)...);
         }
     };
 
+    // 监听socket由自己创建(而不是muduo::net::TcpServer)，这样ServerOptions::socket中的参数可以在listen之前、
+    // 以及每个连接accept出来之后设置；IO线程池、连接对象仍然使用muduo的实现
     class MuduoServer : public BaseServer
     {
     public:
         using ptr = std::shared_ptr<MuduoServer>;
-        MuduoServer(int port) : _server(&_baseloop, muduo::net::InetAddress("0,0,0,0", port), "MuduoServer", muduo::net::TcpServer::kReusePort),
-                                _protocol(ProtocolFactory::Create()) {}
+        MuduoServer(int port, const ServerOptions &options = ServerOptions())
+            : _port(port), _options(options), _pool(&_baseloop, "MuduoServer"),
+              _admission(options.admission ? options.admission
+                                           : AdmissionControl::Create(options.max_connections, options.max_connections_per_ip, options.accept_rate))
+        {
+            // 必须在start之前设置，start时才会创建IO线程
+            _pool.setThreadNum(options.io_threads);
+        }
+        ~MuduoServer()
+        {
+            for (auto &it : _tcp_conns)
+            {
+                muduo::net::TcpConnectionPtr conn = it.second;
+                conn->getLoop()->runInLoop(std::bind(&muduo::net::TcpConnection::connectDestroyed, conn));
+            }
+        }
         virtual void Start()
         {
-            _server.setConnectionCallback(std::bind(&MuduoServer::onConnection, this, std::placeholders::_1));
-            _server.setMessageCallback(std::bind(&MuduoServer::onMessage, this,
-                                                 std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-            _server.start();
+            _pool.start();
+            if (_options.idle_timeout_ms > 0)
+            {
+                // 每个IO线程一个时间轮，只在该线程中访问；_wheels在这之后不再修改，各线程只读
+                for (muduo::net::EventLoop *loop : _pool.getAllLoops())
+                {
+                    auto wheel = std::make_shared<TimingWheel>(_options.idle_timeout_ms);
+                    _wheels[loop] = wheel;
+                    loop->runEvery(wheel->TickMs() / 1000.0, std::bind(&TimingWheel::Tick, wheel));
+                }
+            }
+            _tcp_acceptor = std::make_shared<SocketAcceptor>(&_baseloop);
+            _tcp_acceptor->SetNewConnectionCallback(std::bind(&MuduoServer::onNewConnection, this, std::placeholders::_1, true));
+            // 和muduo的Acceptor一样，端口监听不了时直接退出，不能带着一个不接受连接的端口继续运行(还会被注册到注册中心)
+            if (_tcp_acceptor->ListenTcp(_port, _options.socket) == false)
+            {
+                LOG(LogLevel::FATAL) << "服务端启动失败，无法监听端口: " << _port;
+                ::abort();
+            }
+            if (_options.unix_path.empty() == false)
+            {
+                // unix域套接字上的连接和TCP连接共用IO线程、回调和连接表，上层感知不到区别
+                _unix_acceptor = std::make_shared<SocketAcceptor>(&_baseloop);
+                _unix_acceptor->SetNewConnectionCallback(std::bind(&MuduoServer::onNewConnection, this, std::placeholders::_1, false));
+                if (_unix_acceptor->ListenUnix(_options.unix_path) == false)
+                    _unix_acceptor.reset();
+            }
+            if (_options.shm_path.empty() == false)
+            {
+                _shm_server = std::make_shared<ShmServer>(_options.shm_path, _options, &_baseloop);
+                _shm_server->SetConnectionCallback(_on_connection);
+                _shm_server->SetCloseCallback(_on_close);
+                _shm_server->SetMessageCallback(_on_message);
+                if (_shm_server->Listen() == false)
+                    _shm_server.reset();
+            }
             _baseloop.loop();
         }
+        virtual void StopAccept() override
+        {
+            _baseloop.runInLoop([this]()
+                                {
+                                    _tcp_acceptor.reset();
+                                    _unix_acceptor.reset();
+                                    if (_shm_server)
+                                        _shm_server->StopAccept(); });
+        }
+        virtual void Stop(int timeout_ms) override
+        {
+            _baseloop.runInLoop([this, timeout_ms]()
+                                {
+                                    if (_stopping)
+                                        return;
+                                    _stopping = true;
+                                    _tcp_acceptor.reset();
+                                    _unix_acceptor.reset();
+                                    if (_shm_server)
+                                        _shm_server->Stop(timeout_ms);
+                                    LOG(LogLevel::INFO) << "服务端停止中，等待" << _tcp_conns.size() << "个连接关闭";
+                                    // 经过MuduoConnection关闭，写合并攒着的响应也会先写出去
+                                    std::vector<BaseConnection::ptr> conns;
+                                    {
+                                        std::unique_lock<std::mutex> lock(_mutex);
+                                        for (auto &it : _conns)
+                                            conns.push_back(it.second);
+                                    }
+                                    for (auto &conn : conns)
+                                        conn->Shutdown();
+                                    _baseloop.runAfter(timeout_ms / 1000.0, std::bind(&MuduoServer::ForceStop, this));
+                                    QuitIfDrained(); });
+        }
 
     private:
-        void onConnection(const muduo::net::TcpConnectionPtr &conn)
+        // 以下两个函数在_baseloop中执行
+        void ForceStop()
+        {
+            if (_tcp_conns.empty() == false)
+                LOG(LogLevel::WARNING) << "停止超时，强制关闭" << _tcp_conns.size() << "个连接";
+            // 剩下的连接由析构函数清理
+            for (auto &it : _tcp_conns)
+                it.second->forceClose();
+            _baseloop.quit();
+        }
+        void QuitIfDrained()
+        {
+            if (_stopping && _tcp_conns.empty())
+                _baseloop.quit();
+        }
+        // 在_baseloop中执行：为新连接创建TcpConnection并按轮询分配一个IO线程
+        void onNewConnection(int fd, bool tcp)
+        {
+            // 准入判断放在最前面，被拒绝的连接不创建TcpConnection，也不进入连接表
+            if (_admission && _admission->Admit(tcp ? SocketOps::PeerIp(fd) : 0) == false)
+                return SocketOps::Reject(fd);
+            SocketOps::ApplyConnected(fd, tcp, _options.socket);
+            muduo::net::EventLoop *loop = _pool.getNextLoop();
+            std::string name = (tcp ? "MuduoServer#" : "MuduoServer-unix#") + std::to_string(++_conn_id);
+            auto conn = std::make_shared<muduo::net::TcpConnection>(loop, name, fd,
+                                                                    SocketOps::LocalAddr(fd), SocketOps::PeerAddr(fd));
+            _tcp_conns[name] = conn;
+            int quickack_fd = (tcp && _options.socket.tcp_quickack) ? fd : -1;
+            conn->setConnectionCallback(std::bind(&MuduoServer::onConnection, this, std::placeholders::_1, quickack_fd));
+            conn->setMessageCallback(std::bind(&MuduoServer::onMessage, this,
+                                               std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+            conn->setCloseCallback(std::bind(&MuduoServer::removeConnection, this, std::placeholders::_1));
+            loop->runInLoop(std::bind(&muduo::net::TcpConnection::connectEstablished, conn));
+        }
+        // 在连接所属的IO线程中执行，_tcp_conns只在_baseloop中访问
+        void removeConnection(const muduo::net::TcpConnectionPtr &conn)
+        {
+            _baseloop.runInLoop([this, conn]()
+                                {
+                                    _tcp_conns.erase(conn->name());
+                                    // unix域套接字的peerAddress是空地址，和Admit时一样得到0
+                                    if (_admission)
+                                        _admission->Release(conn->peerAddress().ipv4NetEndian());
+                                    conn->getLoop()->queueInLoop(std::bind(&muduo::net::TcpConnection::connectDestroyed, conn));
+                                    QuitIfDrained(); });
+        }
+        void onConnection(const muduo::net::TcpConnectionPtr &conn, int quickack_fd)
         {
             if (conn->connected())
             {
                 std::cout << "连接建立" << std::endl;
-                auto muduo_conn = ConnectionFactory::Create(conn, _protocol);
-
+                // 每个连接一个协议对象，分片重组的状态互不干扰，多个IO线程之间也不共享
+                auto protocol = ProtocolFactory::Create(_options.max_message_size, _options.compress);
+                auto muduo_conn = ConnectionFactory::Create(conn, protocol, _options.cork_writes);
+                muduo_conn->EnableQuickAck(quickack_fd);
+                auto wheel = _wheels.find(conn->getLoop());
+                if (wheel != _wheels.end())
+                {
+                    std::weak_ptr<muduo::net::TcpConnection> weak = conn;
+                    auto entry = wheel->second->Add([weak]()
+                                                    {
+                                                        muduo::net::TcpConnectionPtr conn = weak.lock();
+                                                        if (conn && conn->connected())
+                                                        {
+                                                            LOG(LogLevel::INFO) << "连接空闲超时，关闭: " << conn->name();
+                                                            conn->forceClose();
+                                                        } });
+                    muduo_conn->SetIdleWheel(wheel->second.get(), entry);
+                }
+                // 绑定到TcpConnection的上下文中，onMessage直接从上下文取，热路径上不加锁也不查表
+                conn->setContext(muduo_conn);
+                muduo_conn->SetHighWaterMark(_options.high_water_mark, _options.overload_policy, _on_high_water_mark);
                 {
+                    // _conns只用于遍历和关闭时的清理
                     std::unique_lock<std::mutex> lock(_mutex);
                     _conns[conn] = muduo_conn;
                 }
@@ -219,100 +457,304 @@ namespace Rpc
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
                     auto it = _conns.find(conn);
-                    if (it != _conns.end())
+                    if (it == _conns.end())
                         return;
                     muduo_conn = it->second;
-                    _conns.erase(conn);
+                    _conns.erase(it);
                 }
+                // 上下文持有MuduoConnection，MuduoConnection又持有TcpConnectionPtr，断开时要解开这个循环引用
+                conn->setContext(boost::any());
                 if (_on_close)
                     _on_close(muduo_conn);
             }
         }
         void onMessage(const muduo::net::TcpConnectionPtr &conn, muduo::net::Buffer *buf, muduo::Timestamp)
         {
-            LOG(LogLevel::DEBUG) << "有数据到来";
-            // 明白这个函数是干嘛用的才能编写
-            //  1.首先检查缓冲区的数据是否是可处理的
-            //  2.再交给协议进行一个反序列化的处理
-            //  3.根据反序列化的结果，创建消息对象，并交给回调函数处理
-            auto base_buf = BufferFactory::Create(buf);
-            while (1)
-            {
-                if (_protocol->IsProcessable(base_buf) == false)
-                {
-                    if (base_buf->ReadableSize() > maxDataSize)
-                    {
-                        LOG(LogLevel::ERROR) << "数据包太大";
-                        conn->shutdown();
-                        return;
-                    }
-                    LOG(LogLevel::DEBUG) << "数据包不完整";
-                    break;
-                }
-                BaseMessage::ptr msg;
-                bool ret = _protocol->OnMessage(base_buf, msg);
-                if (ret == false)
-                {
-                    LOG(LogLevel::ERROR) << "数据包解析失败";
-                    conn->shutdown();
-                    return;
-                }
-                BaseConnection::ptr base_conn;
-                {
-                    std::unique_lock<std::mutex> lock(_mutex);
-                    auto it = _conns.find(conn);
-                    if (it == _conns.end())
-                    {
-                        conn->shutdown();
-                        return;
-                    }
-                    base_conn = it->second;
-                }
-                if (_on_message)
-                    _on_message(base_conn, msg);
+            const MuduoConnection::ptr *ctx = boost::any_cast<MuduoConnection::ptr>(&conn->getContext());
+            if (ctx == nullptr)
+            {
+                conn->shutdown();
+                return;
             }
+            // 拷贝一份，回调中即使连接被关闭、上下文被清空也不会悬空
+            MuduoConnection::ptr muduo_conn = *ctx;
+            muduo_conn->OnMessage(buf, _on_message);
         }
 
     private:
-        const size_t maxDataSize = (1 << 16);
-        BaseProtocol::ptr _protocol;
+        int _port;
+        ServerOptions _options;
         muduo::net::EventLoop _baseloop;
-        muduo::net::TcpServer _server;
+        muduo::net::EventLoopThreadPool _pool;
+        AdmissionControl::ptr _admission;
+        std::unordered_map<muduo::net::EventLoop *, TimingWheel::ptr> _wheels;
         std::mutex _mutex;
         std::unordered_map<muduo::net::TcpConnectionPtr, BaseConnection::ptr> _conns;
+        // 监听和连接表，只在_baseloop中访问
+        SocketAcceptor::ptr _tcp_acceptor;
+        SocketAcceptor::ptr _unix_acceptor;
+        size_t _conn_id = 0;
+        bool _stopping = false;
+        std::unordered_map<std::string, muduo::net::TcpConnectionPtr> _tcp_conns;
+        ShmServer::ptr _shm_server;
+    };
+
+    // ServerOptions::acceptor_groups大于1时使用：每组是一个完整的服务端(MuduoServer或UringServer)，
+    // 第一组在Start的调用线程中运行，其余各组各占一个线程；回调共用，连接表、事件循环各组独立
+    class ReusePortServer : public BaseServer
+    {
+    public:
+        using ptr = std::shared_ptr<ReusePortServer>;
+        using GroupFactory = std::function<BaseServer::ptr(const ServerOptions &)>;
+        ReusePortServer(const ServerOptions &options, const GroupFactory &factory)
+            : _options(options), _factory(factory), _stopping(false)
+        {
+            // 准入上限对整个服务端生效，各组共用一份计数
+            if (_options.admission.get() == nullptr)
+                _options.admission = AdmissionControl::Create(options.max_connections, options.max_connections_per_ip, options.accept_rate);
+        }
+
+        // 所有组都退出之后返回
+        virtual void Start() override
+        {
+            std::vector<std::thread> threads;
+            for (int i = 1; i < _options.acceptor_groups; i++)
+                threads.emplace_back(&ReusePortServer::RunGroup, this, i);
+            RunGroup(0);
+            for (auto &thread : threads)
+                thread.join();
+        }
+        virtual void StopAccept() override
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            for (auto &group : _groups)
+                group->StopAccept();
+        }
+        // 各组在各自的线程中同时停止，剩余时间按同一个截止时间计算，后停止的组不会多等
+        // 调用各组的Stop时不持有_mutex，正在启动的组不会被挡住
+        virtual void Stop(int timeout_ms) override
+        {
+            std::vector<BaseServer::ptr> groups;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _stopping = true;
+                groups = _groups;
+            }
+            int64_t deadline_us = Clock::NowUs() + std::max(timeout_ms, 0) * 1000LL;
+            std::vector<std::thread> threads;
+            for (auto &group : groups)
+                threads.emplace_back([group, deadline_us]()
+                                     { group->Stop((int)std::max<int64_t>(0, (deadline_us - Clock::NowUs()) / 1000)); });
+            for (auto &thread : threads)
+                thread.join();
+        }
+
+    private:
+        void RunGroup(int index)
+        {
+            ServerOptions options = _options;
+            options.acceptor_groups = 1;
+            if (index > 0)
+            {
+                options.unix_path.clear();
+                options.shm_path.clear();
+            }
+            // muduo的EventLoop只能在运行它的线程中创建，所以每组在自己的线程里构造
+            BaseServer::ptr group = _factory(options);
+            group->SetConnectionCallback(_on_connection);
+            group->SetCloseCallback(_on_close);
+            group->SetMessageCallback(_on_message);
+            group->SetHighWaterMarkCallback(_on_high_water_mark);
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_stopping)
+                    return;
+                _groups.push_back(group);
+            }
+            // 在Start之前调用的Stop会排进这一组的事件循环，循环开始后立即执行
+            group->Start();
+        }
+
+    private:
+        ServerOptions _options;
+        GroupFactory _factory;
+        std::mutex _mutex;
+        bool _stopping;
+        std::vector<BaseServer::ptr> _groups;
     };
 
     class ServerFactory
     {
     public:
-        template <typename... Args>
-        static BaseServer::ptr Create(Args &&...args)
+        static BaseServer::ptr Create(int port, const ServerOptions &options = ServerOptions())
         {
-            return std::make_shared<MuduoServer>(std::forward<Args>(args)...);
+            if (options.acceptor_groups > 1)
+            {
+                return std::make_shared<ReusePortServer>(options, [port](const ServerOptions &group_options)
+                                                         { return ServerFactory::Create(port, group_options); });
+            }
+            if (options.backend == NetBackend::BACKEND_IO_URING)
+            {
+#ifdef RPC_HAVE_IO_URING
+                if (UringLoop::Supported())
+                    return std::make_shared<UringServer>(port, options);
+#endif
+                LOG(LogLevel::WARNING) << "当前环境不支持io_uring，使用muduo后端";
+            }
+            return std::make_shared<MuduoServer>(port, options);
         }
     };
 
-    class MuduoClient : public BaseClient
+    // 进程内所有MuduoClient共享的一组IO线程
+    // 开启服务发现的RpcClient每连一个服务提供者就有一个MuduoClient，每个客户端各开一个线程的话线程数会随提供者数量增长
+    class ClientLoopPool
     {
     public:
-        using ptr = std::shared_ptr<MuduoClient>;
-        MuduoClient(const std::string &ip, int port) : _downlatch(1),
-                                                       _protocol(ProtocolFactory::Create()),
-                                                       _baseloop(_loopthread.startLoop()),
-                                                       _client(_baseloop, muduo::net::InetAddress(ip, port), "MuduoClient") {}
+        // 第一次调用时创建并启动所有IO线程；进程退出时不析构，避免和持有客户端的静态对象之间的析构顺序问题
+        static ClientLoopPool &Instance()
+        {
+            static ClientLoopPool *pool = new ClientLoopPool(ThreadNum());
+            return *pool;
+        }
+        // 必须在创建第一个客户端之前调用，之后再设置不生效
+        static void SetThreadNum(size_t thread_num)
+        {
+            ThreadNum() = thread_num;
+        }
+        // 轮询分配
+        muduo::net::EventLoop *GetNextLoop()
+        {
+            return _loops[_next++ % _loops.size()];
+        }
+        // 按哈希分配，同一个哈希值总是落在同一个线程上
+        muduo::net::EventLoop *GetLoopForHash(size_t hash)
+        {
+            return _loops[hash % _loops.size()];
+        }
+        size_t Size() const { return _loops.size(); }
+        // 当前线程是不是池中的IO线程；在这些线程中不能阻塞等待其他客户端的loop
+        bool InPoolThread() const
+        {
+            muduo::net::EventLoop *loop = muduo::net::EventLoop::getEventLoopOfCurrentThread();
+            return loop != nullptr && std::find(_loops.begin(), _loops.end(), loop) != _loops.end();
+        }
 
-        virtual void Connect() override
+    private:
+        explicit ClientLoopPool(size_t thread_num) : _next(0)
         {
-            LOG(LogLevel::DEBUG) << "设置回调函数";
-            _client.setConnectionCallback(std::bind(&MuduoClient::onConnection, this, std::placeholders::_1));
-            _client.setMessageCallback(std::bind(&MuduoClient::onMessage, this, std::placeholders::_1,
-                                                 std::placeholders::_2, std::placeholders::_3));
+            if (thread_num == 0)
+                thread_num = 1;
+            for (size_t i = 0; i < thread_num; i++)
+            {
+                _threads.emplace_back(new muduo::net::EventLoopThread(muduo::net::EventLoopThread::ThreadInitCallback(),
+                                                                      "RpcClientLoop" + std::to_string(i)));
+                _loops.push_back(_threads.back()->startLoop());
+            }
+        }
+        static size_t &ThreadNum()
+        {
+            // 默认和CPU核数相同，最多4个：客户端的IO线程只做收发和解析
+            static size_t thread_num = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+            return thread_num;
+        }
 
-            _client.connect();
-            _downlatch.wait();
-            LOG(LogLevel::DEBUG) << "连接服务器成功";
+    private:
+        std::atomic<size_t> _next;
+        std::vector<std::unique_ptr<muduo::net::EventLoopThread>> _threads;
+        std::vector<muduo::net::EventLoop *> _loops;
+    };
+
+    // socket由客户端自己创建并发起非阻塞connect(和muduo的Connector一样用Channel等待可写)，
+    // ClientOptions::socket中的参数才能在connect之前设置；连接建立之后交给muduo的TcpConnection
+    // ip写成"unix:/path/to/socket"时连接同一台机器上服务端的unix域套接字(服务端需要设置ServerOptions::unix_path)
+    // 交给loop的回调都只持有客户端的弱引用，所以必须通过shared_ptr持有(ClientFactory::Create)
+    class MuduoClient : public BaseClient, public std::enable_shared_from_this<MuduoClient>
+    {
+    public:
+        using ptr = std::shared_ptr<MuduoClient>;
+        static constexpr int initRetryDelayMs = 500;
+        static constexpr int maxRetryDelayMs = 30 * 1000;
+        static constexpr int rttProbeIntervals = 6;
+
+        MuduoClient(const std::string &ip, int port, const ClientOptions &options = ClientOptions())
+            : _options(options),
+              _name("MuduoClient:" + ip + ":" + std::to_string(port)),
+              _loop(ClientLoopPool::Instance().GetNextLoop()),
+              _addr_len(0),
+              _started(false),
+              _retry_delay_ms(initRetryDelayMs),
+              _last_probe_us(0),
+              _quickack_fd(-1)
+        {
+            if (SocketOps::Resolve(ip, port, _addr, _addr_len) == false)
+                _addr_len = 0;
+        }
+        ~MuduoClient()
+        {
+            // loop是共享的，比客户端活得久。回调只持有弱引用，走到这里时loop中已经不会再有回调访问this，
+            // 所以不用等loop线程(两个loop互相析构对方的客户端时，等待会死锁)：
+            // 把连接、正在进行的connect和定时器交给loop线程清理，之后到来的事件不会再回调到已经销毁的对象上
+            muduo::net::EventLoop *loop = _loop;
+            muduo::net::TcpConnectionPtr tcp_conn = std::move(_tcp_conn);
+            std::shared_ptr<muduo::net::Channel> connecting = std::move(_connecting);
+            muduo::net::TimerId retry_timer = _retry_timer;
+            muduo::net::TimerId heartbeat_timer = _heartbeat_timer;
+            _loop->runInLoop([loop, tcp_conn, connecting, retry_timer, heartbeat_timer]()
+                             {
+                                 loop->cancel(retry_timer);
+                                 loop->cancel(heartbeat_timer);
+                                 if (connecting)
+                                 {
+                                     connecting->disableAll();
+                                     connecting->remove();
+                                     ::close(connecting->fd());
+                                 }
+                                 if (tcp_conn)
+                                 {
+                                     DetachCallbacks(tcp_conn);
+                                     tcp_conn->setCloseCallback(&MuduoClient::DestroyConnection);
+                                     tcp_conn->forceClose();
+                                 } });
         }
 
+        // 超时返回false；开启了自动重连时后台会继续尝试，连上之后通过连接回调通知
+        // 在客户端的IO线程(比如异步响应的回调)中调用时不等待：等待会让同一线程上的所有客户端停住，
+        // 客户端恰好分到这个线程时更是永远连不上。这时连接在后台建立，返回值只表示是否已经连上
+        virtual bool Connect() override
+        {
+            std::weak_ptr<MuduoClient> weak = weak_from_this();
+            _loop->runInLoop([weak]()
+                             {
+                                 if (auto self = weak.lock())
+                                 {
+                                     // 手动连接代替等待中的重试
+                                     self->_started = true;
+                                     self->_loop->cancel(self->_retry_timer);
+                                     self->ConnectInLoop();
+                                 } });
+            if (ClientLoopPool::Instance().InPoolThread())
+            {
+                LOG(LogLevel::WARNING) << "在客户端IO线程中调用Connect，不等待连接建立: " << _name;
+                return Connected();
+            }
+            if (WaitConnected())
+                return true;
+            if (_options.auto_reconnect == false)
+                _loop->runInLoop(Weak(&MuduoClient::Stop));
+            return false;
+        }
+        virtual void Shutdown() override
+        {
+            std::weak_ptr<MuduoClient> weak = weak_from_this();
+            _loop->runInLoop([weak]()
+                             {
+                                 if (auto self = weak.lock())
+                                 {
+                                     self->Stop();
+                                     if (self->_tcp_conn)
+                                         self->_tcp_conn->shutdown();
+                                 } });
+        }
         virtual bool Send(const BaseMessage::ptr &msg) override
         {
             // 获取连接的本地副本并加锁
@@ -339,9 +781,6 @@ namespace Rpc
 
             try
             {
-                std::string serialized_data = msg->Serialize();
-                LOG(LogLevel::DEBUG) << "消息序列化成功，长度: " << serialized_data.length();
-
                 conn->Send(msg);
                 LOG(LogLevel::DEBUG) << "消息发送成功";
                 return true;
@@ -360,84 +799,277 @@ namespace Rpc
             }
         }
 
-        virtual void Shutdown() override
-        {
-            return _client.disconnect();
-        }
         virtual BaseConnection::ptr Connection() override
         {
+            std::lock_guard<std::mutex> lock(_conn_mutex);
             return _conn;
         }
         virtual bool Connected() override
         {
-            return (_conn && _conn->Connected());
+            BaseConnection::ptr conn = Connection();
+            return (conn && conn->Connected());
         }
 
     private:
-        void onConnection(const muduo::net::TcpConnectionPtr &conn)
+        // 交给loop的回调：客户端析构之后才执行时什么也不做
+        std::function<void()> Weak(void (MuduoClient::*fn)())
         {
-            if (conn->connected())
+            std::weak_ptr<MuduoClient> weak = weak_from_this();
+            return [weak, fn]()
             {
-                LOG(LogLevel::DEBUG) << "连接建立";
-                _conn = ConnectionFactory::Create(conn, _protocol);
-                _downlatch.countDown(); // 计数--，为0时唤醒阻塞
+                if (auto self = weak.lock())
+                    ((*self).*fn)();
+            };
+        }
+        // 以下函数都在_loop中执行
+        void ConnectInLoop()
+        {
+            if (_started == false || _addr_len == 0)
+                return;
+            // 已经连上或者connect还在进行中(比如Connect超时之后再次调用)：不能再发起一个，
+            // 否则会覆盖_connecting而它的Channel还注册在loop中，或者替换掉正在使用的连接
+            if (_tcp_conn || _connecting)
+                return;
+            int fd = ::socket(_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                LOG(LogLevel::ERROR) << "创建socket失败: " << strerror(errno);
+                return ScheduleRetry();
             }
-            else
+            SocketOps::ApplyBuffers(fd, _options.socket);
+            if (::connect(fd, (struct sockaddr *)&_addr, _addr_len) == 0)
+                return Established(fd);
+            if (errno == EINPROGRESS)
             {
-                LOG(LogLevel::DEBUG) << "连接断开";
-                _conn.reset();
+                // TCP连接需要等握手完成，socket可写时再检查结果
+                _connecting = std::make_shared<muduo::net::Channel>(_loop, fd);
+                _connecting->setWriteCallback(Weak(&MuduoClient::HandleConnecting));
+                _connecting->setErrorCallback(Weak(&MuduoClient::HandleConnecting));
+                _connecting->enableWriting();
+                return;
             }
+            LOG(LogLevel::WARNING) << "连接服务器失败: " << _name << " " << strerror(errno);
+            ::close(fd);
+            ScheduleRetry();
         }
-        void onMessage(const muduo::net::TcpConnectionPtr &conn, muduo::net::Buffer *buf, muduo::Timestamp)
+        void HandleConnecting()
         {
-            LOG(LogLevel::DEBUG) << "有数据到来";
-            auto base_buf = BufferFactory::Create(buf);
-            while (1)
+            int fd = RemoveConnecting();
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+                err = errno;
+            if (err == 0 && SocketOps::IsSelfConnect(fd))
+                err = ECONNREFUSED;
+            if (err != 0)
+            {
+                LOG(LogLevel::WARNING) << "连接服务器失败: " << _name << " " << strerror(err);
+                ::close(fd);
+                return ScheduleRetry();
+            }
+            Established(fd);
+        }
+        // 连接成功或失败之后不再关注socket，返回它的fd
+        int RemoveConnecting()
+        {
+            int fd = _connecting->fd();
+            _connecting->disableAll();
+            _connecting->remove();
+            // Channel不能在它自己的回调中析构，放到本轮事件处理之后
+            std::shared_ptr<muduo::net::Channel> channel;
+            channel.swap(_connecting);
+            _loop->queueInLoop([channel]() {});
+            return fd;
+        }
+        // 连接建立时不重置退避：接受之后立即断开的服务端(比如准入控制拒绝)不能让客户端无间隔地重连
+        // 收到第一个数据之后才认为连接是健康的，见onMessage
+        void Established(int fd)
+        {
+            bool tcp = (_addr.ss_family == AF_INET);
+            SocketOps::ApplyConnected(fd, tcp, _options.socket);
+            _quickack_fd = (tcp && _options.socket.tcp_quickack) ? fd : -1;
+            _tcp_conn = std::make_shared<muduo::net::TcpConnection>(_loop, _name, fd,
+                                                                    SocketOps::LocalAddr(fd), SocketOps::PeerAddr(fd));
+            std::weak_ptr<MuduoClient> weak = weak_from_this();
+            _tcp_conn->setConnectionCallback([weak](const muduo::net::TcpConnectionPtr &conn)
+                                             {
+                                                 if (auto self = weak.lock())
+                                                     self->onConnection(conn); });
+            _tcp_conn->setMessageCallback([weak](const muduo::net::TcpConnectionPtr &conn, muduo::net::Buffer *buf, muduo::Timestamp)
+                                          {
+                                              if (auto self = weak.lock())
+                                                  self->onMessage(conn, buf);
+                                              else
+                                                  buf->retrieveAll(); });
+            // 客户端已经析构时连接也要照常清理
+            _tcp_conn->setCloseCallback([weak](const muduo::net::TcpConnectionPtr &conn)
+                                        {
+                                            if (auto self = weak.lock())
+                                                self->RemoveConnection(conn);
+                                            else
+                                                DestroyConnection(conn); });
+            _tcp_conn->connectEstablished();
+        }
+        void ScheduleRetry()
+        {
+            LOG(LogLevel::DEBUG) << _retry_delay_ms << "ms后重新连接: " << _name;
+            _retry_timer = _loop->runAfter(_retry_delay_ms / 1000.0, Weak(&MuduoClient::ConnectInLoop));
+            _retry_delay_ms = std::min(_retry_delay_ms * 2, maxRetryDelayMs);
+        }
+        void RemoveConnection(const muduo::net::TcpConnectionPtr &conn)
+        {
+            _tcp_conn.reset();
+            DestroyConnection(conn);
+            if (_started && _options.auto_reconnect)
+            {
+                LOG(LogLevel::INFO) << "连接断开，重新连接: " << _name;
+                ScheduleRetry();
+            }
+        }
+        void Stop()
+        {
+            _started = false;
+            _loop->cancel(_retry_timer);
+            _loop->cancel(_heartbeat_timer);
+            if (_connecting)
+                ::close(RemoveConnecting());
+        }
+        // 和TcpServer一样，连接的最后清理放到本轮事件处理之后
+        static void DestroyConnection(const muduo::net::TcpConnectionPtr &conn)
+        {
+            conn->getLoop()->queueInLoop(std::bind(&muduo::net::TcpConnection::connectDestroyed, conn));
+        }
+        // 等待onConnection建立连接，超过connect_timeout_ms返回false
+        bool WaitConnected()
+        {
+            std::unique_lock<std::mutex> lock(_conn_mutex);
+            auto ready = [this]()
+            { return _conn.get() != nullptr; };
+            if (_options.connect_timeout_ms <= 0)
+                _conn_cond.wait(lock, ready);
+            else if (_conn_cond.wait_for(lock, std::chrono::milliseconds(_options.connect_timeout_ms), ready) == false)
             {
-                if (_protocol->IsProcessable(base_buf) == false)
+                LOG(LogLevel::ERROR) << "连接服务器超时: " << _options.connect_timeout_ms << "ms";
+                return false;
+            }
+            LOG(LogLevel::DEBUG) << "连接服务器成功";
+            return true;
+        }
+        void onConnection(const muduo::net::TcpConnectionPtr &conn)
+        {
+            if (conn->connected())
+            {
+                LOG(LogLevel::DEBUG) << "连接建立";
+                // 每个连接一个新的协议对象，旧连接上没有重组完的分片随之丢弃
+                MuduoConnection::ptr base_conn = ConnectionFactory::Create(conn, ProtocolFactory::Create(LVProtocol::defaultMaxMessageSize, _options.compress));
+                base_conn->EnableQuickAck(_quickack_fd);
+                // 协商提议附在第一条业务请求上，确认到达之前的请求仍然是JSON
+                // 只用JSON也要提出，对端的确认表明它能应答心跳
+                base_conn->Protocol()->Offer(_options.codec);
                 {
-                    if (base_buf->ReadableSize() > maxDataSize)
-                    {
-                        LOG(LogLevel::ERROR) << "数据包太大";
-                        conn->shutdown();
-                        return;
-                    }
-                   
-                    LOG(LogLevel::DEBUG) << "数据包不完整";
-                    break;
+                    std::lock_guard<std::mutex> lock(_conn_mutex);
+                    _conn = base_conn;
                 }
-                BaseMessage::ptr msg;
-                bool ret = _protocol->OnMessage(base_buf, msg);
-                if (ret == false)
+                _conn_cond.notify_all(); // 唤醒阻塞在Connect中的线程
+                if (_on_connection)
+                    _on_connection(base_conn);
+                _last_probe_us = 0;
+                if (_options.heartbeat_interval_ms > 0)
+                    _heartbeat_timer = _loop->runEvery(_options.heartbeat_interval_ms / 1000.0,
+                                                       Weak(&MuduoClient::OnHeartbeatTimer));
+            }
+            else
+            {
+                LOG(LogLevel::DEBUG) << "连接断开" << (_options.auto_reconnect ? "，等待自动重连" : "");
+                _loop->cancel(_heartbeat_timer);
+                MuduoConnection::ptr base_conn;
                 {
-                    LOG(LogLevel::ERROR) << "数据包解析失败";
-                    conn->shutdown();
-                    return;
+                    std::lock_guard<std::mutex> lock(_conn_mutex);
+                    base_conn.swap(_conn);
                 }
-                if (_on_message)
-                    _on_message(_conn, msg);
+                if (_on_close && base_conn)
+                    _on_close(base_conn);
             }
         }
+        void onMessage(const muduo::net::TcpConnectionPtr &, muduo::net::Buffer *buf)
+        {
+            // _conn只会在本IO线程的onConnection中被修改，这里直接读取
+            MuduoConnection::ptr muduo_conn = _conn;
+            if (muduo_conn.get() == nullptr)
+                return;
+            _retry_delay_ms = initRetryDelayMs;
+            muduo_conn->OnMessage(buf, _on_message);
+        }
+        // 每隔heartbeat_interval_ms检查一次，所以两次发送之间最长的空闲接近两个间隔
+        // 新连接的第一次检查总会发送，尽早测到往返时间
+        void OnHeartbeatTimer()
+        {
+            MuduoConnection::ptr conn = _conn;
+            if (conn.get() == nullptr || _tcp_conn.get() == nullptr)
+                return;
+            // 老版本的服务端不认识心跳消息，收到会断开连接：对端确认过协商提议之后才发心跳、检测超时
+            if (conn->PeerHeartbeat() == false)
+                return;
+            int64_t now = Clock::NowUs();
+            if (_options.heartbeat_timeout_ms > 0 && now - conn->LastRecvUs() > _options.heartbeat_timeout_ms * 1000LL)
+            {
+                LOG(LogLevel::WARNING) << _options.heartbeat_timeout_ms << "ms没有收到任何数据，断开连接: " << _name;
+                _tcp_conn->forceClose();
+                return;
+            }
+            // 一直有数据发送的连接也隔几个间隔发一次，保持往返时间是新的
+            int64_t interval_us = _options.heartbeat_interval_ms * 1000LL;
+            if (now - conn->LastSendUs() >= interval_us || now - _last_probe_us >= rttProbeIntervals * interval_us)
+            {
+                _last_probe_us = now;
+                Heartbeat::Send(conn);
+            }
+        }
+        // 连接回调换成空操作，客户端析构之后连接上的事件不会再回调到this
+        static void DetachCallbacks(const muduo::net::TcpConnectionPtr &conn)
+        {
+            conn->setConnectionCallback([](const muduo::net::TcpConnectionPtr &) {});
+            conn->setMessageCallback([](const muduo::net::TcpConnectionPtr &, muduo::net::Buffer *buf, muduo::Timestamp)
+                                     { buf->retrieveAll(); });
+        }
 
     private:
+        ClientOptions _options;
+        std::string _name;
+        muduo::net::EventLoop *_loop; // 从ClientLoopPool中分配，不归客户端所有
+        struct sockaddr_storage _addr;
+        socklen_t _addr_len;
         std::mutex _conn_mutex;
-        std::size_t maxDataSize = (1 << 16);
-        BaseProtocol::ptr _protocol;
-
-        BaseConnection::ptr _conn;
-        muduo::CountDownLatch _downlatch;
-        muduo::net::EventLoopThread _loopthread;
-        muduo::net::EventLoop *_baseloop;
-        muduo::net::TcpClient _client;
+        std::condition_variable _conn_cond;
+        MuduoConnection::ptr _conn;
+        // 以下成员只在_loop中访问
+        bool _started;
+        int _retry_delay_ms;
+        muduo::net::TimerId _retry_timer;
+        muduo::net::TimerId _heartbeat_timer;
+        int64_t _last_probe_us;
+        std::shared_ptr<muduo::net::Channel> _connecting; // 正在进行中的非阻塞connect
+        muduo::net::TcpConnectionPtr _tcp_conn;
+        int _quickack_fd; // 需要在每次读完数据后重新开启quickack的socket，-1表示不需要
     };
 
     class ClientFactory
     {
     public:
-        template <typename... Args>
-        static BaseClient::ptr Create(Args &&...args)
+        // ip写成"unix:/path/to/socket"时走unix域套接字，写成"shm:/path/to/socket"时走共享内存，端口被忽略
+        static BaseClient::ptr Create(const std::string &ip, int port, const ClientOptions &options = ClientOptions())
         {
-            return std::make_shared<MuduoClient>(std::forward<Args>(args)...);
+            if (ShmClient::IsShm(ip))
+                return std::make_shared<ShmClient>(ip.substr(strlen(ShmClient::scheme)), options);
+            if (options.backend == NetBackend::BACKEND_IO_URING)
+            {
+#ifdef RPC_HAVE_IO_URING
+                if (UringLoop::Supported())
+                    return std::make_shared<UringClient>(ip, port, options);
+#endif
+                LOG(LogLevel::WARNING) << "当前环境不支持io_uring，使用muduo后端";
+            }
+            return std::make_shared<MuduoClient>(ip, port, options);
         }
     };
 }
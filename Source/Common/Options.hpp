@@ -0,0 +1,96 @@
+#pragma once
+// 服务端和客户端的可调参数
+
+#include "Socket.hpp"
+#include "Protocol.hpp"
+#include "Admission.hpp"
+
+namespace Rpc
+{
+    // 服务端的可调参数，通过ServerFactory::Create(port, options)传入
+    struct ServerOptions
+    {
+        // IO线程(从reactor)的数量，0表示所有连接的读写、解析都在_baseloop上完成
+        // 大于0时_baseloop只负责accept，新连接按轮询分配到各个IO线程
+        int io_threads = 0;
+        // 业务线程数量(仅RpcServer使用)，0表示服务回调直接在IO线程上执行
+        int worker_threads = 0;
+        // 业务线程池的最大排队请求数，超过后新请求直接以RCODE_OVERLOADED拒绝
+        size_t worker_queue_size = 10000;
+        // 写合并：同一轮事件循环中产生的响应合并成一次write，适合小报文、流水线请求多的场景
+        bool cork_writes = false;
+        // 超过单帧上限(64K)的消息会被分片传输，这是接收端重组后单条消息的上限
+        size_t max_message_size = LVProtocol::defaultMaxMessageSize;
+        // 单个连接发送积压的高水位，0表示不限制；慢订阅者、不读数据的客户端会让积压无限增长
+        size_t high_water_mark = (64 << 20);
+        // 积压超过高水位后的处理策略
+        OverloadPolicy overload_policy = OverloadPolicy::OVERLOAD_REJECT;
+        // 非空时除了TCP端口之外再监听这个unix域套接字，同一台机器上的调用方可以绕过TCP协议栈
+        std::string unix_path;
+        // 非空时在这个unix域套接字上接受共享内存传输的客户端(只用来交换共享内存段，数据走共享内存)
+        std::string shm_path;
+        // 共享内存传输的接收线程睡眠之前先忙等的微秒数，0表示不忙等；忙等能把往返延迟压到几微秒，代价是占满CPU
+        int shm_busy_poll_us = 0;
+        // 网络传输的实现，BACKEND_IO_URING在不支持的内核上退回muduo
+        NetBackend backend = NetBackend::BACKEND_MUDUO;
+        // io_uring后端每个循环(io_threads个加上主循环)常驻的接收缓冲区：块数(向上取整到2的幂)和每块的字节数
+        // 默认每个循环1MB；连接多、吞吐高时调大块数，块数不够只会多几次recv提交
+        unsigned uring_recv_buffers = 64;
+        unsigned uring_recv_buffer_size = 16 * 1024;
+        // 监听socket和每个连接上的socket参数
+        SocketOptions socket;
+        // 连接上超过这么久没有收到任何数据就主动关闭，0表示不检测
+        // 半开连接(对端断电、断网)上TCP迟迟不报错，会一直占着Provider、Subscriber和缓冲区；
+        // 开启后客户端需要在空闲时自己发送数据保活
+        int idle_timeout_ms = 0;
+        // 大于1时创建这么多组互相独立的服务端，每组有自己的SO_REUSEPORT监听socket、accept循环、io_threads个IO线程和连接表，
+        // 由内核把新连接分散到各组，没有共享的accept队列；注册中心触发大批客户端同时重连时单个accept循环不再是瓶颈
+        // unix_path和shm_path只在第一组上监听
+        int acceptor_groups = 1;
+        // 以下三项是连接准入控制，0表示不限制；超过上限的新连接在accept之后立即以RST关闭，不分配连接对象
+        // 连接总数上限(TCP和unix域套接字合计)
+        size_t max_connections = 0;
+        // 同一个对端IP的TCP连接数上限
+        size_t max_connections_per_ip = 0;
+        // 每秒最多接受的新连接数，允许一秒的突发；注册中心重启后的重连风暴被摊到更长的时间里
+        int accept_rate = 0;
+        // acceptor_groups大于1时由ReusePortServer创建、各组共用同一份计数，使用者不需要设置
+        AdmissionControl::ptr admission;
+        // 接受的消息体压缩算法，客户端在连接上提出相同的算法时启用；COMPRESS_NONE表示拒绝压缩
+        // threshold和dictionary同样作用于这一端发出的消息，共享内存传输不压缩
+        CompressOptions compress{Compression::COMPRESS_LZ4};
+    };
+
+    // 客户端的可调参数，通过ClientFactory::Create(ip, port, options)传入
+    struct ClientOptions
+    {
+        // Connect最多阻塞的时间，小于等于0表示一直等到连接成功
+        int connect_timeout_ms = 3000;
+        // 连接失败或断开后在后台自动重连，重连间隔按指数退避(0.5s起，翻倍到最长30s)，连接上收到数据之后才回到0.5s
+        bool auto_reconnect = true;
+        // 共享内存传输每个方向上环的字节数
+        uint32_t shm_ring_size = (1 << 20);
+        // 共享内存传输的接收线程睡眠之前先忙等的微秒数
+        int shm_busy_poll_us = 0;
+        // 网络传输的实现，BACKEND_IO_URING在不支持的内核上退回muduo；共享内存传输不受影响
+        NetBackend backend = NetBackend::BACKEND_MUDUO;
+        // io_uring后端的接收缓冲区，含义同ServerOptions；这两项相同的UringClient共享一个循环
+        unsigned uring_recv_buffers = 64;
+        unsigned uring_recv_buffer_size = 16 * 1024;
+        // 每个连接上的socket参数
+        SocketOptions socket;
+        // 连接上超过这么久没有发送任何数据时发一个协议层心跳，顺带测量往返时间；小于等于0表示不发送
+        // 只有muduo后端的TCP/unix连接会主动发送，其他传输只应答对端的心跳
+        // 服务端确认了第一条请求上的协商提议之后才开始发送：老版本的服务端收到心跳会断开连接，不会确认
+        int heartbeat_interval_ms = 10000;
+        // 超过这么久没有收到任何数据(包括心跳响应)就认为对端已经失效，主动断开，开启了自动重连时随后重连
+        // 小于等于0表示不检测，和心跳一样在服务端确认之后才生效
+        int heartbeat_timeout_ms = 30000;
+        // 想使用的消息体编码。不是JSON时作为可选字段附在连接上的第一条请求中向服务端提出，服务端用心跳响应确认之后才切换，
+        // 确认之前以及对端是老版本(忽略这个字段，不会确认)时照常使用JSON
+        Codec codec = Codec::CODEC_JSON;
+        // 想使用的消息体压缩，和codec一样随第一条请求协商，服务端接受之后两个方向上超过阈值的消息体都会压缩
+        // 适合跨机房、大结果和主题推送较多的连接；共享内存传输不压缩
+        CompressOptions compress;
+    };
+}
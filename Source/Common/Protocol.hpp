@@ -0,0 +1,648 @@
+#pragma once
+// 缓冲区适配、LV帧协议、协议层心跳和帧读取，各个传输共用
+
+#include <muduo/net/Buffer.h>
+#include "Detail.hpp"
+#include "Fields.hpp"
+#include "Abstract.hpp"
+#include "Message.hpp"
+#include "BufferPool.hpp"
+#include "Compress.hpp"
+#include <streambuf>
+#include <cstring>
+#include <atomic>
+#include <arpa/inet.h>
+
+namespace Rpc
+{
+    class MuduoBuffer : public BaseBuffer
+    {
+    public:
+        using ptr = std::shared_ptr<MuduoBuffer>;
+        MuduoBuffer(muduo::net::Buffer *buf) : _buf(buf) {}
+        virtual size_t ReadableSize() override
+        {
+            return _buf->readableBytes();
+        }
+        virtual int32_t PeekInt32() override
+        {
+            // muduo库是网络库，从缓冲区取出4字节整形，会进行网络字节序的转换，变成host字节序
+            return _buf->peekInt32();
+        }
+        virtual void RetrieveInt32() override
+        {
+            _buf->retrieveInt32();
+        }
+        virtual int32_t ReadInt32() override
+        {
+            return _buf->readInt32();
+        }
+        virtual std::string RetrieveAsString(size_t len) override
+        {
+            return _buf->retrieveAsString(len);
+        }
+        virtual const char *Peek() override
+        {
+            return _buf->peek();
+        }
+        virtual void Retrieve(size_t len) override
+        {
+            _buf->retrieve(len);
+        }
+        virtual void Append(const void *data, size_t len) override
+        {
+            _buf->append(data, len);
+        }
+        virtual void PrependInt32(int32_t val) override
+        {
+            // muduo的缓冲区在可读区域之前始终保留kCheapPrepend(8)字节
+            _buf->prependInt32(val);
+        }
+        virtual char *BeginWrite() override
+        {
+            return _buf->beginWrite();
+        }
+        virtual size_t WritableSize() override
+        {
+            return _buf->writableBytes();
+        }
+        virtual void EnsureWritable(size_t len) override
+        {
+            _buf->ensureWritableBytes(len);
+        }
+        virtual void HasWritten(size_t len) override
+        {
+            _buf->hasWritten(len);
+        }
+
+    private:
+        // 这个指针的资源管理并不是由muduobuffer来进行的，muduobuffer目的是实现功能向外提供接口，并不负责资源的释放
+        muduo::net::Buffer *_buf;
+    };
+    class BufferFactory
+    {
+    public:
+        template <typename... Args>
+        static BaseBuffer::ptr Create(Args &&...args)
+        {
+            return std::make_shared<MuduoBuffer>(std::forward<Args>(args)...);
+        }
+        // onMessage每次回调都会用到缓冲区，为了不在堆上反复创建MuduoBuffer，调用者把它放在栈上，
+        // 这里返回一个不持有所有权的智能指针(aliasing构造，不分配控制块)，只能在该对象的生命周期内使用
+        static BaseBuffer::ptr Borrow(BaseBuffer &buf)
+        {
+            return BaseBuffer::ptr(BaseBuffer::ptr(), &buf);
+        }
+    };
+
+    // 把BaseBuffer的可写区域包装成streambuf，序列化器通过std::ostream直接写进缓冲区，不经过中间字符串
+    class BufferStreamBuf : public std::streambuf
+    {
+    public:
+        BufferStreamBuf(const BaseBuffer::ptr &buf) : _buf(buf)
+        {
+            Reset();
+        }
+        ~BufferStreamBuf()
+        {
+            Commit();
+        }
+
+    protected:
+        virtual int overflow(int ch) override
+        {
+            Commit();
+            _buf->EnsureWritable(growSize);
+            Reset();
+            if (ch != traits_type::eof())
+            {
+                *pptr() = (char)ch;
+                pbump(1);
+            }
+            return traits_type::not_eof(ch);
+        }
+        virtual std::streamsize xsputn(const char *s, std::streamsize n) override
+        {
+            if (epptr() - pptr() < n)
+            {
+                Commit();
+                _buf->EnsureWritable(std::max<size_t>(n, growSize));
+                Reset();
+            }
+            ::memcpy(pptr(), s, n);
+            pbump((int)n);
+            return n;
+        }
+        virtual int sync() override
+        {
+            Commit();
+            return 0;
+        }
+
+    private:
+        // 把已经写入的数据提交给缓冲区
+        void Commit()
+        {
+            if (pptr() > pbase())
+            {
+                _buf->HasWritten(pptr() - pbase());
+                setp(pptr(), epptr());
+            }
+        }
+        void Reset()
+        {
+            setp(_buf->BeginWrite(), _buf->BeginWrite() + _buf->WritableSize());
+        }
+
+    private:
+        static constexpr size_t growSize = 4096;
+        BaseBuffer::ptr _buf;
+    };
+
+    // 每个连接各自持有一个LVProtocol对象：分片重组的状态是按连接保存的
+    class LVProtocol : public BaseProtocol
+    {
+    public:
+        using ptr = std::shared_ptr<LVProtocol>;
+
+        // 单个报文(包括长度字段)的上限，接收端缓冲区中不完整的数据超过它就会断开连接
+        static constexpr size_t maxFrameSize = (1 << 16);
+        // 分片重组后单条消息的默认上限
+        static constexpr size_t defaultMaxMessageSize = (16 << 20);
+
+        // compress是这一端的压缩配置，协商之后才会真正压缩
+        LVProtocol(size_t max_message_size = defaultMaxMessageSize, const CompressOptions &compress = CompressOptions())
+            : _max_message_size(max_message_size), _codec(Codec::CODEC_JSON), _compress_options(compress),
+              _dict_id(CompressOptions::DictionaryId(compress.dictionary)),
+              _compression(Compression::COMPRESS_NONE), _compress_dict(false), _stream_bytes(0),
+              _offer_codec(Codec::CODEC_JSON), _offer_pending(false) {}
+
+        // 可能在任意发送线程中读取，用原子变量保存
+        virtual void SetCodec(Codec codec) override { _codec = codec; }
+        virtual Codec GetCodec() override { return _codec; }
+
+        virtual Compression CompressOffer(uint32_t &dict_id) override
+        {
+            dict_id = _dict_id;
+            return _compress_options.compression;
+        }
+        // 只接受和本端配置相同的算法，字典的校验和不一致时不用字典
+        virtual Compression AcceptCompress(Compression offer, uint32_t &dict_id) override
+        {
+            if (offer == Compression::COMPRESS_NONE || offer != _compress_options.compression)
+            {
+                dict_id = 0;
+                return Compression::COMPRESS_NONE;
+            }
+            if (dict_id != _dict_id)
+                dict_id = 0;
+            EnableCompress(offer, dict_id);
+            return offer;
+        }
+        virtual void EnableCompress(Compression compression, uint32_t dict_id) override
+        {
+            _compress_dict = (dict_id != 0 && dict_id == _dict_id);
+            _compression = compression;
+        }
+        virtual Compression GetCompress() override { return _compression; }
+        virtual void Offer(Codec codec) override
+        {
+            _offer_codec = codec;
+            _offer_pending = true;
+        }
+
+        // 判断缓冲区的数据是否够一条消息
+        virtual bool IsProcessable(const BaseBuffer::ptr &buffer) override
+        {
+            if (buffer->ReadableSize() < lenFieldLength)
+            {
+                return false;
+            }
+            int32_t total_len = buffer->PeekInt32();
+            if (buffer->ReadableSize() < total_len + lenFieldLength)
+            {
+                return false;
+            }
+            return true;
+        }
+        // 返回true但msg为空，表示收到的是分片，消息还没有重组完成
+        virtual bool OnMessage(const BaseBuffer::ptr &buffer, BaseMessage::ptr &msg) override
+        {
+            // 调用OnMessage默认是至少有一个完整的数据报文才会被处理，所以这里不需要判断数据是否够一条消息
+            // 直接在缓冲区的可读区域上解析，id和body都只是视图，消息构建完成后再把整个报文retrieve掉
+            // |--Len--|--flags|mtype--|--idlen--|--id--|--body--|
+            const char *data = buffer->Peek();
+            int32_t total_len = PeekInt32(data);                                 // 总长度
+            if (total_len < (int32_t)(mtypeFieldLength + idlenFieldLength))
+            {
+                LOG(LogLevel::ERROR) << "invalid frame length: " << total_len;
+                return false;
+            }
+            uint32_t type_field = PeekInt32(data + lenFieldLength);              // 标志位和数据类型
+            int32_t idlen = PeekInt32(data + lenFieldLength + mtypeFieldLength); // id长度
+            int32_t body_len = total_len - idlen - mtypeFieldLength - idlenFieldLength;
+            bool ret = Decode(data + lenFieldLength + mtypeFieldLength + idlenFieldLength,
+                              type_field, idlen, body_len, msg);
+            buffer->Retrieve(lenFieldLength + total_len);
+            return ret;
+        }
+        virtual std::string Serialize(const BaseMessage::ptr &msg) override
+        {
+            muduo::net::Buffer frame;
+            MuduoBuffer buf(&frame);
+            if (Serialize(msg, BufferFactory::Borrow(buf)) == false)
+                return std::string();
+            return frame.retrieveAllAsString();
+        }
+
+        virtual bool Serialize(const BaseMessage::ptr &msg, const BaseBuffer::ptr &buffer) override
+        {
+            // |--Len--|--flags|mtype--|--idlen--|--id--|--body--|
+            // 头部和id先写入，body通过流直接序列化在其后，总长度最后写进缓冲区预留的头部空间
+            // 整个报文只在这个缓冲区中写一次，不再拼接中间字符串
+            std::string id = msg->GetId();
+            uint32_t type_field = (uint32_t)msg->GetType();
+            // 第一条请求带上协商提议，多个线程同时发送时只有一个线程取到
+            bool offer = _offer_pending.load(std::memory_order_relaxed) && IsRequest(msg->GetType()) &&
+                         _offer_pending.exchange(false);
+            // 协商出二进制编码之后，消息体先编码进线程局部的暂存区，再整体拷进缓冲区
+            static thread_local std::string binary_body;
+            binary_body.clear();
+            if (offer == false && _codec == Codec::CODEC_BINARY && msg->SerializeBinary(binary_body))
+                type_field |= binaryFlag;
+            int32_t mtype = htonl(type_field);
+            int32_t idlen = htonl(id.size());
+            buffer->Append(&mtype, mtypeFieldLength);
+            buffer->Append(&idlen, idlenFieldLength);
+            buffer->Append(id.data(), id.size());
+            if (type_field & binaryFlag)
+            {
+                buffer->Append(binary_body.data(), binary_body.size());
+                if (binary_body.capacity() > maxFrameSize)
+                    std::string().swap(binary_body);
+            }
+            else
+            {
+                BufferStreamBuf streambuf(buffer);
+                std::ostream out(&streambuf);
+                if ((offer ? SerializeWithOffer(msg, out) : msg->SerializeTo(out)) == false)
+                {
+                    LOG(LogLevel::ERROR) << "serialize message body failed";
+                    return false;
+                }
+            }
+            size_t header_len = mtypeFieldLength + idlenFieldLength + id.size();
+            // 先压缩再分片，压缩后能放进一帧的消息不再分片
+            if (_compression == Compression::COMPRESS_LZ4 &&
+                buffer->ReadableSize() - header_len >= _compress_options.threshold)
+                Compress(type_field, id, header_len, buffer);
+            if (lenFieldLength + buffer->ReadableSize() > maxFrameSize)
+                return Fragment(type_field, id, header_len, buffer);
+            buffer->PrependInt32(buffer->ReadableSize());
+            return true;
+        }
+
+    private:
+        static bool IsRequest(MType mtype)
+        {
+            return mtype == MType::REQ_RPC || mtype == MType::REQ_TOPIC || mtype == MType::REQ_SERVICE;
+        }
+        // 提议的内容和心跳请求相同：时间戳用来在确认到达时测一次往返时间；不是JSON消息时留给下一条请求
+        bool SerializeWithOffer(const BaseMessage::ptr &msg, std::ostream &out)
+        {
+            auto json = dynamic_cast<JsonMessage *>(msg.get());
+            if (json == nullptr)
+            {
+                _offer_pending = true;
+                return msg->SerializeTo(out);
+            }
+            auto offer = MessageFactory::CreateMessage<HeartbeatMessage>();
+            offer->SetTimestamp(Clock::NowUs());
+            if (_offer_codec != Codec::CODEC_JSON)
+                offer->SetCodecOffer(_offer_codec);
+            uint32_t dict_id = 0;
+            Compression compression = CompressOffer(dict_id);
+            if (compression != Compression::COMPRESS_NONE)
+                offer->SetCompressOffer(compression, dict_id);
+            return json->SerializeWithOffer(*offer, out);
+        }
+        // 压缩后变小时把缓冲区中的消息体换成压缩结果，并在type_field中加上压缩标志
+        void Compress(uint32_t &type_field, const std::string &id, size_t header_len, const BaseBuffer::ptr &buffer)
+        {
+            static thread_local std::string packed;
+            bool use_dict = _compress_dict;
+            std::string_view dict = use_dict ? std::string_view(*_compress_options.dictionary) : std::string_view();
+            std::string_view body(buffer->Peek() + header_len, buffer->ReadableSize() - header_len);
+            if (Lz4::Compress(body, dict, packed))
+            {
+                type_field |= compressFlag | (use_dict ? dictFlag : 0);
+                int32_t mtype = htonl(type_field);
+                int32_t idlen = htonl(id.size());
+                buffer->Retrieve(buffer->ReadableSize());
+                buffer->Append(&mtype, mtypeFieldLength);
+                buffer->Append(&idlen, idlenFieldLength);
+                buffer->Append(id.data(), id.size());
+                buffer->Append(packed.data(), packed.size());
+            }
+            if (packed.capacity() > maxFrameSize)
+                std::string().swap(packed);
+        }
+        // 解压出的body放在线程局部的暂存区中，只在反序列化之前有效
+        bool Decompress(std::string_view body, bool use_dict, std::string &plain)
+        {
+            if (use_dict && _dict_id == 0)
+            {
+                LOG(LogLevel::ERROR) << "compressed with a dictionary but none is configured";
+                return false;
+            }
+            std::string_view dict = use_dict ? std::string_view(*_compress_options.dictionary) : std::string_view();
+            if (Lz4::Decompress(body, dict, _max_message_size, plain) == false)
+            {
+                LOG(LogLevel::ERROR) << "decompress message body failed";
+                return false;
+            }
+            return true;
+        }
+        // 超过单帧上限的消息拆成多个分片，除最后一片外都带fragmentFlag，接收端按id重组
+        // 不超过上限的消息格式和原来完全一样，老版本的对端依然能正常通信
+        bool Fragment(uint32_t base_type_field, const std::string &id, size_t header_len,
+                      const BaseBuffer::ptr &buffer)
+        {
+            size_t body_len = buffer->ReadableSize() - header_len;
+            if (body_len > _max_message_size)
+            {
+                LOG(LogLevel::ERROR) << "message too large: " << body_len;
+                return false;
+            }
+            if (header_len >= maxFrameSize - lenFieldLength)
+            {
+                LOG(LogLevel::ERROR) << "message id too long: " << id.size();
+                return false;
+            }
+            size_t max_piece = maxFrameSize - lenFieldLength - header_len;
+            size_t pieces = (body_len + max_piece - 1) / max_piece;
+            size_t message_len = buffer->ReadableSize();
+            // 分片直接追加在原消息之后，从原消息的body上切片，最后再把原消息retrieve掉
+            // 先一次预留好全部空间，追加过程中缓冲区不会再搬移，body的指针一直有效
+            buffer->EnsureWritable(body_len + pieces * (lenFieldLength + header_len));
+            const char *body = buffer->Peek() + header_len;
+            for (size_t offset = 0; offset < body_len; offset += max_piece)
+            {
+                size_t piece = std::min(max_piece, body_len - offset);
+                uint32_t type_field = base_type_field;
+                if (offset + piece < body_len)
+                    type_field |= fragmentFlag;
+                int32_t total_len = htonl(header_len + piece);
+                int32_t mtype = htonl(type_field);
+                int32_t idlen = htonl(id.size());
+                buffer->Append(&total_len, lenFieldLength);
+                buffer->Append(&mtype, mtypeFieldLength);
+                buffer->Append(&idlen, idlenFieldLength);
+                buffer->Append(id.data(), id.size());
+                buffer->Append(body + offset, piece);
+            }
+            buffer->Retrieve(message_len);
+            return true;
+        }
+        bool Decode(const char *payload, uint32_t type_field, int32_t idlen, int32_t body_len, BaseMessage::ptr &msg)
+        {
+            if (idlen < 0 || body_len < 0)
+            {
+                LOG(LogLevel::ERROR) << "invalid id length in frame header";
+                return false;
+            }
+            MType mtype = (MType)(type_field & mtypeMask);
+            std::string_view id(payload, idlen);
+            std::string_view body(payload + idlen, body_len);
+            std::string stream;
+            if ((type_field & fragmentFlag) || _streams.empty() == false)
+            {
+                bool done = false;
+                if (Reassemble(id, body, (type_field & fragmentFlag) == 0, done, stream) == false)
+                    return false;
+                if (done == false)
+                {
+                    msg.reset();
+                    return true;
+                }
+                if (stream.empty() == false) // 分片重组出的完整body
+                    body = stream;
+            }
+            static thread_local std::string plain;
+            if (type_field & compressFlag)
+            {
+                if (Decompress(body, (type_field & dictFlag) != 0, plain) == false)
+                    return false;
+                body = plain;
+            }
+            msg = MessageFactory::CreateMessage(mtype);
+            if (msg.get() == nullptr)
+            {
+                LOG(LogLevel::ERROR) << "message type error,creat message failed";
+                return false;
+            }
+            bool ret = (type_field & binaryFlag) ? msg->DeserializeBinary(body) : msg->Deserialize(body);
+            if (plain.capacity() > maxFrameSize)
+                std::string().swap(plain);
+            if (!ret)
+            {
+                LOG(LogLevel::ERROR) << "deserialize message failed";
+                return false;
+            }
+            msg->SetId(std::string(id));
+            msg->SetType(mtype);
+            return true;
+        }
+        // 把分片追加到对应id的重组缓冲区，收到最后一片时取出完整的body
+        // 没有进行中的重组且不是分片时done=true，body保持原样不拷贝
+        bool Reassemble(std::string_view id, std::string_view body, bool last, bool &done, std::string &out)
+        {
+            auto it = _streams.find(std::string(id));
+            if (it == _streams.end())
+            {
+                if (last)
+                {
+                    done = true;
+                    return true;
+                }
+                if (_streams.size() >= maxStreams)
+                {
+                    LOG(LogLevel::ERROR) << "too many fragmented messages in progress";
+                    return false;
+                }
+                it = _streams.emplace(std::string(id), std::string()).first;
+            }
+            // 限制的是所有进行中的重组加起来的字节数，一个对端最多占用一条最大消息的内存
+            if (_stream_bytes + body.size() > _max_message_size)
+            {
+                LOG(LogLevel::ERROR) << "fragmented messages exceed limit: " << _max_message_size;
+                _stream_bytes -= it->second.size();
+                _streams.erase(it);
+                return false;
+            }
+            it->second.append(body.data(), body.size());
+            _stream_bytes += body.size();
+            if (last == false)
+            {
+                done = false;
+                return true;
+            }
+            _stream_bytes -= it->second.size();
+            out.swap(it->second);
+            _streams.erase(it);
+            done = true;
+            return true;
+        }
+        // 从任意(可能未对齐的)地址读取4字节网络字节序整数
+        static int32_t PeekInt32(const char *data)
+        {
+            int32_t be32 = 0;
+            ::memcpy(&be32, data, sizeof(be32));
+            return ntohl(be32);
+        }
+
+    private:
+        const size_t lenFieldLength = 4;
+        const size_t mtypeFieldLength = 4;
+        const size_t idlenFieldLength = 4;
+        // 类型字段低16位是MType，高位是标志位
+        static constexpr uint32_t mtypeMask = 0xFFFF;
+        static constexpr uint32_t fragmentFlag = (1u << 16);
+        // 消息体是Codec::CODEC_BINARY编码；只会发给协商过的对端，老版本不认识这一位
+        static constexpr uint32_t binaryFlag = (1u << 17);
+        // 消息体(分片重组之后)经过压缩；dictFlag表示压缩时用了协商好的字典
+        static constexpr uint32_t compressFlag = (1u << 18);
+        static constexpr uint32_t dictFlag = (1u << 19);
+        // 同一连接上同时进行重组的消息数量上限
+        static constexpr size_t maxStreams = 16;
+
+        size_t _max_message_size;
+        std::atomic<Codec> _codec;
+        const CompressOptions _compress_options;
+        const uint32_t _dict_id;
+        std::atomic<Compression> _compression;
+        std::atomic<bool> _compress_dict;
+        // 正在重组的消息：id -> 已经收到的body
+        std::unordered_map<std::string, std::string> _streams;
+        // _streams中所有body的字节数之和
+        size_t _stream_bytes;
+        // 还没有发出的协商提议，见Offer
+        std::atomic<Codec> _offer_codec;
+        std::atomic<bool> _offer_pending;
+    };
+
+    class ProtocolFactory
+    {
+    public:
+        template <typename... Args>
+        static BaseProtocol::ptr Create(Args &&...args)
+        {
+            return std::make_shared<LVProtocol>(std::forward<Args>(args)...);
+        }
+    };
+
+    // 协议层心跳，收到的心跳消息在FrameReader中就处理掉，不会交给Dispatcher和业务回调
+    class Heartbeat
+    {
+    public:
+        // 发送一个心跳请求，对端的响应到达后更新conn的RttUs
+        static void Send(const BaseConnection::ptr &conn)
+        {
+            auto msg = MessageFactory::CreateMessage<HeartbeatMessage>();
+            msg->SetType(MType::REQ_HEARTBEAT);
+            msg->SetTimestamp(Clock::NowUs());
+            conn->Send(msg);
+        }
+        // msg是心跳消息时处理掉并返回true：请求原样回一个响应，响应用来计算往返时间
+        static bool Handle(const BaseConnection::ptr &conn, const BaseMessage::ptr &msg)
+        {
+            MType mtype = msg->GetType();
+            if (mtype != MType::REQ_HEARTBEAT && mtype != MType::RSP_HEARTBEAT)
+                return false;
+            auto heartbeat = std::dynamic_pointer_cast<HeartbeatMessage>(msg);
+            if (heartbeat.get() == nullptr || heartbeat->Check() == false)
+                return true;
+            Codec codec;
+            Compression compression;
+            uint32_t dict_id = 0;
+            if (mtype == MType::REQ_HEARTBEAT)
+            {
+                // 提出编码的一端一定能解码它，这一端可以立即切换
+                if (heartbeat->GetCodecOffer(codec))
+                {
+                    conn->Protocol()->SetCodec(codec);
+                    heartbeat->SetCodec(codec);
+                }
+                if (heartbeat->GetCompressOffer(compression, dict_id))
+                {
+                    compression = conn->Protocol()->AcceptCompress(compression, dict_id);
+                    heartbeat->SetCompress(compression, dict_id);
+                }
+                heartbeat->SetType(MType::RSP_HEARTBEAT);
+                conn->Send(heartbeat);
+                return true;
+            }
+            conn->SetPeerHeartbeat();
+            if (heartbeat->GetCodec(codec))
+                conn->Protocol()->SetCodec(codec);
+            if (heartbeat->GetCompress(compression, dict_id))
+                conn->Protocol()->EnableCompress(compression, dict_id);
+            int64_t rtt = Clock::NowUs() - heartbeat->GetTimestamp();
+            if (rtt >= 0)
+                conn->AddRttSample(rtt);
+            return true;
+        }
+        // 服务端收到带有协商提议的请求时调用：按心跳请求处理提议，在业务响应之前先回一个心跳响应作为确认
+        // 只有发出提议的新版本客户端会收到这个响应；请求随后照常交给业务回调
+        static void Accept(const BaseConnection::ptr &conn, const BaseMessage::ptr &msg)
+        {
+            auto json = dynamic_cast<JsonMessage *>(msg.get());
+            auto offer = MessageFactory::CreateMessage<HeartbeatMessage>();
+            if (json == nullptr || json->TakeOffer(*offer) == false)
+                return;
+            offer->SetType(MType::REQ_HEARTBEAT);
+            Handle(conn, offer);
+        }
+    };
+
+    // 从接收缓冲区中解析出所有完整的消息交给cb，各种传输共用
+    class FrameReader
+    {
+    public:
+        // 数据不合法时返回false，由调用者关闭连接
+        static bool Process(const BaseConnection::ptr &conn, const BaseBuffer::ptr &buffer, const MessageCallback &cb)
+        {
+            //  1.首先检查缓冲区的数据是否是可处理的
+            //  2.再交给协议进行一个反序列化的处理
+            //  3.根据反序列化的结果，创建消息对象，并交给回调函数处理
+            const BaseProtocol::ptr &protocol = conn->Protocol();
+            while (1)
+            {
+                if (protocol->IsProcessable(buffer) == false)
+                {
+                    if (buffer->ReadableSize() > LVProtocol::maxFrameSize)
+                    {
+                        LOG(LogLevel::ERROR) << "数据包太大";
+                        return false;
+                    }
+                    LOG(LogLevel::DEBUG) << "数据包不完整";
+                    return true;
+                }
+                BaseMessage::ptr msg;
+                bool ret = protocol->OnMessage(buffer, msg);
+                if (ret == false)
+                {
+                    LOG(LogLevel::ERROR) << "数据包解析失败";
+                    return false;
+                }
+                if (msg.get() == nullptr)
+                    continue; // 分片还没有收齐
+                if (Heartbeat::Handle(conn, msg))
+                    continue;
+                Heartbeat::Accept(conn, msg);
+                if (cb)
+                    cb(conn, msg);
+            }
+        }
+    };
+}
@@ -0,0 +1,409 @@
+#pragma once
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "Detail.hpp"
+
+namespace Rpc
+{
+    // 类型化的消息结构体：用RPC_SCHEMA声明一次字段，SchemaCodec据此生成JSON和二进制的编解码与校验
+    // 支持的字段类型：bool、整数、枚举、浮点数、std::string、std::vector以及另一个声明过的结构体
+    template <typename T>
+    struct Schema;
+
+    template <typename T, typename = void>
+    struct IsSchema : std::false_type
+    {
+    };
+    template <typename T>
+    struct IsSchema<T, std::void_t<decltype(Schema<T>::fieldCount)>> : std::true_type
+    {
+    };
+
+#define RPC_SCHEMA_CONCAT_(a, b) a##b
+#define RPC_SCHEMA_CONCAT(a, b) RPC_SCHEMA_CONCAT_(a, b)
+#define RPC_SCHEMA_COUNT_N(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, N, ...) N
+#define RPC_SCHEMA_COUNT(...) RPC_SCHEMA_COUNT_N(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1)
+#define RPC_SCHEMA_EACH_1(m, x) m(x)
+#define RPC_SCHEMA_EACH_2(m, x, ...) m(x) RPC_SCHEMA_EACH_1(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_3(m, x, ...) m(x) RPC_SCHEMA_EACH_2(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_4(m, x, ...) m(x) RPC_SCHEMA_EACH_3(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_5(m, x, ...) m(x) RPC_SCHEMA_EACH_4(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_6(m, x, ...) m(x) RPC_SCHEMA_EACH_5(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_7(m, x, ...) m(x) RPC_SCHEMA_EACH_6(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_8(m, x, ...) m(x) RPC_SCHEMA_EACH_7(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_9(m, x, ...) m(x) RPC_SCHEMA_EACH_8(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_10(m, x, ...) m(x) RPC_SCHEMA_EACH_9(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_11(m, x, ...) m(x) RPC_SCHEMA_EACH_10(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_12(m, x, ...) m(x) RPC_SCHEMA_EACH_11(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_13(m, x, ...) m(x) RPC_SCHEMA_EACH_12(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_14(m, x, ...) m(x) RPC_SCHEMA_EACH_13(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_15(m, x, ...) m(x) RPC_SCHEMA_EACH_14(m, __VA_ARGS__)
+#define RPC_SCHEMA_EACH_16(m, x, ...) m(x) RPC_SCHEMA_EACH_15(m, __VA_ARGS__)
+#define RPC_SCHEMA_FIELD(field) &&visit(#field, obj.field)
+
+// 在全局作用域中使用，Type写完整的名字，字段名就是JSON中的键名，最多16个字段：
+//     struct AddReq { int num1; int num2; };
+//     RPC_SCHEMA(AddReq, num1, num2)
+#define RPC_SCHEMA(Type, ...)                                                                           \
+    namespace Rpc                                                                                       \
+    {                                                                                                   \
+        template <>                                                                                     \
+        struct Schema<Type>                                                                             \
+        {                                                                                               \
+            static constexpr size_t fieldCount = RPC_SCHEMA_COUNT(__VA_ARGS__);                         \
+            template <typename Obj, typename Visitor>                                                   \
+            static bool Visit(Obj &obj, Visitor &&visit)                                                \
+            {                                                                                           \
+                return true RPC_SCHEMA_CONCAT(RPC_SCHEMA_EACH_, RPC_SCHEMA_COUNT(__VA_ARGS__))(         \
+                    RPC_SCHEMA_FIELD, __VA_ARGS__);                                                     \
+            }                                                                                           \
+        };                                                                                              \
+    }
+
+    // 结构体和消息体之间的编解码
+    // JSON：和Json::Value互转，连接使用JSON编码时走这条路，和手写Json::Value的对端完全兼容
+    // 二进制：直接按JsonBinary的格式读写结构体，中间不构造Json::Value，和用Json::Value编码的对端互通
+    // 解码时校验每个字段都存在且类型、取值范围正确，多出来的字段忽略
+    class SchemaCodec
+    {
+    public:
+        template <typename T>
+        static void ToJson(const T &obj, Json::Value &val)
+        {
+            val = Json::Value(Json::objectValue);
+            Schema<T>::Visit(obj, [&val](const char *name, const auto &field)
+                             {
+                                 ToJsonValue(field, val[name]);
+                                 return true; });
+        }
+        template <typename T>
+        static bool FromJson(const Json::Value &val, T &obj)
+        {
+            if (val.isObject() == false)
+            {
+                LOG(LogLevel::ERROR) << "typed message body is not an object";
+                return false;
+            }
+            return Schema<T>::Visit(obj, [&val](const char *name, auto &field)
+                                    {
+                                        const Json::Value *member = val.find(name, name + strlen(name));
+                                        if (member == nullptr)
+                                        {
+                                            LOG(LogLevel::ERROR) << "字段缺失" << name;
+                                            return false;
+                                        }
+                                        if (FromJsonValue(*member, field) == false)
+                                        {
+                                            LOG(LogLevel::ERROR) << "字段类型错误" << name;
+                                            return false;
+                                        }
+                                        return true; });
+        }
+        // 追加到out之后
+        template <typename T>
+        static void Encode(const T &obj, std::string &out)
+        {
+            out.push_back(JsonBinary::TAG_OBJECT);
+            JsonBinary::PutVarint(out, Schema<T>::fieldCount);
+            Schema<T>::Visit(obj, [&out](const char *name, const auto &field)
+                             {
+                                 JsonBinary::PutKey(out, name, strlen(name));
+                                 EncodeValue(field, out);
+                                 return true; });
+        }
+        template <typename T>
+        static bool Decode(std::string_view data, T &obj)
+        {
+            const char *pos = data.data();
+            const char *end = data.data() + data.size();
+            if (DecodeObject(pos, end, obj, 0) == false || pos != end)
+            {
+                LOG(LogLevel::ERROR) << "Failed to decode typed message body";
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        template <typename U>
+        struct IsVector : std::false_type
+        {
+        };
+        template <typename U>
+        struct IsVector<std::vector<U>> : std::true_type
+        {
+        };
+
+        template <typename U>
+        static void ToJsonValue(const U &v, Json::Value &val)
+        {
+            if constexpr (std::is_same_v<U, bool>)
+                val = v;
+            else if constexpr (std::is_enum_v<U>)
+                ToJsonValue((std::underlying_type_t<U>)v, val);
+            else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+                val = (Json::Int64)v;
+            else if constexpr (std::is_integral_v<U>)
+                val = (Json::UInt64)v;
+            else if constexpr (std::is_floating_point_v<U>)
+                val = (double)v;
+            else if constexpr (std::is_same_v<U, std::string>)
+                val = v;
+            else if constexpr (IsVector<U>::value)
+            {
+                val = Json::Value(Json::arrayValue);
+                for (const auto &e : v)
+                    ToJsonValue((const typename U::value_type &)e, val.append(Json::Value()));
+            }
+            else
+            {
+                static_assert(IsSchema<U>::value, "field type is not supported by SchemaCodec");
+                ToJson(v, val);
+            }
+        }
+        template <typename U>
+        static bool FromJsonValue(const Json::Value &val, U &v)
+        {
+            if constexpr (std::is_same_v<U, bool>)
+            {
+                if (val.isBool() == false)
+                    return false;
+                v = val.asBool();
+                return true;
+            }
+            else if constexpr (std::is_enum_v<U>)
+            {
+                std::underlying_type_t<U> n;
+                if (FromJsonValue(val, n) == false)
+                    return false;
+                v = (U)n;
+                return true;
+            }
+            else if constexpr (std::is_integral_v<U>)
+            {
+                if (val.isInt64())
+                    return Narrow((int64_t)val.asInt64(), v);
+                if (val.isUInt64())
+                    return Narrow((uint64_t)val.asUInt64(), v);
+                return false;
+            }
+            else if constexpr (std::is_floating_point_v<U>)
+            {
+                if (val.isNumeric() == false)
+                    return false;
+                v = (U)val.asDouble();
+                return true;
+            }
+            else if constexpr (std::is_same_v<U, std::string>)
+            {
+                if (val.isString() == false)
+                    return false;
+                const char *begin = nullptr, *end = nullptr;
+                val.getString(&begin, &end);
+                v.assign(begin, end);
+                return true;
+            }
+            else if constexpr (IsVector<U>::value)
+            {
+                if (val.isArray() == false)
+                    return false;
+                v.clear();
+                v.reserve(val.size());
+                for (Json::ArrayIndex i = 0; i < val.size(); i++)
+                {
+                    typename U::value_type e{};
+                    if (FromJsonValue(val[i], e) == false)
+                        return false;
+                    v.push_back(std::move(e));
+                }
+                return true;
+            }
+            else
+            {
+                static_assert(IsSchema<U>::value, "field type is not supported by SchemaCodec");
+                return FromJson(val, v);
+            }
+        }
+
+        template <typename U>
+        static void EncodeValue(const U &v, std::string &out)
+        {
+            if constexpr (std::is_same_v<U, bool>)
+                out.push_back(v ? JsonBinary::TAG_TRUE : JsonBinary::TAG_FALSE);
+            else if constexpr (std::is_enum_v<U>)
+                EncodeValue((std::underlying_type_t<U>)v, out);
+            else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+                JsonBinary::PutInt(out, v);
+            else if constexpr (std::is_integral_v<U>)
+            {
+                out.push_back(JsonBinary::TAG_UINT);
+                JsonBinary::PutVarint(out, v);
+            }
+            else if constexpr (std::is_floating_point_v<U>)
+                JsonBinary::PutDouble(out, v);
+            else if constexpr (std::is_same_v<U, std::string>)
+            {
+                out.push_back(JsonBinary::TAG_STRING);
+                JsonBinary::PutString(out, v.data(), v.size());
+            }
+            else if constexpr (IsVector<U>::value)
+            {
+                out.push_back(JsonBinary::TAG_ARRAY);
+                JsonBinary::PutVarint(out, v.size());
+                for (const auto &e : v)
+                    EncodeValue((const typename U::value_type &)e, out);
+            }
+            else
+            {
+                static_assert(IsSchema<U>::value, "field type is not supported by SchemaCodec");
+                Encode(v, out);
+            }
+        }
+        template <typename T>
+        static bool DecodeObject(const char *&pos, const char *end, T &obj, int depth)
+        {
+            static_assert(Schema<T>::fieldCount < 64, "too many fields");
+            if (pos >= end || depth > JsonBinary::maxDepth || *pos != JsonBinary::TAG_OBJECT)
+                return false;
+            pos++;
+            uint64_t n = 0;
+            if (JsonBinary::GetVarint(pos, end, n) == false || n > (uint64_t)(end - pos))
+                return false;
+            // 按键名找到对应的字段，seen记录已经解码的字段，最后要求全部出现
+            uint64_t seen = 0;
+            for (uint64_t i = 0; i < n; i++)
+            {
+                const char *key = nullptr;
+                size_t len = 0;
+                if (JsonBinary::GetKey(pos, end, key, len) == false)
+                    return false;
+                bool matched = false, ok = true;
+                size_t index = 0;
+                Schema<T>::Visit(obj, [&](const char *name, auto &field)
+                                 {
+                                     uint64_t bit = 1ull << index++;
+                                     if (matched || strlen(name) != len || memcmp(name, key, len) != 0)
+                                         return true;
+                                     matched = true;
+                                     seen |= bit;
+                                     ok = DecodeValue(pos, end, field, depth + 1);
+                                     return ok; });
+                if (ok == false)
+                    return false;
+                if (matched == false && JsonBinary::Skip(pos, end, depth + 1) == false)
+                    return false;
+            }
+            if (seen != (1ull << Schema<T>::fieldCount) - 1)
+            {
+                LOG(LogLevel::ERROR) << "字段缺失";
+                return false;
+            }
+            return true;
+        }
+        template <typename U>
+        static bool DecodeValue(const char *&pos, const char *end, U &v, int depth)
+        {
+            if (pos >= end)
+                return false;
+            if constexpr (IsSchema<U>::value)
+                return DecodeObject(pos, end, v, depth);
+            else
+            {
+                char tag = *pos++;
+                uint64_t n = 0;
+                if constexpr (std::is_same_v<U, bool>)
+                {
+                    if (tag != JsonBinary::TAG_TRUE && tag != JsonBinary::TAG_FALSE)
+                        return false;
+                    v = (tag == JsonBinary::TAG_TRUE);
+                    return true;
+                }
+                else if constexpr (std::is_enum_v<U>)
+                {
+                    std::underlying_type_t<U> e;
+                    pos--;
+                    if (DecodeValue(pos, end, e, depth) == false)
+                        return false;
+                    v = (U)e;
+                    return true;
+                }
+                else if constexpr (std::is_integral_v<U>)
+                {
+                    if ((tag != JsonBinary::TAG_INT && tag != JsonBinary::TAG_UINT) || JsonBinary::GetVarint(pos, end, n) == false)
+                        return false;
+                    return tag == JsonBinary::TAG_INT ? Narrow(JsonBinary::ZigZag(n), v) : Narrow(n, v);
+                }
+                else if constexpr (std::is_floating_point_v<U>)
+                {
+                    // 用Json::Value编码的对端，整数值的浮点字段可能编成整数
+                    double d = 0;
+                    if (tag == JsonBinary::TAG_DOUBLE && JsonBinary::GetDouble(pos, end, d))
+                        v = (U)d;
+                    else if (tag == JsonBinary::TAG_INT && JsonBinary::GetVarint(pos, end, n))
+                        v = (U)JsonBinary::ZigZag(n);
+                    else if (tag == JsonBinary::TAG_UINT && JsonBinary::GetVarint(pos, end, n))
+                        v = (U)n;
+                    else
+                        return false;
+                    return true;
+                }
+                else if constexpr (std::is_same_v<U, std::string>)
+                {
+                    const char *str = nullptr;
+                    size_t len = 0;
+                    if (tag != JsonBinary::TAG_STRING || JsonBinary::GetString(pos, end, str, len) == false)
+                        return false;
+                    v.assign(str, len);
+                    return true;
+                }
+                else if constexpr (IsVector<U>::value)
+                {
+                    if (tag != JsonBinary::TAG_ARRAY || JsonBinary::GetVarint(pos, end, n) == false ||
+                        n > (uint64_t)(end - pos) || depth > JsonBinary::maxDepth)
+                        return false;
+                    v.clear();
+                    v.reserve(n);
+                    for (uint64_t i = 0; i < n; i++)
+                    {
+                        typename U::value_type e{};
+                        if (DecodeValue(pos, end, e, depth + 1) == false)
+                            return false;
+                        v.push_back(std::move(e));
+                    }
+                    return true;
+                }
+                else
+                {
+                    static_assert(IsSchema<U>::value, "field type is not supported by SchemaCodec");
+                    return false;
+                }
+            }
+        }
+        // 超出U的取值范围时返回false
+        template <typename U>
+        static bool Narrow(int64_t n, U &v)
+        {
+            if constexpr (std::is_signed_v<U>)
+            {
+                if (n < (int64_t)std::numeric_limits<U>::min() || n > (int64_t)std::numeric_limits<U>::max())
+                    return false;
+            }
+            else
+            {
+                if (n < 0 || (uint64_t)n > (uint64_t)std::numeric_limits<U>::max())
+                    return false;
+            }
+            v = (U)n;
+            return true;
+        }
+        template <typename U>
+        static bool Narrow(uint64_t n, U &v)
+        {
+            if (n > (uint64_t)std::numeric_limits<U>::max())
+                return false;
+            v = (U)n;
+            return true;
+        }
+    };
+}
@@ -0,0 +1,267 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "Log.hpp"
+
+namespace Rpc
+{
+    using namespace LogModule;
+
+    // 放在共享内存中的单生产者单消费者环形缓冲区的控制信息
+    // head/tail是只增不减的字节位置，对容量取模得到下标；两个进程通过原子变量同步，不需要加锁
+    struct ShmRingHeader
+    {
+        alignas(64) std::atomic<uint64_t> head; // 写位置，只由生产者修改
+        alignas(64) std::atomic<uint64_t> tail; // 读位置，只由消费者修改
+        // 消费者等数据、生产者等空间时睡在这两个futex上，waiters不为0时对端才需要唤醒
+        alignas(64) std::atomic<uint32_t> data_seq;
+        std::atomic<uint32_t> data_waiters;
+        alignas(64) std::atomic<uint32_t> space_seq;
+        std::atomic<uint32_t> space_waiters;
+    };
+
+    class ShmRing
+    {
+    public:
+        ShmRing() : _header(nullptr), _data(nullptr), _capacity(0) {}
+        ShmRing(ShmRingHeader *header, char *data, uint64_t capacity)
+            : _header(header), _data(data), _capacity(capacity) {}
+
+        size_t ReadableSize() const
+        {
+            return _header->head.load(std::memory_order_acquire) - _header->tail.load(std::memory_order_relaxed);
+        }
+        size_t WritableSize() const
+        {
+            return _capacity - (_header->head.load(std::memory_order_relaxed) - _header->tail.load(std::memory_order_acquire));
+        }
+        // 生产者调用：尽量写入，返回实际写入的字节数
+        size_t Write(const char *data, size_t len)
+        {
+            uint64_t head = _header->head.load(std::memory_order_relaxed);
+            size_t n = std::min(len, WritableSize());
+            if (n == 0)
+                return 0;
+            size_t pos = head % _capacity;
+            size_t first = std::min(n, (size_t)(_capacity - pos));
+            memcpy(_data + pos, data, first);
+            memcpy(_data, data + first, n - first);
+            _header->head.store(head + n, std::memory_order_release);
+            Wake(_header->data_seq, _header->data_waiters);
+            return n;
+        }
+        // 消费者调用：最多读出len字节，返回实际读出的字节数
+        size_t Read(char *out, size_t len)
+        {
+            uint64_t tail = _header->tail.load(std::memory_order_relaxed);
+            size_t n = std::min(len, ReadableSize());
+            if (n == 0)
+                return 0;
+            size_t pos = tail % _capacity;
+            size_t first = std::min(n, (size_t)(_capacity - pos));
+            memcpy(out, _data + pos, first);
+            memcpy(out + first, _data, n - first);
+            _header->tail.store(tail + n, std::memory_order_release);
+            Wake(_header->space_seq, _header->space_waiters);
+            return n;
+        }
+        // 先忙等busy_poll_us微秒，再睡在futex上最多timeout_ms毫秒，有数据可读返回true
+        bool WaitReadable(int busy_poll_us, int timeout_ms)
+        {
+            return WaitFor([this]()
+                           { return ReadableSize() > 0; },
+                           _header->data_seq, _header->data_waiters, busy_poll_us, timeout_ms);
+        }
+        bool WaitWritable(int busy_poll_us, int timeout_ms)
+        {
+            return WaitFor([this]()
+                           { return WritableSize() > 0; },
+                           _header->space_seq, _header->space_waiters, busy_poll_us, timeout_ms);
+        }
+        // 关闭时唤醒所有睡着的一方，让它们重新检查状态
+        void WakeAll()
+        {
+            _header->data_seq.fetch_add(1);
+            Futex(&_header->data_seq, FUTEX_WAKE, INT32_MAX, nullptr);
+            _header->space_seq.fetch_add(1);
+            Futex(&_header->space_seq, FUTEX_WAKE, INT32_MAX, nullptr);
+        }
+
+    private:
+        template <typename Pred>
+        static bool WaitFor(Pred ready, std::atomic<uint32_t> &seq, std::atomic<uint32_t> &waiters,
+                            int busy_poll_us, int timeout_ms)
+        {
+            if (ready())
+                return true;
+            if (busy_poll_us > 0)
+            {
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(busy_poll_us);
+                while (std::chrono::steady_clock::now() < deadline)
+                {
+                    if (ready())
+                        return true;
+                }
+            }
+            // 先登记等待者再检查一次条件，对端在这之后写入一定能看到waiters并唤醒
+            uint32_t cur = seq.load();
+            waiters.fetch_add(1);
+            if (ready() == false)
+            {
+                struct timespec ts;
+                ts.tv_sec = timeout_ms / 1000;
+                ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+                Futex(&seq, FUTEX_WAIT, cur, &ts);
+            }
+            waiters.fetch_sub(1);
+            return ready();
+        }
+        static void Wake(std::atomic<uint32_t> &seq, std::atomic<uint32_t> &waiters)
+        {
+            seq.fetch_add(1);
+            if (waiters.load() > 0)
+                Futex(&seq, FUTEX_WAKE, 1, nullptr);
+        }
+        // 跨进程使用，不能带FUTEX_PRIVATE_FLAG
+        static long Futex(std::atomic<uint32_t> *addr, int op, uint32_t val, const struct timespec *ts)
+        {
+            return syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), op, val, ts, nullptr, 0);
+        }
+
+    private:
+        ShmRingHeader *_header;
+        char *_data;
+        uint64_t _capacity;
+    };
+
+    // 一个共享内存段：段头 + 客户端到服务端的环 + 服务端到客户端的环
+    // 由客户端创建并初始化，服务端按名字映射；双方都映射之后名字就被删除，进程退出后内存自动回收
+    class ShmSegment
+    {
+    public:
+        using ptr = std::shared_ptr<ShmSegment>;
+        static constexpr uint32_t magic = 0x52504353; // "RPCS"
+        static constexpr size_t align = 64;
+
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t ring_size;
+            std::atomic<uint32_t> closed; // 任意一方关闭后置1
+        };
+
+        ~ShmSegment()
+        {
+            if (_base != nullptr)
+                ::munmap(_base, _size);
+        }
+
+        static ShmSegment::ptr Create(const std::string &name, uint32_t ring_size)
+        {
+            int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd < 0)
+            {
+                LOG(LogLevel::ERROR) << "创建共享内存失败: " << name << " " << strerror(errno);
+                return ShmSegment::ptr();
+            }
+            size_t size = TotalSize(ring_size);
+            if (::ftruncate(fd, size) < 0)
+            {
+                LOG(LogLevel::ERROR) << "设置共享内存大小失败: " << strerror(errno);
+                ::close(fd);
+                ::shm_unlink(name.c_str());
+                return ShmSegment::ptr();
+            }
+            auto segment = Map(fd, size);
+            if (segment.get() == nullptr)
+            {
+                ::shm_unlink(name.c_str());
+                return segment;
+            }
+            // ftruncate出来的内存全是0，原子变量的初始值就是0
+            Header *header = segment->GetHeader();
+            header->ring_size = ring_size;
+            header->magic = magic;
+            return segment;
+        }
+        static ShmSegment::ptr Open(const std::string &name)
+        {
+            int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+            if (fd < 0)
+            {
+                LOG(LogLevel::ERROR) << "打开共享内存失败: " << name << " " << strerror(errno);
+                return ShmSegment::ptr();
+            }
+            struct stat st;
+            if (::fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Header))
+            {
+                ::close(fd);
+                return ShmSegment::ptr();
+            }
+            auto segment = Map(fd, st.st_size);
+            if (segment.get() == nullptr)
+                return segment;
+            Header *header = segment->GetHeader();
+            if (header->magic != magic || TotalSize(header->ring_size) != segment->_size)
+            {
+                LOG(LogLevel::ERROR) << "共享内存格式不正确: " << name;
+                return ShmSegment::ptr();
+            }
+            return segment;
+        }
+
+        // is_server决定哪个环用来读、哪个环用来写
+        ShmRing InRing(bool is_server) { return Ring(is_server ? 0 : 1); }
+        ShmRing OutRing(bool is_server) { return Ring(is_server ? 1 : 0); }
+
+        bool Closed() { return GetHeader()->closed.load() != 0; }
+        void Close()
+        {
+            GetHeader()->closed.store(1);
+            Ring(0).WakeAll();
+            Ring(1).WakeAll();
+        }
+
+    private:
+        ShmSegment(void *base, size_t size) : _base(base), _size(size) {}
+
+        static ShmSegment::ptr Map(int fd, size_t size)
+        {
+            void *base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (base == MAP_FAILED)
+            {
+                LOG(LogLevel::ERROR) << "映射共享内存失败: " << strerror(errno);
+                return ShmSegment::ptr();
+            }
+            return ShmSegment::ptr(new ShmSegment(base, size));
+        }
+        static size_t AlignUp(size_t n) { return (n + align - 1) / align * align; }
+        static size_t RingSize(uint32_t ring_size) { return AlignUp(sizeof(ShmRingHeader)) + AlignUp(ring_size); }
+        static size_t TotalSize(uint32_t ring_size) { return AlignUp(sizeof(Header)) + 2 * RingSize(ring_size); }
+
+        Header *GetHeader() { return static_cast<Header *>(_base); }
+        ShmRing Ring(int index)
+        {
+            uint32_t ring_size = GetHeader()->ring_size;
+            char *ring = static_cast<char *>(_base) + AlignUp(sizeof(Header)) + index * RingSize(ring_size);
+            return ShmRing(reinterpret_cast<ShmRingHeader *>(ring), ring + AlignUp(sizeof(ShmRingHeader)), ring_size);
+        }
+
+    private:
+        void *_base;
+        size_t _size;
+    };
+}
@@ -0,0 +1,423 @@
+#pragma once
+// 共享内存传输的连接、服务端和客户端，环本身在Shm.hpp中
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+#include "Shm.hpp"
+#include "Protocol.hpp"
+#include "Socket.hpp"
+#include "Options.hpp"
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <poll.h>
+
+namespace Rpc
+{
+    // 共享内存传输上的连接：发送时把报文写进对端读取的环，接收线程从另一个环中取数据解析
+    class ShmConnection : public BaseConnection, public std::enable_shared_from_this<ShmConnection>
+    {
+    public:
+        using ptr = std::shared_ptr<ShmConnection>;
+        using AliveCheck = std::function<bool()>;
+        // 环上没有数据时每隔这么久醒来一次，检查连接是否还活着
+        static constexpr int waitTimeoutMs = 100;
+
+        ShmConnection(const ShmSegment::ptr &segment, bool is_server, const BaseProtocol::ptr &protocol, int busy_poll_us)
+            : _segment(segment),
+              _in(segment->InRing(is_server)),
+              _out(segment->OutRing(is_server)),
+              _protocol(protocol),
+              _busy_poll_us(busy_poll_us) {}
+        ~ShmConnection()
+        {
+            // 最后一个引用在接收线程中释放时走到这里
+            if (_thread.joinable())
+                _thread.detach();
+        }
+
+        virtual void Send(const BaseMessage::ptr &msg) override
+        {
+            static thread_local muduo::net::Buffer frame;
+            MuduoBuffer buf(&frame);
+            if (_protocol->Serialize(msg, BufferFactory::Borrow(buf)))
+                Write(frame.peek(), frame.readableBytes());
+            frame.retrieveAll();
+        }
+        virtual bool Connected() override
+        {
+            return _segment->Closed() == false;
+        }
+        virtual void Shutdown() override
+        {
+            _segment->Close();
+        }
+        virtual const BaseProtocol::ptr &Protocol() override
+        {
+            return _protocol;
+        }
+        // 环的大小是固定的，写满时发送方等待对端读取，积压不会超过环的容量
+        virtual void SetHighWaterMark(size_t, OverloadPolicy, const HighWaterMarkCallback &) override {}
+        virtual bool Overloaded() override
+        {
+            return false;
+        }
+        virtual size_t BacklogBytes() override
+        {
+            return _out.ReadableSize();
+        }
+        // 环在共享内存中、大小固定，这里只统计接收线程拼帧用的缓冲区
+        virtual size_t BufferBytes() override
+        {
+            return _usage.Get();
+        }
+
+        // 启动接收线程，线程持有连接直到连接关闭；alive返回false也视为关闭，关闭后调用close_cb
+        void Start(const MessageCallback &cb, const CloseCallback &close_cb, const AliveCheck &alive = AliveCheck())
+        {
+            auto self = shared_from_this();
+            _thread = std::thread([self, cb, close_cb, alive]()
+                                  { self->Routine(cb, close_cb, alive); });
+        }
+        // 关闭连接并等待接收线程退出
+        void Stop()
+        {
+            _segment->Close();
+            if (_thread.joinable() && _thread.get_id() != std::this_thread::get_id())
+                _thread.join();
+        }
+
+    private:
+        void Write(const char *data, size_t len)
+        {
+            // 环只允许一个生产者，多个线程发送时在这里串行
+            std::lock_guard<std::mutex> lock(_send_mutex);
+            while (len > 0 && _segment->Closed() == false)
+            {
+                size_t n = _out.Write(data, len);
+                data += n;
+                len -= n;
+                if (len > 0)
+                    _out.WaitWritable(_busy_poll_us, waitTimeoutMs);
+            }
+        }
+        void Routine(const MessageCallback &cb, const CloseCallback &close_cb, const AliveCheck &alive)
+        {
+            muduo::net::Buffer buffer;
+            MuduoBuffer muduo_buf(&buffer);
+            auto base_buf = BufferFactory::Borrow(muduo_buf);
+            BaseConnection::ptr self = shared_from_this();
+            while (_segment->Closed() == false)
+            {
+                if (_in.WaitReadable(_busy_poll_us, waitTimeoutMs) == false)
+                {
+                    if (alive && alive() == false)
+                        break;
+                    continue;
+                }
+                size_t n = _in.ReadableSize();
+                buffer.ensureWritableBytes(n);
+                buffer.hasWritten(_in.Read(buffer.beginWrite(), n));
+                if (FrameReader::Process(self, base_buf, cb) == false)
+                    break;
+                BufferPool::Shrink(&buffer);
+                _usage.Set(buffer.internalCapacity());
+            }
+            _segment->Close();
+            if (close_cb)
+                close_cb(self);
+        }
+
+    private:
+        ShmSegment::ptr _segment;
+        ShmRing _in;
+        ShmRing _out;
+        BaseProtocol::ptr _protocol;
+        int _busy_poll_us;
+        std::mutex _send_mutex;
+        std::thread _thread;
+        BufferUsage _usage;
+    };
+
+    // 共享内存传输的服务端：客户端通过unix域套接字发来它创建的共享内存段的名字，之后的数据都走共享内存中的环
+    // 这条控制连接一直保持，任意一方进程退出时对端都能通过它感知到
+    class ShmServer : public BaseServer
+    {
+    public:
+        using ptr = std::shared_ptr<ShmServer>;
+        // loop为空时自己创建一个并在Start中运行；MuduoServer同时提供共享内存接入时挂在它的baseloop上
+        ShmServer(const std::string &path, const ServerOptions &options = ServerOptions(),
+                  muduo::net::EventLoop *loop = nullptr)
+            : _path(path), _options(options), _loop(loop), _conn_id(0), _stopping(false)
+        {
+            if (_loop == nullptr)
+            {
+                _own_loop.reset(new muduo::net::EventLoop());
+                _loop = _own_loop.get();
+            }
+        }
+        ~ShmServer()
+        {
+            for (auto &it : _controls)
+            {
+                muduo::net::TcpConnectionPtr conn = it.second;
+                _loop->runInLoop(std::bind(&muduo::net::TcpConnection::connectDestroyed, conn));
+            }
+        }
+        virtual void Start() override
+        {
+            Listen();
+            if (_own_loop)
+                _loop->loop();
+        }
+        virtual void StopAccept() override
+        {
+            _loop->runInLoop([this]()
+                             { _acceptor.reset(); });
+        }
+        // 关闭控制连接，客户端随之关闭共享内存段；挂在别人的loop上时不退出loop
+        virtual void Stop(int timeout_ms) override
+        {
+            _loop->runInLoop([this, timeout_ms]()
+                             {
+                                 if (_stopping)
+                                     return;
+                                 _stopping = true;
+                                 _acceptor.reset();
+                                 for (auto &it : _controls)
+                                     it.second->shutdown();
+                                 _loop->runAfter(timeout_ms / 1000.0, std::bind(&ShmServer::ForceStop, this));
+                                 QuitIfDrained(); });
+        }
+        // 需要在loop所属的线程中调用
+        bool Listen()
+        {
+            _acceptor = std::make_shared<SocketAcceptor>(_loop);
+            _acceptor->SetNewConnectionCallback(std::bind(&ShmServer::onNewConnection, this, std::placeholders::_1));
+            if (_acceptor->ListenUnix(_path) == false)
+            {
+                _acceptor.reset();
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        // 以下函数都在_loop中执行，控制连接上的流量很小，全部放在这一个线程上
+        void onNewConnection(int fd)
+        {
+            std::string name = "ShmServer#" + std::to_string(++_conn_id);
+            auto conn = std::make_shared<muduo::net::TcpConnection>(_loop, name, fd,
+                                                                    muduo::net::InetAddress(), muduo::net::InetAddress());
+            _controls[name] = conn;
+            conn->setConnectionCallback(std::bind(&ShmServer::onConnection, this, std::placeholders::_1));
+            conn->setMessageCallback(std::bind(&ShmServer::onMessage, this,
+                                               std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+            conn->setCloseCallback(std::bind(&ShmServer::removeConnection, this, std::placeholders::_1));
+            conn->connectEstablished();
+        }
+        void onConnection(const muduo::net::TcpConnectionPtr &conn)
+        {
+            if (conn->connected())
+                return;
+            const ShmConnection::ptr *ctx = boost::any_cast<ShmConnection::ptr>(&conn->getContext());
+            if (ctx == nullptr)
+                return;
+            ShmConnection::ptr shm_conn = *ctx;
+            conn->setContext(boost::any());
+            // 接收线程看到关闭标志后自行退出
+            shm_conn->Shutdown();
+            if (_on_close)
+                _on_close(shm_conn);
+        }
+        // 控制连接上只有一条消息：共享内存段的名字，以'\n'结尾
+        void onMessage(const muduo::net::TcpConnectionPtr &conn, muduo::net::Buffer *buf, muduo::Timestamp)
+        {
+            if (conn->getContext().empty() == false)
+            {
+                buf->retrieveAll();
+                return;
+            }
+            const char *eol = buf->findEOL();
+            if (eol == nullptr)
+            {
+                if (buf->readableBytes() > NAME_MAX)
+                    conn->shutdown();
+                return;
+            }
+            std::string name(buf->peek(), eol);
+            buf->retrieveUntil(eol + 1);
+            auto segment = ShmSegment::Open(name);
+            if (segment.get() == nullptr)
+            {
+                conn->shutdown();
+                return;
+            }
+            auto shm_conn = std::make_shared<ShmConnection>(segment, true, ProtocolFactory::Create(_options.max_message_size),
+                                                            _options.shm_busy_poll_us);
+            conn->setContext(shm_conn);
+            conn->send("1", 1); // 告诉客户端已经映射好了，它可以删除共享内存的名字
+            if (_on_connection)
+                _on_connection(shm_conn);
+            shm_conn->Start(_on_message, CloseCallback());
+        }
+        void removeConnection(const muduo::net::TcpConnectionPtr &conn)
+        {
+            _controls.erase(conn->name());
+            _loop->queueInLoop(std::bind(&muduo::net::TcpConnection::connectDestroyed, conn));
+            QuitIfDrained();
+        }
+        void ForceStop()
+        {
+            if (_controls.empty() == false)
+                LOG(LogLevel::WARNING) << "停止超时，强制关闭" << _controls.size() << "个共享内存连接";
+            for (auto &it : _controls)
+                it.second->forceClose();
+            if (_own_loop)
+                _loop->quit();
+        }
+        void QuitIfDrained()
+        {
+            if (_stopping && _controls.empty() && _own_loop)
+                _loop->quit();
+        }
+
+    private:
+        std::string _path;
+        ServerOptions _options;
+        std::unique_ptr<muduo::net::EventLoop> _own_loop;
+        muduo::net::EventLoop *_loop;
+        SocketAcceptor::ptr _acceptor;
+        size_t _conn_id;
+        bool _stopping;
+        std::unordered_map<std::string, muduo::net::TcpConnectionPtr> _controls;
+    };
+
+    // 共享内存传输的客户端，地址写作"shm:/path/to/socket"(服务端的ServerOptions::shm_path)
+    // 不支持自动重连，连接断开后需要重新调用Connect
+    class ShmClient : public BaseClient
+    {
+    public:
+        using ptr = std::shared_ptr<ShmClient>;
+        static constexpr const char *scheme = "shm:";
+        static bool IsShm(const std::string &ip)
+        {
+            return ip.compare(0, strlen(scheme), scheme) == 0;
+        }
+
+        ShmClient(const std::string &path, const ClientOptions &options = ClientOptions())
+            : _path(path), _options(options), _fd(-1) {}
+        ~ShmClient()
+        {
+            Shutdown();
+        }
+
+        virtual bool Connect() override
+        {
+            Shutdown();
+            static std::atomic<uint32_t> seq(0);
+            std::string name = "/rpc-shm-" + std::to_string(getpid()) + "-" + std::to_string(seq++);
+            auto segment = ShmSegment::Create(name, _options.shm_ring_size);
+            if (segment.get() == nullptr)
+                return false;
+            bool ret = Handshake(name);
+            ::shm_unlink(name.c_str()); // 服务端已经映射(或者失败了)，名字不再需要
+            if (ret == false)
+            {
+                CloseFd();
+                return false;
+            }
+            auto conn = std::make_shared<ShmConnection>(segment, false, ProtocolFactory::Create(), _options.shm_busy_poll_us);
+            if (_options.codec != Codec::CODEC_JSON)
+                conn->Protocol()->Offer(_options.codec);
+            {
+                std::lock_guard<std::mutex> lock(_conn_mutex);
+                _conn = conn;
+            }
+            if (_on_connection)
+                _on_connection(conn);
+            // 服务端进程退出时控制连接被关闭，recv返回0
+            int fd = _fd;
+            auto alive = [fd]()
+            {
+                char c;
+                ssize_t n = ::recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+                return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+            };
+            conn->Start(_on_message, _on_close, alive);
+            return true;
+        }
+        virtual void Shutdown() override
+        {
+            ShmConnection::ptr conn;
+            {
+                std::lock_guard<std::mutex> lock(_conn_mutex);
+                conn.swap(_conn);
+            }
+            if (conn)
+                conn->Stop();
+            CloseFd();
+        }
+        virtual bool Send(const BaseMessage::ptr &msg) override
+        {
+            BaseConnection::ptr conn = Connection();
+            if (conn.get() == nullptr || conn->Connected() == false)
+            {
+                LOG(LogLevel::ERROR) << "连接已断开";
+                return false;
+            }
+            conn->Send(msg);
+            return true;
+        }
+        virtual BaseConnection::ptr Connection() override
+        {
+            std::lock_guard<std::mutex> lock(_conn_mutex);
+            return _conn;
+        }
+        virtual bool Connected() override
+        {
+            BaseConnection::ptr conn = Connection();
+            return (conn && conn->Connected());
+        }
+
+    private:
+        // 把共享内存段的名字发给服务端，等服务端映射完成的确认
+        bool Handshake(const std::string &name)
+        {
+            struct sockaddr_un addr;
+            if (UnixAddress::ToSockAddr(_path, addr) == false)
+                return false;
+            _fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (_fd < 0 || ::connect(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            {
+                LOG(LogLevel::ERROR) << "连接共享内存服务端失败: " << _path << " " << strerror(errno);
+                return false;
+            }
+            std::string line = name + "\n";
+            if (::write(_fd, line.data(), line.size()) != (ssize_t)line.size())
+                return false;
+            struct pollfd pfd = {_fd, POLLIN, 0};
+            int timeout = _options.connect_timeout_ms > 0 ? _options.connect_timeout_ms : -1;
+            char ack = 0;
+            if (::poll(&pfd, 1, timeout) <= 0 || ::read(_fd, &ack, 1) != 1 || ack != '1')
+            {
+                LOG(LogLevel::ERROR) << "共享内存握手失败: " << _path;
+                return false;
+            }
+            return true;
+        }
+        void CloseFd()
+        {
+            if (_fd >= 0)
+                ::close(_fd);
+            _fd = -1;
+        }
+
+    private:
+        std::string _path;
+        ClientOptions _options;
+        int _fd; // 控制连接
+        std::mutex _conn_mutex;
+        ShmConnection::ptr _conn;
+    };
+}
@@ -0,0 +1,571 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <jsoncpp/json/json.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace Rpc
+{
+    // 基于结构索引的JSON解析器，结果直接填进Json::Value，代替jsoncpp逐字符的解析
+    // 第一遍每次处理64字节：用向量比较得到引号、反斜杠、结构字符、空白的位图，
+    // 算出字符串区间之后得到所有结构字符和值起始位置的索引；第二遍按索引构建Json::Value，只在字符串和数字上逐字节处理
+    // 指令集在编译时选择：-mavx2时用AVX2，x86_64默认用SSE2(SSE4.2的机器走这条路径)，其他平台用标量实现
+    // 编译时定义RPC_SIMD_JSON，JSON::Deserialize就改用它；只接受标准JSON，不支持jsoncpp允许的注释
+    class SimdJson
+    {
+    public:
+        // 语法错误、字符串未结束、嵌套过深时返回false，err为原因
+        static bool Parse(std::string_view text, Json::Value &val, std::string &err)
+        {
+            static thread_local std::vector<uint32_t> index;
+            bool ret = false;
+            if (text.size() >= UINT32_MAX)
+                err = "document too large";
+            else if (Index(text, index) == false)
+                err = "unterminated string";
+            else
+                ret = Parser(text, index, err).Parse(val);
+            // 偶尔的大消息过后不一直占着索引的内存
+            if (index.capacity() > maxKeptIndex)
+                std::vector<uint32_t>().swap(index);
+            return ret;
+        }
+        static const char *Backend()
+        {
+#if defined(__AVX2__)
+            return "avx2";
+#elif defined(__SSE2__)
+            return "sse2";
+#else
+            return "scalar";
+#endif
+        }
+
+    private:
+        static constexpr size_t maxKeptIndex = (1 << 20);
+        static constexpr int maxDepth = 1000;
+
+        // 一个64字节块中各类字符的位图，第i位对应第i个字节
+        struct Block
+        {
+            uint64_t quote;
+            uint64_t backslash;
+            uint64_t op; // { } [ ] : ,
+            uint64_t ws; // 空格 \t \n \r
+        };
+
+        static void Classify(const char *p, Block &b)
+        {
+#if defined(__AVX2__)
+            __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+            __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+            auto eq = [](__m256i l, __m256i h, char c) -> uint64_t
+            {
+                __m256i v = _mm256_set1_epi8(c);
+                return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(l, v)) |
+                       ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(h, v)) << 32);
+            };
+            // '['、']'或上0x20就是'{'、'}'
+            __m256i lower = _mm256_set1_epi8(0x20);
+            __m256i lo_l = _mm256_or_si256(lo, lower), hi_l = _mm256_or_si256(hi, lower);
+            b.quote = eq(lo, hi, '"');
+            b.backslash = eq(lo, hi, '\\');
+            b.op = eq(lo_l, hi_l, '{') | eq(lo_l, hi_l, '}') | eq(lo, hi, ':') | eq(lo, hi, ',');
+            b.ws = eq(lo, hi, ' ') | eq(lo, hi, '\t') | eq(lo, hi, '\n') | eq(lo, hi, '\r');
+#elif defined(__SSE2__)
+            __m128i v[4];
+            __m128i v_l[4];
+            __m128i lower = _mm_set1_epi8(0x20);
+            for (int i = 0; i < 4; i++)
+            {
+                v[i] = _mm_loadu_si128((const __m128i *)(p + i * 16));
+                v_l[i] = _mm_or_si128(v[i], lower);
+            }
+            auto eq = [](const __m128i *x, char c) -> uint64_t
+            {
+                __m128i s = _mm_set1_epi8(c);
+                uint64_t mask = 0;
+                for (int i = 0; i < 4; i++)
+                    mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x[i], s)) << (i * 16);
+                return mask;
+            };
+            b.quote = eq(v, '"');
+            b.backslash = eq(v, '\\');
+            b.op = eq(v_l, '{') | eq(v_l, '}') | eq(v, ':') | eq(v, ',');
+            b.ws = eq(v, ' ') | eq(v, '\t') | eq(v, '\n') | eq(v, '\r');
+#else
+            b = Block{0, 0, 0, 0};
+            for (int i = 0; i < 64; i++)
+            {
+                uint64_t bit = 1ull << i;
+                switch (p[i])
+                {
+                case '"':
+                    b.quote |= bit;
+                    break;
+                case '\\':
+                    b.backslash |= bit;
+                    break;
+                case '{':
+                case '}':
+                case '[':
+                case ']':
+                case ':':
+                case ',':
+                    b.op |= bit;
+                    break;
+                case ' ':
+                case '\t':
+                case '\n':
+                case '\r':
+                    b.ws |= bit;
+                    break;
+                }
+            }
+#endif
+        }
+        // 被反斜杠转义的字符；carry表示上一块以奇数个反斜杠结尾，本块第一个字符被转义。只在块中有反斜杠时调用
+        static uint64_t Escaped(uint64_t backslash, uint64_t &carry)
+        {
+            uint64_t escaped = carry;
+            backslash &= ~carry;
+            carry = 0;
+            while (backslash != 0)
+            {
+                int i = __builtin_ctzll(backslash);
+                if (i == 63)
+                {
+                    carry = 1;
+                    break;
+                }
+                uint64_t next = 1ull << (i + 1);
+                escaped |= next;
+                backslash &= ~((1ull << i) | next);
+            }
+            return escaped;
+        }
+        // 第i位为前i位(含)的异或，引号位图经过它得到字符串区间
+        static uint64_t PrefixXor(uint64_t x)
+        {
+            x ^= x << 1;
+            x ^= x << 2;
+            x ^= x << 4;
+            x ^= x << 8;
+            x ^= x << 16;
+            x ^= x << 32;
+            return x;
+        }
+        // 第一遍：结构字符和每个值(字符串、数字、字面量)的起始位置，字符串内部的字符不计入
+        static bool Index(std::string_view text, std::vector<uint32_t> &index)
+        {
+            index.clear();
+            uint64_t in_string_carry = 0; // 上一块结束时在字符串中为全1
+            uint64_t escaped_carry = 0;
+            uint64_t scalar_carry = 0; // 上一块最后一个字节是字面量或数字的一部分
+            size_t len = text.size();
+            char tail[64];
+            for (size_t offset = 0; offset < len; offset += 64)
+            {
+                const char *p = text.data() + offset;
+                // 不足64字节的最后一块拷出来用空格补齐，不越界读
+                if (len - offset < 64)
+                {
+                    memset(tail, ' ', sizeof(tail));
+                    memcpy(tail, p, len - offset);
+                    p = tail;
+                }
+                Block b;
+                Classify(p, b);
+                uint64_t escaped = 0;
+                if ((b.backslash | escaped_carry) != 0)
+                    escaped = Escaped(b.backslash, escaped_carry);
+                uint64_t quote = b.quote & ~escaped;
+                uint64_t in_string = PrefixXor(quote) ^ in_string_carry;
+                in_string_carry = (uint64_t)((int64_t)in_string >> 63);
+                // 开引号、以及紧跟在空白或结构字符之后的非空白字符是一个值的起始位置
+                uint64_t scalar = ~(b.op | b.ws);
+                uint64_t nonquote_scalar = scalar & ~quote;
+                uint64_t follows_scalar = (nonquote_scalar << 1) | scalar_carry;
+                scalar_carry = nonquote_scalar >> 63;
+                uint64_t string_tail = in_string ^ quote; // 字符串内部和闭引号
+                uint64_t structurals = (b.op | (scalar & ~follows_scalar)) & ~string_tail;
+                while (structurals != 0)
+                {
+                    index.push_back((uint32_t)(offset + __builtin_ctzll(structurals)));
+                    structurals &= structurals - 1;
+                }
+            }
+            return in_string_carry == 0;
+        }
+
+        // 第二遍：按结构索引递归构建Json::Value，同时校验语法
+        class Parser
+        {
+        public:
+            Parser(std::string_view text, const std::vector<uint32_t> &index, std::string &err)
+                : _text(text.data()), _end(text.data() + text.size()), _index(index.data()),
+                  _count(index.size()), _next(0), _err(err) {}
+
+            bool Parse(Json::Value &val)
+            {
+                if (Value(val, 0) == false)
+                    return false;
+                if (_next != _count)
+                    return Fail("unexpected data after the root value");
+                return true;
+            }
+
+        private:
+            bool Fail(const char *reason)
+            {
+                _err = reason;
+                return false;
+            }
+            // 取下一个结构位置上的字符，没有时返回0
+            char Take(const char *&at)
+            {
+                if (_next >= _count)
+                    return 0;
+                at = _text + _index[_next++];
+                return *at;
+            }
+            char Peek() const { return _next < _count ? _text[_index[_next]] : 0; }
+            // 下一个结构位置，值的结尾和它之间只能是空白
+            const char *Limit() const { return _next < _count ? _text + _index[_next] : _end; }
+
+            bool Value(Json::Value &val, int depth)
+            {
+                if (depth > maxDepth)
+                    return Fail("exceeded the maximum nesting depth");
+                const char *at = nullptr;
+                switch (Take(at))
+                {
+                case 0:
+                    return Fail("unexpected end of document");
+                case '{':
+                    return Object(val, depth + 1);
+                case '[':
+                    return Array(val, depth + 1);
+                case '"':
+                    if (String(at, _scratch) == false)
+                        return false;
+                    val = Json::Value(_scratch.data(), _scratch.data() + _scratch.size());
+                    return true;
+                default:
+                    return Scalar(at, val);
+                }
+            }
+            bool Object(Json::Value &val, int depth)
+            {
+                val = Json::Value(Json::objectValue);
+                const char *at = nullptr;
+                if (Peek() == '}')
+                {
+                    Take(at);
+                    return true;
+                }
+                while (true)
+                {
+                    if (Take(at) != '"')
+                        return Fail("expected a member name");
+                    if (String(at, _scratch) == false)
+                        return false;
+                    Json::Value &member = *val.demand(_scratch.data(), _scratch.data() + _scratch.size());
+                    if (Take(at) != ':')
+                        return Fail("expected ':' after a member name");
+                    if (Value(member, depth) == false)
+                        return false;
+                    char c = Take(at);
+                    if (c == '}')
+                        return true;
+                    if (c != ',')
+                        return Fail("expected ',' or '}' in object");
+                }
+            }
+            bool Array(Json::Value &val, int depth)
+            {
+                val = Json::Value(Json::arrayValue);
+                const char *at = nullptr;
+                if (Peek() == ']')
+                {
+                    Take(at);
+                    return true;
+                }
+                while (true)
+                {
+                    if (Value(val.append(Json::Value()), depth) == false)
+                        return false;
+                    char c = Take(at);
+                    if (c == ']')
+                        return true;
+                    if (c != ',')
+                        return Fail("expected ',' or ']' in array");
+                }
+            }
+            // at指向开引号，out为解码后的内容
+            bool String(const char *at, std::string &out)
+            {
+                out.clear();
+                const char *p = at + 1;
+                while (true)
+                {
+                    const char *run = p;
+                    p = ScanString(p, _end);
+                    out.append(run, p - run);
+                    if (p >= _end)
+                        return Fail("unterminated string");
+                    if (*p == '"')
+                        return true;
+                    if (*p != '\\')
+                        return Fail("control character in string");
+                    if (++p >= _end)
+                        return Fail("unterminated string");
+                    switch (*p++)
+                    {
+                    case '"':
+                        out.push_back('"');
+                        break;
+                    case '\\':
+                        out.push_back('\\');
+                        break;
+                    case '/':
+                        out.push_back('/');
+                        break;
+                    case 'b':
+                        out.push_back('\b');
+                        break;
+                    case 'f':
+                        out.push_back('\f');
+                        break;
+                    case 'n':
+                        out.push_back('\n');
+                        break;
+                    case 'r':
+                        out.push_back('\r');
+                        break;
+                    case 't':
+                        out.push_back('\t');
+                        break;
+                    case 'u':
+                        if (Unicode(p, out) == false)
+                            return false;
+                        break;
+                    default:
+                        return Fail("invalid escape sequence");
+                    }
+                }
+            }
+            // 第一个引号、反斜杠或控制字符的位置，没有时返回end
+            static const char *ScanString(const char *p, const char *end)
+            {
+#if defined(__AVX2__)
+                const __m256i quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\');
+                const __m256i control = _mm256_set1_epi8(0x1F);
+                for (; end - p >= 32; p += 32)
+                {
+                    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+                    __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                                                _mm256_cmpeq_epi8(_mm256_min_epu8(v, control), v));
+                    uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+                    if (mask != 0)
+                        return p + __builtin_ctz(mask);
+                }
+#elif defined(__SSE2__)
+                const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+                const __m128i control = _mm_set1_epi8(0x1F);
+                for (; end - p >= 16; p += 16)
+                {
+                    __m128i v = _mm_loadu_si128((const __m128i *)p);
+                    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                             _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+                    uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+                    if (mask != 0)
+                        return p + __builtin_ctz(mask);
+                }
+#endif
+                for (; p < end; p++)
+                {
+                    unsigned char c = (unsigned char)*p;
+                    if (c == '"' || c == '\\' || c < 0x20)
+                        return p;
+                }
+                return end;
+            }
+            bool Hex4(const char *&p, uint32_t &code)
+            {
+                if (_end - p < 4)
+                    return Fail("invalid unicode escape");
+                code = 0;
+                for (int i = 0; i < 4; i++, p++)
+                {
+                    char c = *p;
+                    uint32_t digit;
+                    if (c >= '0' && c <= '9')
+                        digit = c - '0';
+                    else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                        digit = (c | 0x20) - 'a' + 10;
+                    else
+                        return Fail("invalid unicode escape");
+                    code = (code << 4) | digit;
+                }
+                return true;
+            }
+            // p指向\u之后，解出的码点按UTF-8写进out；高代理项后面必须跟着低代理项
+            bool Unicode(const char *&p, std::string &out)
+            {
+                uint32_t code = 0;
+                if (Hex4(p, code) == false)
+                    return false;
+                if (code >= 0xD800 && code <= 0xDBFF)
+                {
+                    uint32_t low = 0;
+                    if (_end - p < 2 || p[0] != '\\' || p[1] != 'u')
+                        return Fail("expecting a low surrogate");
+                    p += 2;
+                    if (Hex4(p, low) == false)
+                        return false;
+                    if (low < 0xDC00 || low > 0xDFFF)
+                        return Fail("invalid low surrogate");
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                if (code < 0x80)
+                    out.push_back((char)code);
+                else if (code < 0x800)
+                {
+                    out.push_back((char)(0xC0 | (code >> 6)));
+                    out.push_back((char)(0x80 | (code & 0x3F)));
+                }
+                else if (code < 0x10000)
+                {
+                    out.push_back((char)(0xE0 | (code >> 12)));
+                    out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+                    out.push_back((char)(0x80 | (code & 0x3F)));
+                }
+                else
+                {
+                    out.push_back((char)(0xF0 | (code >> 18)));
+                    out.push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+                    out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+                    out.push_back((char)(0x80 | (code & 0x3F)));
+                }
+                return true;
+            }
+            // true、false、null或数字，之后到下一个结构位置之间只能是空白
+            bool Scalar(const char *at, Json::Value &val)
+            {
+                const char *limit = Limit();
+                const char *p = at;
+                if (Literal(p, limit, "true"))
+                    val = true;
+                else if (Literal(p, limit, "false"))
+                    val = false;
+                else if (Literal(p, limit, "null"))
+                    val = Json::Value();
+                else if (Number(p, limit, val) == false)
+                    return Fail("invalid value");
+                for (; p < limit; p++)
+                {
+                    if (*p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+                        return Fail("invalid value");
+                }
+                return true;
+            }
+            static bool Literal(const char *&p, const char *limit, const char *word)
+            {
+                size_t len = strlen(word);
+                if ((size_t)(limit - p) < len || memcmp(p, word, len) != 0)
+                    return false;
+                p += len;
+                return true;
+            }
+            // 和jsoncpp一致：在Int64范围内的整数为intValue，更大的正整数为uintValue，其余为realValue
+            static bool Number(const char *&p, const char *limit, Json::Value &val)
+            {
+                const char *start = p;
+                bool negative = (p < limit && *p == '-');
+                if (negative)
+                    p++;
+                const char *digits = p;
+                if (p >= limit || *p < '0' || *p > '9')
+                    return false;
+                if (*p == '0')
+                    p++;
+                else
+                {
+                    while (p < limit && *p >= '0' && *p <= '9')
+                        p++;
+                }
+                bool integral = true;
+                size_t int_digits = p - digits;
+                if (p < limit && *p == '.')
+                {
+                    integral = false;
+                    if (++p >= limit || *p < '0' || *p > '9')
+                        return false;
+                    while (p < limit && *p >= '0' && *p <= '9')
+                        p++;
+                }
+                if (p < limit && (*p == 'e' || *p == 'E'))
+                {
+                    integral = false;
+                    if (++p < limit && (*p == '+' || *p == '-'))
+                        p++;
+                    if (p >= limit || *p < '0' || *p > '9')
+                        return false;
+                    while (p < limit && *p >= '0' && *p <= '9')
+                        p++;
+                }
+                if (integral && int_digits <= 20)
+                {
+                    uint64_t n = 0;
+                    bool overflow = false;
+                    for (const char *d = digits; d < digits + int_digits; d++)
+                    {
+                        uint64_t digit = *d - '0';
+                        if (n > (UINT64_MAX - digit) / 10)
+                        {
+                            overflow = true;
+                            break;
+                        }
+                        n = n * 10 + digit;
+                    }
+                    if (overflow == false)
+                    {
+                        if (negative == false && n <= (uint64_t)INT64_MAX)
+                            val = (Json::Int64)n;
+                        else if (negative == false)
+                            val = (Json::UInt64)n;
+                        else if (n <= (uint64_t)INT64_MAX + 1)
+                            val = (Json::Int64)(0 - n);
+                        else
+                            overflow = true;
+                        if (overflow == false)
+                            return true;
+                    }
+                }
+                double d = 0;
+                auto result = std::from_chars(start, p, d);
+                if (result.ec == std::errc::result_out_of_range)
+                    return false;
+                val = d;
+                return result.ec == std::errc() && result.ptr == p;
+            }
+
+        private:
+            const char *_text;
+            const char *_end;
+            const uint32_t *_index;
+            size_t _count;
+            size_t _next;
+            std::string &_err;
+            // 字符串和键名的解码暂存区
+            std::string _scratch;
+        };
+    };
+}
@@ -0,0 +1,314 @@
+#pragma once
+// unix域套接字地址、socket参数和监听socket的接受端，muduo、io_uring和共享内存传输共用
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/Channel.h>
+#include <muduo/net/InetAddress.h>
+#include "Detail.hpp"
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Rpc
+{
+    // unix域套接字地址："unix:/path/to/socket"，可以放在Address的ip字段中，端口被忽略
+    class UnixAddress
+    {
+    public:
+        static constexpr const char *scheme = "unix:";
+        static bool IsUnix(const std::string &ip)
+        {
+            return ip.compare(0, strlen(scheme), scheme) == 0;
+        }
+        static std::string Path(const std::string &ip)
+        {
+            return IsUnix(ip) ? ip.substr(strlen(scheme)) : ip;
+        }
+        static std::string Make(const std::string &path)
+        {
+            return scheme + path;
+        }
+        static bool ToSockAddr(const std::string &path, struct sockaddr_un &addr)
+        {
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(addr.sun_path))
+            {
+                LOG(LogLevel::ERROR) << "无效的unix socket路径: " << path;
+                return false;
+            }
+            memcpy(addr.sun_path, path.data(), path.size());
+            return true;
+        }
+    };
+
+    // 每个连接上的socket参数，服务端和客户端的所有连接(包括unix域套接字上的，只应用其中适用的部分)都会设置
+    struct SocketOptions
+    {
+        // 关闭Nagle算法：小请求不必等上一个报文的ACK，否则和对端的延迟确认叠加会出现40ms的停顿
+        bool tcp_nodelay = true;
+        // 每次读到数据后重新进入quickack模式，立即确认而不是延迟确认；每次读多一次系统调用，默认关闭
+        bool tcp_quickack = false;
+        // 内核接收/发送缓冲区的字节数，0表示使用系统默认值(自动调整)；在listen/connect之前设置，才能影响窗口扩大因子
+        int rcvbuf = 0;
+        int sndbuf = 0;
+        // SO_BUSY_POLL：读socket时先在网卡队列上忙等的微秒数，0表示不开启；超过系统设置的值需要CAP_NET_ADMIN
+        int busy_poll_us = 0;
+    };
+
+    // socket的创建和参数设置，muduo和io_uring两个后端共用
+    class SocketOps
+    {
+    public:
+        // 在listen/connect之前设置的参数，监听socket上设置的值会被accept出来的连接继承
+        static void ApplyBuffers(int fd, const SocketOptions &options)
+        {
+            if (options.rcvbuf > 0)
+                SetOpt(fd, SOL_SOCKET, SO_RCVBUF, options.rcvbuf, "SO_RCVBUF");
+            if (options.sndbuf > 0)
+                SetOpt(fd, SOL_SOCKET, SO_SNDBUF, options.sndbuf, "SO_SNDBUF");
+        }
+        // 连接建立之后设置的参数
+        static void ApplyConnected(int fd, bool tcp, const SocketOptions &options)
+        {
+            if (options.busy_poll_us > 0)
+                SetOpt(fd, SOL_SOCKET, SO_BUSY_POLL, options.busy_poll_us, "SO_BUSY_POLL");
+            if (tcp == false)
+                return;
+            SetOpt(fd, IPPROTO_TCP, TCP_NODELAY, options.tcp_nodelay ? 1 : 0, "TCP_NODELAY");
+            if (options.tcp_quickack)
+                QuickAck(fd);
+        }
+        // quickack模式不是持久的，内核会自行退出，需要在每次读完数据后重新设置
+        static void QuickAck(int fd)
+        {
+            int on = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+        }
+        // ip写成"unix:/path/to/socket"时解析为unix域套接字地址
+        static bool Resolve(const std::string &ip, int port, struct sockaddr_storage &addr, socklen_t &len)
+        {
+            memset(&addr, 0, sizeof(addr));
+            if (UnixAddress::IsUnix(ip))
+            {
+                if (UnixAddress::ToSockAddr(UnixAddress::Path(ip), reinterpret_cast<struct sockaddr_un &>(addr)) == false)
+                    return false;
+                len = sizeof(struct sockaddr_un);
+                return true;
+            }
+            struct sockaddr_in *in = reinterpret_cast<struct sockaddr_in *>(&addr);
+            in->sin_family = AF_INET;
+            in->sin_port = htons(port);
+            if (::inet_pton(AF_INET, ip.c_str(), &in->sin_addr) != 1)
+            {
+                LOG(LogLevel::ERROR) << "无效的服务端地址: " << ip;
+                return false;
+            }
+            len = sizeof(struct sockaddr_in);
+            return true;
+        }
+        // 本机连接时源端口可能恰好等于目的端口，内核会让socket连上自己
+        static bool IsSelfConnect(int fd)
+        {
+            struct sockaddr_in local, peer;
+            socklen_t len = sizeof(local);
+            if (::getsockname(fd, (struct sockaddr *)&local, &len) < 0 || local.sin_family != AF_INET)
+                return false;
+            len = sizeof(peer);
+            if (::getpeername(fd, (struct sockaddr *)&peer, &len) < 0)
+                return false;
+            return local.sin_port == peer.sin_port && local.sin_addr.s_addr == peer.sin_addr.s_addr;
+        }
+        // 接受端预留的fd：fd用完(EMFILE/ENFILE)时监听socket一直可读，事件循环会空转，
+        // 和muduo的Acceptor一样先让出这个fd，把排队的连接接受下来立即关闭，再重新占住它
+        static int OpenIdleFd()
+        {
+            return ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        }
+        static void RejectWithIdleFd(int listenfd, int &idlefd)
+        {
+            LOG(LogLevel::ERROR) << "fd已经用完，拒绝新连接: " << strerror(errno);
+            if (idlefd < 0)
+                return;
+            ::close(idlefd);
+            int fd = ::accept(listenfd, nullptr, nullptr);
+            if (fd >= 0)
+                ::close(fd);
+            idlefd = OpenIdleFd();
+        }
+        // 创建监听socket，失败返回-1
+        static int ListenTcp(int port, const SocketOptions &options)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                LOG(LogLevel::ERROR) << "创建socket失败: " << strerror(errno);
+                return -1;
+            }
+            SetOpt(fd, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR");
+            SetOpt(fd, SOL_SOCKET, SO_REUSEPORT, 1, "SO_REUSEPORT");
+            ApplyBuffers(fd, options);
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            if (::bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || ::listen(fd, SOMAXCONN) < 0)
+            {
+                LOG(LogLevel::ERROR) << "监听端口失败: " << port << " " << strerror(errno);
+                ::close(fd);
+                return -1;
+            }
+            return fd;
+        }
+        static int ListenUnix(const std::string &path)
+        {
+            struct sockaddr_un addr;
+            if (UnixAddress::ToSockAddr(path, addr) == false)
+                return -1;
+            int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                LOG(LogLevel::ERROR) << "创建unix socket失败: " << strerror(errno);
+                return -1;
+            }
+            ::unlink(path.c_str()); // 上次进程退出时遗留的socket文件
+            if (::bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || ::listen(fd, SOMAXCONN) < 0)
+            {
+                LOG(LogLevel::ERROR) << "监听unix socket失败: " << path << " " << strerror(errno);
+                ::close(fd);
+                return -1;
+            }
+            LOG(LogLevel::INFO) << "监听unix socket: " << path;
+            return fd;
+        }
+        // TCP连接两端的地址，unix域套接字返回空地址
+        static muduo::net::InetAddress LocalAddr(int fd)
+        {
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            if (::getsockname(fd, (struct sockaddr *)&addr, &len) < 0 || addr.sin_family != AF_INET)
+                return muduo::net::InetAddress();
+            return muduo::net::InetAddress(addr);
+        }
+        static muduo::net::InetAddress PeerAddr(int fd)
+        {
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            if (::getpeername(fd, (struct sockaddr *)&addr, &len) < 0 || addr.sin_family != AF_INET)
+                return muduo::net::InetAddress();
+            return muduo::net::InetAddress(addr);
+        }
+        // 对端的IPv4地址(网络字节序)，unix域套接字返回0
+        static uint32_t PeerIp(int fd)
+        {
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            if (::getpeername(fd, (struct sockaddr *)&addr, &len) < 0 || addr.sin_family != AF_INET)
+                return 0;
+            return addr.sin_addr.s_addr;
+        }
+        // 拒绝刚accept出来的连接：SO_LINGER为0时close直接发RST，服务端不进入TIME_WAIT
+        static void Reject(int fd)
+        {
+            struct linger lg;
+            lg.l_onoff = 1;
+            lg.l_linger = 0;
+            ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+            ::close(fd);
+        }
+
+    private:
+        static void SetOpt(int fd, int level, int name, int value, const char *what)
+        {
+            if (::setsockopt(fd, level, name, &value, sizeof(value)) < 0)
+                LOG(LogLevel::WARNING) << "设置" << what << "失败: " << strerror(errno);
+        }
+    };
+
+    // 监听socket的接受端，挂在一个muduo事件循环上，接受的新连接交给回调
+    class SocketAcceptor
+    {
+    public:
+        using ptr = std::shared_ptr<SocketAcceptor>;
+        using NewConnectionCallback = std::function<void(int)>;
+        // 一次可读事件中最多接受的连接数，连接洪峰时不让一个监听socket长时间占住事件循环
+        static constexpr int maxAcceptsPerRead = 64;
+        explicit SocketAcceptor(muduo::net::EventLoop *loop) : _loop(loop), _listenfd(-1), _idlefd(SocketOps::OpenIdleFd()) {}
+        ~SocketAcceptor()
+        {
+            if (_idlefd >= 0)
+                ::close(_idlefd);
+            if (_listenfd < 0)
+                return;
+            _channel->disableAll();
+            _channel->remove();
+            ::close(_listenfd);
+            if (_path.empty() == false)
+                ::unlink(_path.c_str());
+        }
+        void SetNewConnectionCallback(const NewConnectionCallback &cb) { _on_new_connection = cb; }
+        // 以下两个函数需要在loop所属的线程中调用
+        bool ListenTcp(int port, const SocketOptions &options)
+        {
+            return Listen(SocketOps::ListenTcp(port, options));
+        }
+        bool ListenUnix(const std::string &path)
+        {
+            if (Listen(SocketOps::ListenUnix(path)) == false)
+                return false;
+            _path = path;
+            return true;
+        }
+
+    private:
+        bool Listen(int fd)
+        {
+            if (fd < 0)
+                return false;
+            _listenfd = fd;
+            _channel.reset(new muduo::net::Channel(_loop, _listenfd));
+            _channel->setReadCallback(std::bind(&SocketAcceptor::HandleRead, this));
+            _channel->enableReading();
+            return true;
+        }
+        // 监听socket是水平触发的，backlog中剩下的连接下一轮事件循环还会通知
+        void HandleRead()
+        {
+            for (int i = 0; i < maxAcceptsPerRead; i++)
+            {
+                int fd = ::accept4(_listenfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0)
+                {
+                    if (errno == EMFILE || errno == ENFILE)
+                        SocketOps::RejectWithIdleFd(_listenfd, _idlefd);
+                    else if (errno == ECONNABORTED || errno == EINTR)
+                        continue;
+                    else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        LOG(LogLevel::ERROR) << "accept失败: " << strerror(errno);
+                    return;
+                }
+                if (_on_new_connection)
+                    _on_new_connection(fd);
+                else
+                    ::close(fd);
+            }
+        }
+
+    private:
+        muduo::net::EventLoop *_loop;
+        int _listenfd;
+        int _idlefd; // 见SocketOps::OpenIdleFd
+        std::string _path; // unix域套接字的路径，关闭时删除
+        std::unique_ptr<muduo::net::Channel> _channel;
+        NewConnectionCallback _on_new_connection;
+    };
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace Rpc
+{
+    // 空闲连接检测用的时间轮，每个IO线程一个，只在该线程中使用
+    // 每个连接对应一个Entry，连接上收到数据时把Entry的引用放进当前格子；指针每个tick前进一格并清空那一格，
+    // 转完一整圈都没有被刷新的Entry引用计数归零被析构，析构时回调on_idle。加入、刷新、过期都是O(1)
+    class TimingWheel
+    {
+    public:
+        using ptr = std::shared_ptr<TimingWheel>;
+        using IdleCallback = std::function<void()>;
+        class Entry
+        {
+        public:
+            explicit Entry(const IdleCallback &on_idle) : _on_idle(on_idle) {}
+            ~Entry()
+            {
+                if (_on_idle)
+                    _on_idle();
+            }
+
+        private:
+            IdleCallback _on_idle;
+        };
+        using EntryPtr = std::shared_ptr<Entry>;
+        // 连接只持有弱引用，强引用全部在格子里
+        using WeakEntry = std::weak_ptr<Entry>;
+
+        // 超时精度是一个tick：超时不超过1秒时tick等于超时时间，否则tick为1秒
+        explicit TimingWheel(int timeout_ms)
+            : _tick_ms(std::max(1, std::min(timeout_ms, maxTickMs))),
+              _buckets((timeout_ms + _tick_ms - 1) / _tick_ms + 1),
+              _cursor(0) {}
+
+        // 由所属的事件循环每隔TickMs()调用一次Tick
+        int TickMs() const { return _tick_ms; }
+        WeakEntry Add(const IdleCallback &on_idle)
+        {
+            EntryPtr entry = std::make_shared<Entry>(on_idle);
+            _buckets[_cursor].insert(entry);
+            return entry;
+        }
+        void Touch(const WeakEntry &weak)
+        {
+            EntryPtr entry = weak.lock();
+            if (entry)
+                _buckets[_cursor].insert(entry);
+        }
+        void Tick()
+        {
+            _cursor = (_cursor + 1) % _buckets.size();
+            // 先换出来再析构，on_idle中关闭连接时不会碰到正在清空的格子
+            std::unordered_set<EntryPtr> expired;
+            expired.swap(_buckets[_cursor]);
+        }
+
+    private:
+        static constexpr int maxTickMs = 1000;
+        int _tick_ms;
+        std::vector<std::unordered_set<EntryPtr>> _buckets;
+        size_t _cursor;
+    };
+}
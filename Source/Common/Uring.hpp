@@ -0,0 +1,584 @@
+#pragma once
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+// 多路accept/recv和提供缓冲区环需要6.0以上内核的头文件，没有时整个io_uring后端不参与编译
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define RPC_HAVE_IO_URING 1
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "Log.hpp"
+
+namespace Rpc
+{
+    using namespace LogModule;
+
+    // 不依赖liburing，直接通过系统调用和mmap操作提交队列(SQ)和完成队列(CQ)
+    // 只在所属的事件循环线程中使用，不加锁
+    class Uring
+    {
+    public:
+        Uring() : _fd(-1), _sq_ptr(nullptr), _cq_ptr(nullptr), _sqes(nullptr),
+                  _sq_size(0), _cq_size(0), _sqe_tail(0), _sqe_submitted(0) {}
+        ~Uring()
+        {
+            if (_sqes != nullptr)
+                ::munmap(_sqes, _sq_entries * sizeof(struct io_uring_sqe));
+            if (_cq_ptr != nullptr && _cq_ptr != _sq_ptr)
+                ::munmap(_cq_ptr, _cq_size);
+            if (_sq_ptr != nullptr)
+                ::munmap(_sq_ptr, _sq_size);
+            if (_fd >= 0)
+                ::close(_fd);
+        }
+        Uring(const Uring &) = delete;
+        Uring &operator=(const Uring &) = delete;
+
+        bool Init(unsigned entries)
+        {
+            struct io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            // 完成队列放大一些，多路recv一次提交会产生很多完成事件
+            params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+            params.cq_entries = entries * 4;
+            _fd = (int)::syscall(__NR_io_uring_setup, entries, &params);
+            if (_fd < 0)
+                return false;
+            _sq_entries = params.sq_entries;
+            _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+            bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single_mmap)
+                _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+            _sq_ptr = Map(_sq_size, IORING_OFF_SQ_RING);
+            if (_sq_ptr == nullptr)
+                return false;
+            _cq_ptr = single_mmap ? _sq_ptr : Map(_cq_size, IORING_OFF_CQ_RING);
+            if (_cq_ptr == nullptr)
+                return false;
+            _sqes = static_cast<struct io_uring_sqe *>(Map(params.sq_entries * sizeof(struct io_uring_sqe), IORING_OFF_SQES));
+            if (_sqes == nullptr)
+                return false;
+
+            char *sq = static_cast<char *>(_sq_ptr);
+            _sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            _sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            _sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            _sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            char *cq = static_cast<char *>(_cq_ptr);
+            _cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            _cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            _cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            _cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+            _sqe_tail = _sqe_submitted = *_sq_tail;
+            return true;
+        }
+        int Fd() const { return _fd; }
+
+        // 取一个空的SQE，提交队列满了就先把已有的提交掉；同一轮循环里准备的SQE在Submit时一次提交
+        struct io_uring_sqe *GetSqe()
+        {
+            if (_sqe_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries)
+                Submit(0);
+            unsigned index = _sqe_tail & _sq_mask;
+            struct io_uring_sqe *sqe = &_sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            _sq_array[index] = index;
+            _sqe_tail++;
+            return sqe;
+        }
+        // 提交所有准备好的SQE，并等待至少wait_nr个完成事件
+        int Submit(unsigned wait_nr)
+        {
+            __atomic_store_n(_sq_tail, _sqe_tail, __ATOMIC_RELEASE);
+            unsigned to_submit = _sqe_tail - _sqe_submitted;
+            unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+            int ret;
+            do
+            {
+                ret = (int)::syscall(__NR_io_uring_enter, _fd, to_submit, wait_nr, flags, nullptr, 0);
+            } while (ret < 0 && errno == EINTR && wait_nr == 0);
+            if (ret > 0)
+                _sqe_submitted += ret;
+            else if (ret < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+                LOG(LogLevel::ERROR) << "io_uring_enter失败: " << strerror(errno);
+            return ret;
+        }
+        // 依次处理所有已完成的事件，返回处理的个数
+        template <typename Func>
+        unsigned ForEachCqe(Func func)
+        {
+            unsigned head = *_cq_head;
+            unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+            unsigned count = 0;
+            for (; head != tail; head++, count++)
+                func(&_cqes[head & _cq_mask]);
+            __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+            return count;
+        }
+
+    private:
+        void *Map(size_t size, off_t offset)
+        {
+            void *ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, offset);
+            if (ptr == MAP_FAILED)
+            {
+                LOG(LogLevel::ERROR) << "映射io_uring队列失败: " << strerror(errno);
+                return nullptr;
+            }
+            return ptr;
+        }
+
+    private:
+        int _fd;
+        void *_sq_ptr;
+        void *_cq_ptr;
+        struct io_uring_sqe *_sqes;
+        size_t _sq_size;
+        size_t _cq_size;
+        unsigned _sq_entries;
+        unsigned *_sq_head;
+        unsigned *_sq_tail;
+        unsigned _sq_mask;
+        unsigned *_sq_array;
+        unsigned *_cq_head;
+        unsigned *_cq_tail;
+        unsigned _cq_mask;
+        struct io_uring_cqe *_cqes;
+        unsigned _sqe_tail;      // 已经准备好的SQE
+        unsigned _sqe_submitted; // 已经提交给内核的SQE
+    };
+
+    // 提供缓冲区环：一次注册一组固定大小的接收缓冲区，多路recv每次收到数据时由内核从中挑一块
+    // 连接不需要各自常驻一块接收缓冲区，数据拷进连接的输入缓冲区后立即归还
+    class UringBufRing
+    {
+    public:
+        UringBufRing() : _ring(nullptr), _ring_size(0), _count(0), _buf_size(0), _tail(0) {}
+        ~UringBufRing()
+        {
+            if (_ring != nullptr)
+                ::munmap(_ring, _ring_size);
+        }
+        UringBufRing(const UringBufRing &) = delete;
+        UringBufRing &operator=(const UringBufRing &) = delete;
+
+        // count必须是2的幂
+        bool Init(Uring &ring, uint16_t group_id, unsigned count, unsigned buf_size)
+        {
+            _count = count;
+            _buf_size = buf_size;
+            _group_id = group_id;
+            _ring_size = count * sizeof(struct io_uring_buf);
+            void *ptr = ::mmap(nullptr, _ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+            if (ptr == MAP_FAILED)
+                return false;
+            _ring = static_cast<struct io_uring_buf_ring *>(ptr);
+
+            struct io_uring_buf_reg reg;
+            memset(&reg, 0, sizeof(reg));
+            reg.ring_addr = reinterpret_cast<uint64_t>(_ring);
+            reg.ring_entries = count;
+            reg.bgid = group_id;
+            if (::syscall(__NR_io_uring_register, ring.Fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+            {
+                LOG(LogLevel::ERROR) << "注册io_uring接收缓冲区失败: " << strerror(errno);
+                return false;
+            }
+            _data.resize((size_t)count * buf_size);
+            for (unsigned bid = 0; bid < count; bid++)
+                Add(bid, bid);
+            Publish(count);
+            return true;
+        }
+        uint16_t GroupId() const { return _group_id; }
+        const char *Data(unsigned bid) const { return _data.data() + (size_t)bid * _buf_size; }
+        // 处理完一块缓冲区之后归还给内核
+        void Recycle(unsigned bid)
+        {
+            Add(bid, 0);
+            Publish(1);
+        }
+
+    private:
+        void Add(unsigned bid, unsigned offset)
+        {
+            // 头文件中的bufs在C++下会被前面的空结构体挤后8字节，这里直接按数组取
+            struct io_uring_buf *buf = reinterpret_cast<struct io_uring_buf *>(_ring) + ((_tail + offset) & (_count - 1));
+            buf->addr = reinterpret_cast<uint64_t>(Data(bid));
+            buf->len = _buf_size;
+            buf->bid = (uint16_t)bid;
+        }
+        void Publish(unsigned n)
+        {
+            _tail += n;
+            __atomic_store_n(&_ring->tail, _tail, __ATOMIC_RELEASE);
+        }
+
+    private:
+        struct io_uring_buf_ring *_ring;
+        size_t _ring_size;
+        unsigned _count;
+        unsigned _buf_size;
+        uint16_t _group_id = 0;
+        uint16_t _tail;
+        std::vector<char> _data;
+    };
+
+    // 基于io_uring的事件循环，用法和muduo::net::EventLoop相同：一个线程一个，其他线程通过RunInLoop把任务交给它
+    // 所有IO操作都是异步提交的，完成事件按user_data分发给对应的Handler
+    class UringLoop
+    {
+    public:
+        using Functor = std::function<void()>;
+        // 完成事件的接收者，user_data的低3位存放操作类型，其余位是Handler的地址
+        class Handler
+        {
+        public:
+            virtual ~Handler() {}
+            virtual void OnCompletion(int op, int res, uint32_t flags) = 0;
+        };
+        static constexpr unsigned ringEntries = 1024;
+        // 提供缓冲区常驻内存，每个循环count*size字节；用完时多路recv以-ENOBUFS结束、连接重新提交，不会出错
+        static constexpr unsigned defaultRecvBufCount = 64;
+        static constexpr unsigned defaultRecvBufSize = 16 * 1024;
+        static constexpr unsigned maxRecvBufCount = 32768;
+
+        UringLoop() : _quit(false), _calling_functors(false), _wakeup_fd(-1), _wakeup_value(0) {}
+        ~UringLoop()
+        {
+            for (TimerHandler *timer : _timers)
+                delete timer;
+            if (_wakeup_fd >= 0)
+                ::close(_wakeup_fd);
+        }
+
+        // 检查当前内核是否支持这个后端用到的全部特性(多路recv需要6.0)，结果只探测一次
+        // 只建一个最小的ring、注册一块缓冲区，不占用一个完整循环的内存
+        static bool Supported()
+        {
+            static bool supported = []()
+            {
+                Uring ring;
+                UringBufRing buffers;
+                return ring.Init(1) && buffers.Init(ring, 0, 1, 64);
+            }();
+            return supported;
+        }
+        // buf_count向上取整到2的幂
+        bool Init(unsigned buf_count = defaultRecvBufCount, unsigned buf_size = defaultRecvBufSize)
+        {
+            if (_ring.Init(ringEntries) == false)
+            {
+                LOG(LogLevel::ERROR) << "创建io_uring失败: " << strerror(errno);
+                return false;
+            }
+            unsigned count = 1;
+            while (count < buf_count && count < maxRecvBufCount)
+                count <<= 1;
+            if (_buffers.Init(_ring, 0, count, std::max(buf_size, 1024u)) == false)
+                return false;
+            _wakeup_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            return _wakeup_fd >= 0;
+        }
+        // 在调用线程中运行，直到Quit
+        void Loop()
+        {
+            _thread_id = std::this_thread::get_id();
+            ArmWakeup();
+            while (_quit == false)
+            {
+                // 上一轮回调中准备好的所有SQE在这里一次提交，同时等待新的完成事件
+                _ring.Submit(1);
+                _ring.ForEachCqe([this](const struct io_uring_cqe *cqe)
+                                 {
+                                     Handler *handler = reinterpret_cast<Handler *>(cqe->user_data & ~opMask);
+                                     if (handler != nullptr)
+                                         handler->OnCompletion((int)(cqe->user_data & opMask), cqe->res, cqe->flags); });
+                DoPendingFunctors();
+            }
+        }
+        void Quit()
+        {
+            _quit = true;
+            if (IsInLoopThread() == false)
+                Wakeup();
+        }
+        bool IsInLoopThread() const
+        {
+            return _thread_id == std::this_thread::get_id();
+        }
+        void RunInLoop(const Functor &cb)
+        {
+            if (IsInLoopThread())
+                cb();
+            else
+                QueueInLoop(cb);
+        }
+        void QueueInLoop(const Functor &cb)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _pending_functors.push_back(cb);
+            }
+            if (IsInLoopThread() == false || _calling_functors)
+                Wakeup();
+        }
+        // 定时器编号，0表示没有定时器
+        using TimerId = uint64_t;
+        // ms毫秒之后在循环线程中执行cb，只能在循环线程中调用；返回的编号可以交给Cancel
+        TimerId RunAfter(int ms, const Functor &cb)
+        {
+            return AddTimer(ms, 0, cb);
+        }
+        // 每隔ms毫秒在循环线程中执行一次cb，只能在循环线程中调用；编号在整个周期内不变
+        TimerId RunEvery(int ms, const Functor &cb)
+        {
+            return AddTimer(ms, ms, cb);
+        }
+        // 取消还没执行的定时器，cb和它捕获的对象立即释放；已经执行过的编号被忽略，只能在循环线程中调用
+        void Cancel(TimerId id)
+        {
+            auto it = std::find_if(_timers.begin(), _timers.end(), [id](TimerHandler *timer)
+                                   { return timer->id == id; });
+            if (id == 0 || it == _timers.end())
+                return;
+            TimerHandler *timer = *it;
+            timer->cb = Functor();
+            // 内核中的超时以-ECANCELED完成时才释放；周期定时器在自己的回调里取消时不在内核中，回调返回后释放
+            if (timer->armed)
+            {
+                struct io_uring_sqe *sqe = _ring.GetSqe();
+                sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+                sqe->addr = UserData(timer, 0);
+                sqe->user_data = 0;
+            }
+        }
+
+        // 以下函数准备SQE，都只能在循环线程中调用，真正的提交在本轮循环结束时
+        static uint64_t UserData(Handler *handler, int op)
+        {
+            return reinterpret_cast<uint64_t>(handler) | (uint64_t)op;
+        }
+        void PrepAccept(int listenfd, Handler *handler, int op)
+        {
+            struct io_uring_sqe *sqe = _ring.GetSqe();
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = listenfd;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT; // 一次提交，每接受一个连接产生一个完成事件
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            sqe->user_data = UserData(handler, op);
+        }
+        void PrepRecv(int fd, Handler *handler, int op)
+        {
+            struct io_uring_sqe *sqe = _ring.GetSqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = fd;
+            sqe->ioprio = IORING_RECV_MULTISHOT; // 一次提交，每收到一批数据产生一个完成事件
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = _buffers.GroupId();
+            sqe->user_data = UserData(handler, op);
+        }
+        void PrepSend(int fd, const char *data, size_t len, Handler *handler, int op)
+        {
+            struct io_uring_sqe *sqe = _ring.GetSqe();
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(data);
+            sqe->len = (uint32_t)std::min(len, (size_t)INT32_MAX);
+            sqe->msg_flags = MSG_NOSIGNAL;
+            sqe->user_data = UserData(handler, op);
+        }
+        void PrepConnect(int fd, const struct sockaddr *addr, socklen_t len, Handler *handler, int op)
+        {
+            struct io_uring_sqe *sqe = _ring.GetSqe();
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(addr);
+            sqe->off = len;
+            sqe->user_data = UserData(handler, op);
+        }
+        // 取消user_data对应的操作，被取消的操作以-ECANCELED完成
+        void PrepCancel(Handler *target, int target_op, Handler *handler, int op)
+        {
+            struct io_uring_sqe *sqe = _ring.GetSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = UserData(target, target_op);
+            sqe->user_data = UserData(handler, op);
+        }
+        UringBufRing &Buffers() { return _buffers; }
+
+    private:
+        static constexpr uint64_t opMask = 7;
+        enum
+        {
+            OP_WAKEUP = 1
+        };
+        struct TimerHandler : public Handler
+        {
+            TimerHandler(UringLoop *loop, TimerId id, int interval_ms, const Functor &cb)
+                : loop(loop), id(id), interval_ms(interval_ms), armed(false), cb(cb) {}
+            virtual void OnCompletion(int, int, uint32_t) override
+            {
+                armed = false;
+                if (cb && interval_ms > 0)
+                {
+                    Functor task = cb;
+                    task();
+                    if (cb) // 回调中没有取消
+                        return loop->ArmTimer(this);
+                }
+                loop->RemoveTimer(this);
+                Functor task;
+                task.swap(cb);
+                delete this;
+                if (task)
+                    task();
+            }
+            UringLoop *loop;
+            TimerId id;
+            int interval_ms; // 0表示只执行一次
+            bool armed;      // 超时操作在内核中
+            Functor cb;      // 被取消时清空
+            struct __kernel_timespec ts;
+        };
+        struct WakeupHandler : public Handler
+        {
+            explicit WakeupHandler(UringLoop *loop) : loop(loop) {}
+            virtual void OnCompletion(int, int, uint32_t) override
+            {
+                if (loop->_quit == false)
+                    loop->ArmWakeup();
+            }
+            UringLoop *loop;
+        };
+
+        TimerId AddTimer(int ms, int interval_ms, const Functor &cb)
+        {
+            TimerHandler *timer = new TimerHandler(this, ++_last_timer_id, interval_ms, cb);
+            timer->ts.tv_sec = ms / 1000;
+            timer->ts.tv_nsec = (long long)(ms % 1000) * 1000000;
+            _timers.push_back(timer);
+            ArmTimer(timer);
+            return timer->id;
+        }
+        void ArmTimer(TimerHandler *timer)
+        {
+            timer->armed = true;
+            struct io_uring_sqe *sqe = _ring.GetSqe();
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->addr = reinterpret_cast<uint64_t>(&timer->ts);
+            sqe->len = 1;
+            sqe->user_data = UserData(timer, 0);
+        }
+        void RemoveTimer(TimerHandler *timer)
+        {
+            _timers.erase(std::find(_timers.begin(), _timers.end(), timer));
+        }
+        // eventfd上挂一个读操作，其他线程写eventfd时循环从等待中醒来
+        void ArmWakeup()
+        {
+            struct io_uring_sqe *sqe = _ring.GetSqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = _wakeup_fd;
+            sqe->addr = reinterpret_cast<uint64_t>(&_wakeup_value);
+            sqe->len = sizeof(_wakeup_value);
+            sqe->user_data = UserData(&_wakeup_handler, OP_WAKEUP);
+        }
+        void Wakeup()
+        {
+            uint64_t one = 1;
+            ssize_t n = ::write(_wakeup_fd, &one, sizeof(one));
+            (void)n;
+        }
+        void DoPendingFunctors()
+        {
+            std::vector<Functor> functors;
+            _calling_functors = true;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                functors.swap(_pending_functors);
+            }
+            for (const Functor &functor : functors)
+                functor();
+            _calling_functors = false;
+        }
+
+    private:
+        Uring _ring;
+        UringBufRing _buffers;
+        std::atomic<bool> _quit;
+        bool _calling_functors;
+        std::thread::id _thread_id;
+        int _wakeup_fd;
+        uint64_t _wakeup_value;
+        WakeupHandler _wakeup_handler{this};
+        std::mutex _mutex;
+        std::vector<Functor> _pending_functors;
+        TimerId _last_timer_id = 0;
+        std::vector<TimerHandler *> _timers; // 还没到期和已经取消、等待内核完成的定时器
+    };
+
+    // 在新线程中运行一个UringLoop，和muduo::net::EventLoopThread对应
+    class UringLoopThread
+    {
+    public:
+        UringLoopThread() : _loop(nullptr) {}
+        ~UringLoopThread()
+        {
+            if (_loop != nullptr)
+            {
+                _loop->Quit();
+                _thread.join();
+            }
+        }
+        // 初始化失败返回nullptr；参数同UringLoop::Init
+        UringLoop *StartLoop(unsigned buf_count = UringLoop::defaultRecvBufCount,
+                             unsigned buf_size = UringLoop::defaultRecvBufSize)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            bool done = false;
+            _thread = std::thread([this, &done, buf_count, buf_size]()
+                                  {
+                                      UringLoop loop;
+                                      bool ok = loop.Init(buf_count, buf_size);
+                                      {
+                                          std::lock_guard<std::mutex> lock(_mutex);
+                                          _loop = ok ? &loop : nullptr;
+                                          done = true;
+                                      }
+                                      _cond.notify_one();
+                                      if (ok)
+                                          loop.Loop();
+                                      std::lock_guard<std::mutex> lock(_mutex);
+                                      _loop = nullptr; });
+            _cond.wait(lock, [&done]()
+                       { return done; });
+            if (_loop == nullptr)
+                _thread.join();
+            return _loop;
+        }
+
+    private:
+        UringLoop *_loop;
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _cond;
+    };
+}
+#endif
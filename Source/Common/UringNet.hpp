@@ -0,0 +1,890 @@
+#pragma once
+// io_uring后端的连接、服务端和客户端，事件循环在Uring.hpp中
+
+#include <muduo/base/CountDownLatch.h>
+#include "Uring.hpp"
+#include "TimingWheel.hpp"
+#include "Protocol.hpp"
+#include "Socket.hpp"
+#include "Options.hpp"
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Rpc
+{
+#ifdef RPC_HAVE_IO_URING
+    // io_uring后端上的连接，所有状态只在所属的UringLoop线程中修改
+    // 接收：一个多路recv常驻，数据落在循环共享的提供缓冲区中，拷进_input后立即归还
+    // 发送：同一时刻最多一个send在途，在途期间产生的报文攒在_output中，上一个send完成后一次发出
+    // _input、_output、_sending_buf只在有数据时从循环线程的缓冲区池中借，空了就还回去
+    class UringConnection : public BaseConnection, public UringLoop::Handler, public std::enable_shared_from_this<UringConnection>
+    {
+    public:
+        using ptr = std::shared_ptr<UringConnection>;
+
+        UringConnection(UringLoop *loop, int fd, const BaseProtocol::ptr &protocol)
+            : _loop(loop), _fd(fd), _protocol(protocol),
+              _connected(false), _closing(false), _recv_armed(false), _sending(false), _cancels(0),
+              _paused(false), _shutdown_write(false), _quickack(false), _idle_wheel(nullptr), _high_water_mark(0),
+              _policy(OverloadPolicy::OVERLOAD_REJECT), _overloaded(false), _backlog(0) {}
+        ~UringConnection()
+        {
+            if (_fd >= 0)
+                ::close(_fd);
+        }
+
+        // 在循环线程中调用：开始接收，连接关闭(fd已经关闭、不再有在途操作)后调用close_cb
+        void Start(const MessageCallback &cb, const CloseCallback &close_cb)
+        {
+            _on_message = cb;
+            _on_close = close_cb;
+            _self = shared_from_this(); // 有操作在途时连接不能被销毁，关闭时解开
+            _connected = true;
+            ArmRecv();
+        }
+        // 每次收到数据后重新开启TCP_QUICKACK，需要在Start之前调用
+        void EnableQuickAck(bool on)
+        {
+            _quickack = on;
+        }
+        // 加入所属循环的空闲检测，之后每次收到数据都刷新一次
+        void SetIdleWheel(TimingWheel *wheel, const TimingWheel::WeakEntry &entry)
+        {
+            _idle_wheel = wheel;
+            _idle_entry = entry;
+        }
+        // 在循环线程中调用：之后连接上的事件不再回调到上层
+        void DetachCallbacks()
+        {
+            _on_message = MessageCallback();
+            _on_close = CloseCallback();
+            _on_high_water_mark = HighWaterMarkCallback();
+        }
+
+        virtual void Send(const BaseMessage::ptr &msg) override
+        {
+            if (_loop->IsInLoopThread())
+            {
+                static thread_local muduo::net::Buffer frame;
+                MuduoBuffer buf(&frame);
+                if (_protocol->Serialize(msg, BufferFactory::Borrow(buf)))
+                    SendInLoop(frame.peek(), frame.readableBytes());
+                frame.retrieveAll();
+                return;
+            }
+            // 序列化在调用线程完成，发送交回循环线程
+            auto frame = std::make_shared<muduo::net::Buffer>();
+            MuduoBuffer buf(frame.get());
+            if (_protocol->Serialize(msg, BufferFactory::Borrow(buf)) == false)
+                return;
+            auto self = shared_from_this();
+            _loop->QueueInLoop([self, frame]()
+                               { self->SendInLoop(frame->peek(), frame->readableBytes()); });
+        }
+        virtual bool Connected() override
+        {
+            return _connected;
+        }
+        // 积压的数据写完之后关闭写端，对端随后关闭连接
+        virtual void Shutdown() override
+        {
+            auto self = shared_from_this();
+            _loop->RunInLoop([self]()
+                             {
+                                 self->_shutdown_write = true;
+                                 self->TryShutdownWrite(); });
+        }
+        // 不等积压写完，直接关闭
+        void ForceClose()
+        {
+            auto self = shared_from_this();
+            _loop->RunInLoop([self]()
+                             { self->HandleClose(); });
+        }
+        virtual const BaseProtocol::ptr &Protocol() override
+        {
+            return _protocol;
+        }
+        // 需要在循环线程中、发送任何数据之前调用
+        virtual void SetHighWaterMark(size_t mark, OverloadPolicy policy, const HighWaterMarkCallback &cb) override
+        {
+            _high_water_mark = mark;
+            _policy = policy;
+            _on_high_water_mark = cb;
+        }
+        virtual bool Overloaded() override
+        {
+            return _overloaded;
+        }
+        virtual bool RejectRequests() override
+        {
+            return _overloaded && _policy != OverloadPolicy::OVERLOAD_STOP_PEER_READ;
+        }
+        virtual size_t BacklogBytes() override
+        {
+            return _backlog;
+        }
+        virtual size_t BufferBytes() override
+        {
+            return _usage.Get();
+        }
+
+        virtual void OnCompletion(int op, int res, uint32_t flags) override
+        {
+            // 回调中可能释放最后一个引用，处理完之前保持连接存活
+            ptr guard = _self;
+            switch (op)
+            {
+            case OP_RECV:
+                return OnRecv(res, flags);
+            case OP_SEND:
+                return OnSend(res);
+            case OP_CANCEL:
+                _cancels--;
+                return TryDestroy();
+            }
+        }
+
+    private:
+        enum
+        {
+            OP_RECV = 1,
+            OP_SEND,
+            OP_CANCEL
+        };
+        void ArmRecv()
+        {
+            _recv_armed = true;
+            _loop->PrepRecv(_fd, this, OP_RECV);
+        }
+        void OnRecv(int res, uint32_t flags)
+        {
+            if (flags & IORING_CQE_F_BUFFER)
+            {
+                unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                if (res > 0 && _closing == false)
+                {
+                    if (_input.get() == nullptr)
+                        _input = BufferPool::Local().Get(res);
+                    _input->append(_loop->Buffers().Data(bid), res);
+                }
+                _loop->Buffers().Recycle(bid);
+            }
+            if ((flags & IORING_CQE_F_MORE) == 0)
+            {
+                _recv_armed = false;
+                // 提供缓冲区暂时用完(-ENOBUFS)、被暂停读取时取消(-ECANCELED)都不是连接出错
+                if (res > 0 || res == -ENOBUFS || res == -ECANCELED)
+                {
+                    if (_closing == false && _paused == false)
+                        ArmRecv();
+                }
+                else
+                {
+                    if (res < 0)
+                        LOG(LogLevel::DEBUG) << "io_uring接收出错: " << strerror(-res);
+                    return HandleClose();
+                }
+            }
+            if (res > 0 && _closing == false && _input.get() != nullptr)
+            {
+                if (_quickack)
+                    SocketOps::QuickAck(_fd);
+                if (_idle_wheel != nullptr)
+                    _idle_wheel->Touch(_idle_entry);
+                MuduoBuffer input_buf(_input.get());
+                if (FrameReader::Process(shared_from_this(), BufferFactory::Borrow(input_buf), _on_message) == false)
+                    HandleClose();
+                ReleaseBuffers();
+            }
+            TryDestroy();
+        }
+        void SendInLoop(const char *data, size_t len)
+        {
+            if (_closing)
+                return;
+            if (_output.get() == nullptr)
+                _output = BufferPool::Local().Get(len);
+            _output->append(data, len);
+            UpdateBacklog();
+            if (_sending == false)
+                StartSend();
+            UpdateUsage();
+            CheckHighWaterMark();
+        }
+        // 在途的send引用_sending_buf中的数据，发完之前不能再改动它，新数据都追加到_output
+        void StartSend()
+        {
+            if (Readable(_sending_buf) == 0)
+                _sending_buf.swap(_output);
+            if (Readable(_sending_buf) == 0)
+                return;
+            _sending = true;
+            _loop->PrepSend(_fd, _sending_buf->peek(), _sending_buf->readableBytes(), this, OP_SEND);
+        }
+        void OnSend(int res)
+        {
+            _sending = false;
+            if (res < 0)
+            {
+                LOG(LogLevel::DEBUG) << "io_uring发送出错: " << strerror(-res);
+                return HandleClose();
+            }
+            if (_closing)
+                return TryDestroy();
+            _sending_buf->retrieve(res);
+            StartSend();
+            UpdateBacklog();
+            if (_backlog == 0)
+                OnWriteComplete();
+            ReleaseBuffers();
+            TryShutdownWrite();
+        }
+        void TryShutdownWrite()
+        {
+            if (_shutdown_write && _sending == false && _closing == false)
+                ::shutdown(_fd, SHUT_WR);
+        }
+        void UpdateBacklog()
+        {
+            _backlog = Readable(_output) + Readable(_sending_buf);
+        }
+        static size_t Readable(const BufferPool::BufferPtr &buf)
+        {
+            return buf.get() != nullptr ? buf->readableBytes() : 0;
+        }
+        // 读空、写空的缓冲区还给循环线程的池，还有数据的在大报文过后收缩
+        // 在途的send引用着_sending_buf，只能在发送完成之后处理
+        void ReleaseBuffers()
+        {
+            BufferPool &pool = BufferPool::Local();
+            if (_input.get() != nullptr)
+            {
+                if (_input->readableBytes() == 0)
+                    pool.Put(std::move(_input));
+                else
+                    BufferPool::Shrink(_input.get());
+            }
+            if (_output.get() != nullptr && _output->readableBytes() == 0)
+                pool.Put(std::move(_output));
+            if (_sending == false && _sending_buf.get() != nullptr && _sending_buf->readableBytes() == 0)
+                pool.Put(std::move(_sending_buf));
+            UpdateUsage();
+        }
+        void UpdateUsage()
+        {
+            _usage.Set(BufferPool::Capacity(_input) + BufferPool::Capacity(_output) + BufferPool::Capacity(_sending_buf));
+        }
+        void CheckHighWaterMark()
+        {
+            if (_high_water_mark == 0 || _overloaded || _backlog < _high_water_mark)
+                return;
+            _overloaded = true;
+            LOG(LogLevel::WARNING) << "连接发送积压超过高水位: " << _backlog << " 字节";
+            switch (_policy)
+            {
+            case OverloadPolicy::OVERLOAD_STOP_PEER_READ:
+                // 多路recv不能暂停，只能取消，积压写完后重新提交
+                _paused = true;
+                if (_recv_armed)
+                {
+                    _cancels++;
+                    _loop->PrepCancel(this, OP_RECV, this, OP_CANCEL);
+                }
+                break;
+            case OverloadPolicy::OVERLOAD_DISCONNECT:
+                HandleClose();
+                break;
+            default:
+                break;
+            }
+            if (_on_high_water_mark)
+                _on_high_water_mark(shared_from_this(), _backlog);
+        }
+        void OnWriteComplete()
+        {
+            if (_overloaded == false)
+                return;
+            _overloaded = false;
+            LOG(LogLevel::INFO) << "连接发送积压已写完，解除过载状态";
+            if (_paused)
+            {
+                _paused = false;
+                if (_recv_armed == false && _closing == false)
+                    ArmRecv();
+            }
+        }
+        // 关闭读写两端让在途的recv/send尽快完成，全部完成后才关闭fd
+        void HandleClose()
+        {
+            if (_closing == false)
+            {
+                _closing = true;
+                _connected = false;
+                ::shutdown(_fd, SHUT_RDWR);
+                if (_recv_armed)
+                {
+                    _cancels++;
+                    _loop->PrepCancel(this, OP_RECV, this, OP_CANCEL);
+                }
+            }
+            TryDestroy();
+        }
+        void TryDestroy()
+        {
+            if (_closing == false || _recv_armed || _sending || _cancels > 0 || _self.get() == nullptr)
+                return;
+            ::close(_fd);
+            _fd = -1;
+            ptr self;
+            self.swap(_self);
+            CloseCallback cb;
+            cb.swap(_on_close);
+            _on_message = MessageCallback();
+            if (cb)
+                cb(self);
+        }
+
+    private:
+        UringLoop *_loop;
+        int _fd;
+        BaseProtocol::ptr _protocol;
+        ptr _self;
+        MessageCallback _on_message;
+        CloseCallback _on_close;
+        BufferPool::BufferPtr _input;
+        BufferPool::BufferPtr _output;
+        BufferPool::BufferPtr _sending_buf;
+        std::atomic<bool> _connected;
+        bool _closing;
+        bool _recv_armed;
+        bool _sending;
+        int _cancels;
+        bool _paused;
+        bool _shutdown_write;
+        bool _quickack;
+        TimingWheel *_idle_wheel;
+        TimingWheel::WeakEntry _idle_entry;
+        size_t _high_water_mark;
+        OverloadPolicy _policy;
+        HighWaterMarkCallback _on_high_water_mark;
+        std::atomic<bool> _overloaded;
+        std::atomic<size_t> _backlog;
+        BufferUsage _usage;
+    };
+
+    // 监听套接字上常驻一个多路accept，每接受一个连接回调一次
+    class UringAcceptor : public UringLoop::Handler
+    {
+    public:
+        using ptr = std::shared_ptr<UringAcceptor>;
+        using NewConnectionCallback = std::function<void(int)>;
+        UringAcceptor(UringLoop *loop, int listenfd, const NewConnectionCallback &cb)
+            : _loop(loop), _listenfd(listenfd), _idlefd(SocketOps::OpenIdleFd()), _on_new_connection(cb) {}
+        ~UringAcceptor()
+        {
+            if (_listenfd >= 0)
+                ::close(_listenfd);
+            if (_idlefd >= 0)
+                ::close(_idlefd);
+        }
+        // 以下两个函数在循环线程中调用
+        void Listen()
+        {
+            _loop->PrepAccept(_listenfd, this, OP_ACCEPT);
+        }
+        // 取消在途的accept并关闭监听socket，之后的连接请求直接被拒绝而不是留在backlog中
+        // 被取消的accept还会回调一次，对象要活到循环退出
+        void Stop()
+        {
+            if (_listenfd < 0)
+                return;
+            _loop->PrepCancel(this, OP_ACCEPT, nullptr, 0);
+            ::close(_listenfd);
+            _listenfd = -1;
+        }
+        virtual void OnCompletion(int, int res, uint32_t flags) override
+        {
+            if (res >= 0 && _listenfd < 0)
+                ::close(res); // 已经停止，取消之前刚好完成的accept
+            else if (res >= 0)
+                _on_new_connection(res);
+            else if ((res == -EMFILE || res == -ENFILE) && _listenfd >= 0)
+            {
+                // 不处理的话重新提交的accept会立即以同样的错误完成，循环空转
+                errno = -res;
+                SocketOps::RejectWithIdleFd(_listenfd, _idlefd);
+            }
+            else if (res != -EAGAIN && res != -EINTR && res != -ECONNABORTED && res != -ECANCELED)
+                LOG(LogLevel::ERROR) << "io_uring accept失败: " << strerror(-res);
+            if ((flags & IORING_CQE_F_MORE) == 0 && res != -ECANCELED && _listenfd >= 0)
+                Listen();
+        }
+
+    private:
+        enum
+        {
+            OP_ACCEPT = 1
+        };
+        UringLoop *_loop;
+        int _listenfd;
+        int _idlefd; // 见SocketOps::OpenIdleFd
+        NewConnectionCallback _on_new_connection;
+    };
+
+    // io_uring后端的服务端，线程模型和MuduoServer相同：Start所在线程的循环负责accept，
+    // io_threads大于0时新连接按轮询分配到各个IO线程的循环上
+    // unix_path同样支持；共享内存传输依赖muduo的事件循环，这个后端上不提供
+    class UringServer : public BaseServer
+    {
+    public:
+        using ptr = std::shared_ptr<UringServer>;
+        UringServer(int port, const ServerOptions &options = ServerOptions())
+            : _port(port), _options(options),
+              _admission(options.admission ? options.admission
+                                           : AdmissionControl::Create(options.max_connections, options.max_connections_per_ip, options.accept_rate)),
+              _next(0), _stopping(false) {}
+
+        virtual void Start() override
+        {
+            if (_baseloop.Init(_options.uring_recv_buffers, _options.uring_recv_buffer_size) == false)
+            {
+                LOG(LogLevel::FATAL) << "io_uring事件循环初始化失败";
+                ::abort();
+            }
+            for (int i = 0; i < _options.io_threads; i++)
+            {
+                _threads.emplace_back(new UringLoopThread());
+                UringLoop *loop = _threads.back()->StartLoop(_options.uring_recv_buffers, _options.uring_recv_buffer_size);
+                if (loop != nullptr)
+                    _loops.push_back(loop);
+            }
+            if (_options.shm_path.empty() == false)
+                LOG(LogLevel::WARNING) << "io_uring后端不支持共享内存传输，忽略shm_path";
+            if (_options.idle_timeout_ms > 0)
+            {
+                // 和MuduoServer一样每个循环一个时间轮
+                std::vector<UringLoop *> loops = _loops;
+                loops.push_back(&_baseloop);
+                for (UringLoop *loop : loops)
+                {
+                    auto wheel = std::make_shared<TimingWheel>(_options.idle_timeout_ms);
+                    _wheels[loop] = wheel;
+                    loop->RunInLoop([loop, wheel]()
+                                    { loop->RunEvery(wheel->TickMs(), std::bind(&TimingWheel::Tick, wheel)); });
+                }
+            }
+
+            // 和MuduoServer一样，端口监听不了时直接退出
+            int tcpfd = SocketOps::ListenTcp(_port, _options.socket);
+            if (tcpfd < 0)
+            {
+                LOG(LogLevel::FATAL) << "服务端启动失败，无法监听端口: " << _port;
+                ::abort();
+            }
+            _acceptors.push_back(std::make_shared<UringAcceptor>(&_baseloop, tcpfd,
+                                                                 std::bind(&UringServer::onNewConnection, this, std::placeholders::_1, true)));
+            if (_options.unix_path.empty() == false)
+            {
+                int unixfd = SocketOps::ListenUnix(_options.unix_path);
+                if (unixfd >= 0)
+                    _acceptors.push_back(std::make_shared<UringAcceptor>(&_baseloop, unixfd,
+                                                                         std::bind(&UringServer::onNewConnection, this, std::placeholders::_1, false)));
+            }
+            _baseloop.QueueInLoop([this]()
+                                  {
+                                      for (auto &acceptor : _acceptors)
+                                          acceptor->Listen(); });
+            _baseloop.Loop();
+        }
+        virtual void StopAccept() override
+        {
+            _baseloop.RunInLoop([this]()
+                                {
+                                    for (auto &acceptor : _acceptors)
+                                        acceptor->Stop(); });
+        }
+        virtual void Stop(int timeout_ms) override
+        {
+            _baseloop.RunInLoop([this, timeout_ms]()
+                                {
+                                    if (_stopping)
+                                        return;
+                                    _stopping = true;
+                                    for (auto &acceptor : _acceptors)
+                                        acceptor->Stop();
+                                    std::vector<UringConnection::ptr> conns;
+                                    {
+                                        std::unique_lock<std::mutex> lock(_mutex);
+                                        conns.assign(_conns.begin(), _conns.end());
+                                    }
+                                    LOG(LogLevel::INFO) << "服务端停止中，等待" << conns.size() << "个连接关闭";
+                                    // 积压写完之后才关闭写端
+                                    for (auto &conn : conns)
+                                        conn->Shutdown();
+                                    _baseloop.RunAfter(timeout_ms, std::bind(&UringServer::ForceStop, this));
+                                    QuitIfDrained(); });
+        }
+
+    private:
+        // 以下两个函数在_baseloop中执行
+        void ForceStop()
+        {
+            std::vector<UringConnection::ptr> conns;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                conns.assign(_conns.begin(), _conns.end());
+            }
+            if (conns.empty() == false)
+                LOG(LogLevel::WARNING) << "停止超时，强制关闭" << conns.size() << "个连接";
+            for (auto &conn : conns)
+                conn->ForceClose();
+            _baseloop.Quit();
+        }
+        void QuitIfDrained()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_stopping && _conns.empty())
+                _baseloop.Quit();
+        }
+        // 在_baseloop中执行
+        void onNewConnection(int fd, bool tcp)
+        {
+            uint32_t ip = tcp ? SocketOps::PeerIp(fd) : 0;
+            if (_admission && _admission->Admit(ip) == false)
+                return SocketOps::Reject(fd);
+            SocketOps::ApplyConnected(fd, tcp, _options.socket);
+            UringLoop *loop = _loops.empty() ? &_baseloop : _loops[_next++ % _loops.size()];
+            auto conn = std::make_shared<UringConnection>(loop, fd, ProtocolFactory::Create(_options.max_message_size, _options.compress));
+            conn->EnableQuickAck(tcp && _options.socket.tcp_quickack);
+            loop->RunInLoop([this, conn, loop, ip]()
+                            {
+                                conn->SetHighWaterMark(_options.high_water_mark, _options.overload_policy, _on_high_water_mark);
+                                auto wheel = _wheels.find(loop);
+                                if (wheel != _wheels.end())
+                                {
+                                    std::weak_ptr<UringConnection> weak = conn;
+                                    auto entry = wheel->second->Add([weak]()
+                                                                    {
+                                                                        UringConnection::ptr conn = weak.lock();
+                                                                        if (conn && conn->Connected())
+                                                                        {
+                                                                            LOG(LogLevel::INFO) << "连接空闲超时，关闭";
+                                                                            conn->ForceClose();
+                                                                        } });
+                                    conn->SetIdleWheel(wheel->second.get(), entry);
+                                }
+                                {
+                                    std::unique_lock<std::mutex> lock(_mutex);
+                                    _conns.insert(conn);
+                                }
+                                if (_on_connection)
+                                    _on_connection(conn);
+                                conn->Start(_on_message, std::bind(&UringServer::onClose, this, std::placeholders::_1, ip)); });
+        }
+        // 在连接所属的循环中执行，ip是准入时记下的对端地址
+        void onClose(const BaseConnection::ptr &conn, uint32_t ip)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _conns.erase(std::static_pointer_cast<UringConnection>(conn));
+            }
+            if (_admission)
+                _admission->Release(ip);
+            if (_on_close)
+                _on_close(conn);
+            _baseloop.RunInLoop(std::bind(&UringServer::QuitIfDrained, this));
+        }
+
+    private:
+        int _port;
+        ServerOptions _options;
+        UringLoop _baseloop;
+        AdmissionControl::ptr _admission;
+        std::vector<std::unique_ptr<UringLoopThread>> _threads;
+        std::vector<UringLoop *> _loops;
+        std::unordered_map<UringLoop *, TimingWheel::ptr> _wheels;
+        size_t _next;
+        bool _stopping; // 只在_baseloop中访问
+        std::vector<UringAcceptor::ptr> _acceptors;
+        std::mutex _mutex;
+        std::unordered_set<UringConnection::ptr> _conns;
+    };
+
+    // io_uring后端的主动连接：connect也是异步提交的，失败后按指数退避(0.5s起，翻倍到最长30s)重试，直到Stop
+    // 和MuduoClient一样，退避时间在连接上收到数据(ResetBackoff)之后才回到0.5s，连上就断的服务端不会被频繁重连
+    // 所有函数都在循环线程中调用
+    class UringConnector : public UringLoop::Handler, public std::enable_shared_from_this<UringConnector>
+    {
+    public:
+        using ptr = std::shared_ptr<UringConnector>;
+        using NewConnectionCallback = std::function<void(int)>;
+        static constexpr int initRetryDelayMs = 500;
+        static constexpr int maxRetryDelayMs = 30 * 1000;
+
+        // ip写成"unix:/path/to/socket"时连接unix域套接字
+        UringConnector(UringLoop *loop, const std::string &ip, int port, const SocketOptions &options)
+            : _loop(loop), _options(options), _addr_len(0), _fd(-1), _stopped(true), _retry_delay_ms(initRetryDelayMs)
+        {
+            if (SocketOps::Resolve(ip, port, _addr, _addr_len) == false)
+                _addr_len = 0;
+        }
+        ~UringConnector()
+        {
+            if (_fd >= 0)
+                ::close(_fd);
+        }
+        bool IsTcp() const { return _addr.ss_family == AF_INET; }
+
+        void Start(const NewConnectionCallback &cb)
+        {
+            _on_new_connection = cb;
+            _stopped = false;
+            _retry_delay_ms = initRetryDelayMs;
+            // 手动连接取代等待中的重试
+            _loop->Cancel(_retry_timer);
+            _retry_timer = 0;
+            if (_fd < 0)
+                Connect();
+        }
+        // 在途的connect完成后直接关闭socket，等待中的重试被取消
+        void Stop()
+        {
+            _stopped = true;
+            _on_new_connection = NewConnectionCallback();
+            _loop->Cancel(_retry_timer);
+            _retry_timer = 0;
+        }
+        // 连接断开之后按当前的退避时间重新发起连接
+        void Restart()
+        {
+            if (_stopped)
+                return;
+            ScheduleRetry();
+        }
+        // 连接已经可用，下次断开后从0.5s开始重试
+        void ResetBackoff()
+        {
+            _retry_delay_ms = initRetryDelayMs;
+        }
+        virtual void OnCompletion(int, int res, uint32_t) override
+        {
+            ptr self;
+            self.swap(_self);
+            int fd = _fd;
+            _fd = -1;
+            if (_stopped)
+            {
+                ::close(fd);
+                return;
+            }
+            if (res == 0 && IsTcp() && SocketOps::IsSelfConnect(fd))
+                res = -ECONNREFUSED;
+            if (res == 0)
+            {
+                _on_new_connection(fd);
+                return;
+            }
+            LOG(LogLevel::DEBUG) << "连接服务器失败: " << strerror(-res) << "，" << _retry_delay_ms << "ms后重试";
+            ::close(fd);
+            ScheduleRetry();
+        }
+
+    private:
+        enum
+        {
+            OP_CONNECT = 1
+        };
+        void Connect()
+        {
+            if (_addr_len == 0)
+                return;
+            _fd = ::socket(_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (_fd < 0)
+            {
+                LOG(LogLevel::ERROR) << "创建socket失败: " << strerror(errno);
+                return ScheduleRetry();
+            }
+            SocketOps::ApplyBuffers(_fd, _options);
+            _self = shared_from_this(); // connect在途时不能被销毁
+            _loop->PrepConnect(_fd, reinterpret_cast<struct sockaddr *>(&_addr), _addr_len, this, OP_CONNECT);
+        }
+        void ScheduleRetry()
+        {
+            std::weak_ptr<UringConnector> weak = shared_from_this();
+            _loop->Cancel(_retry_timer);
+            _retry_timer = _loop->RunAfter(_retry_delay_ms, [weak]()
+                                           {
+                                               auto self = weak.lock();
+                                               if (self.get() == nullptr)
+                                                   return;
+                                               self->_retry_timer = 0;
+                                               if (self->_stopped == false && self->_fd < 0)
+                                                   self->Connect(); });
+            _retry_delay_ms = std::min(_retry_delay_ms * 2, maxRetryDelayMs);
+        }
+
+    private:
+        UringLoop *_loop;
+        SocketOptions _options;
+        struct sockaddr_storage _addr;
+        socklen_t _addr_len;
+        int _fd;
+        ptr _self;
+        bool _stopped;
+        int _retry_delay_ms;
+        UringLoop::TimerId _retry_timer = 0;
+        NewConnectionCallback _on_new_connection;
+    };
+
+    // io_uring后端的客户端，进程内uring_recv_buffers和uring_recv_buffer_size相同的UringClient共享一个io_uring循环线程
+    class UringClient : public BaseClient
+    {
+    public:
+        using ptr = std::shared_ptr<UringClient>;
+        UringClient(const std::string &ip, int port, const ClientOptions &options = ClientOptions())
+            : _options(options), _loop(SharedLoop(options)), _connector(std::make_shared<UringConnector>(_loop, ip, port, options.socket)) {}
+        ~UringClient()
+        {
+            // 和MuduoClient一样：循环比客户端活得久，先在循环线程中解开连接和connector上指向this的回调
+            RunInLoopAndWait([this]()
+                             {
+                                 _connector->Stop();
+                                 UringConnection::ptr conn = _conn;
+                                 if (conn)
+                                 {
+                                     conn->DetachCallbacks();
+                                     conn->ForceClose();
+                                 } });
+        }
+
+        // 超时返回false；开启了自动重连时后台会继续尝试，连上之后通过连接回调通知
+        // 和MuduoClient一样，在循环线程中调用时不等待，连接在后台建立
+        virtual bool Connect() override
+        {
+            _loop->RunInLoop([this]()
+                             { _connector->Start(std::bind(&UringClient::onNewConnection, this, std::placeholders::_1)); });
+            if (_loop->IsInLoopThread())
+                return Connected();
+            std::unique_lock<std::mutex> lock(_conn_mutex);
+            auto ready = [this]()
+            { return _conn.get() != nullptr; };
+            if (_options.connect_timeout_ms <= 0)
+                _conn_cond.wait(lock, ready);
+            else if (_conn_cond.wait_for(lock, std::chrono::milliseconds(_options.connect_timeout_ms), ready) == false)
+            {
+                lock.unlock();
+                LOG(LogLevel::ERROR) << "连接服务器超时: " << _options.connect_timeout_ms << "ms";
+                if (_options.auto_reconnect == false)
+                    RunInLoopAndWait([this]()
+                                     { _connector->Stop(); });
+                return false;
+            }
+            LOG(LogLevel::DEBUG) << "连接服务器成功";
+            return true;
+        }
+        virtual void Shutdown() override
+        {
+            RunInLoopAndWait([this]()
+                             { _connector->Stop(); });
+            BaseConnection::ptr conn = Connection();
+            if (conn)
+                conn->Shutdown();
+        }
+        virtual bool Send(const BaseMessage::ptr &msg) override
+        {
+            BaseConnection::ptr conn = Connection();
+            if (conn.get() == nullptr || conn->Connected() == false)
+            {
+                LOG(LogLevel::ERROR) << "连接已断开";
+                return false;
+            }
+            conn->Send(msg);
+            return true;
+        }
+        virtual BaseConnection::ptr Connection() override
+        {
+            std::lock_guard<std::mutex> lock(_conn_mutex);
+            return _conn;
+        }
+        virtual bool Connected() override
+        {
+            BaseConnection::ptr conn = Connection();
+            return (conn && conn->Connected());
+        }
+
+    private:
+        // 每种缓冲区配置一个循环，第一次使用时启动，进程退出时不析构
+        static UringLoop *SharedLoop(const ClientOptions &options)
+        {
+            static std::mutex mutex;
+            static std::map<std::pair<unsigned, unsigned>, UringLoop *> loops;
+            std::lock_guard<std::mutex> lock(mutex);
+            auto key = std::make_pair(options.uring_recv_buffers, options.uring_recv_buffer_size);
+            auto it = loops.find(key);
+            if (it == loops.end())
+                it = loops.emplace(key, (new UringLoopThread())->StartLoop(key.first, key.second)).first;
+            return it->second;
+        }
+        void RunInLoopAndWait(const UringLoop::Functor &cb)
+        {
+            muduo::CountDownLatch latch(1);
+            _loop->RunInLoop([&cb, &latch]()
+                             {
+                                 cb();
+                                 latch.countDown(); });
+            latch.wait();
+        }
+        // 以下函数在循环线程中执行
+        void onNewConnection(int fd)
+        {
+            SocketOps::ApplyConnected(fd, _connector->IsTcp(), _options.socket);
+            LOG(LogLevel::DEBUG) << "连接建立";
+            auto conn = std::make_shared<UringConnection>(_loop, fd, ProtocolFactory::Create(LVProtocol::defaultMaxMessageSize, _options.compress));
+            conn->EnableQuickAck(_connector->IsTcp() && _options.socket.tcp_quickack);
+            // 先Start再交出去，Connect返回之后Connected()一定为true；本轮循环结束前不会有回调
+            // 收到数据说明连接可用，重连的退避时间复位
+            UringConnector::ptr connector = _connector;
+            MessageCallback on_message = _on_message;
+            conn->Start([connector, on_message](const BaseConnection::ptr &conn, const BaseMessage::ptr &msg)
+                        {
+                            connector->ResetBackoff();
+                            if (on_message)
+                                on_message(conn, msg); },
+                        std::bind(&UringClient::onClose, this, std::placeholders::_1));
+            conn->Protocol()->Offer(_options.codec);
+            {
+                std::lock_guard<std::mutex> lock(_conn_mutex);
+                _conn = conn;
+            }
+            _conn_cond.notify_all();
+            if (_on_connection)
+                _on_connection(conn);
+        }
+        void onClose(const BaseConnection::ptr &conn)
+        {
+            LOG(LogLevel::DEBUG) << "连接断开" << (_options.auto_reconnect ? "，等待自动重连" : "");
+            {
+                std::lock_guard<std::mutex> lock(_conn_mutex);
+                if (_conn == conn)
+                    _conn.reset();
+            }
+            if (_on_close)
+                _on_close(conn);
+            if (_options.auto_reconnect)
+                _connector->Restart();
+        }
+
+    private:
+        ClientOptions _options;
+        UringLoop *_loop;
+        UringConnector::ptr _connector;
+        std::mutex _conn_mutex;
+        std::condition_variable _conn_cond;
+        UringConnection::ptr _conn;
+    };
+#endif
+}
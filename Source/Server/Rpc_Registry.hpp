@@ -18,8 +18,10 @@ namespace Rpc
                 BaseConnection::ptr conn;
                 std::mutex mutex;
                 Address host;
+                LocalAddress local; // 提供者公布的本机unix socket地址，可能为空
                 std::vector<std::string> methods;
-                Provider(const BaseConnection::ptr &conn, const Address &host) : conn(conn), host(host) {}
+                Provider(const BaseConnection::ptr &conn, const Address &host, const LocalAddress &local)
+                    : conn(conn), host(host), local(local) {}
                 void AppendMethod(const std::string &method)
                 {
                     std::lock_guard<std::mutex> lock(mutex);
@@ -27,7 +29,8 @@ namespace Rpc
                 }
             };
                 // 新的服务提供服务注册时调用
-                void AddProvider(const BaseConnection::ptr &conn, const Address &host, const std::string &method)
+                void AddProvider(const BaseConnection::ptr &conn, const Address &host, const LocalAddress &local,
+                                 const std::string &method)
                 {
                     Provider::ptr provider;
                     // 查找连接所关联的服务提供者，找到则获取，找不到则创建，并建立关联
@@ -39,7 +42,7 @@ namespace Rpc
                             provider = it->second;
                         else
                         {
-                            provider = std::make_shared<Provider>(conn, host);
+                            provider = std::make_shared<Provider>(conn, host, local);
                             _conns.insert(std::make_pair(conn, provider));
                         }
                         //???是否合理？？如果是第一个注册这个方法的客户端，那么返回的是一个
@@ -77,7 +80,8 @@ namespace Rpc
                     }
                     _conns.erase(it);
                 }
-                std::vector<Address> GetProviders(const std::string &method)
+                // locals返回和hosts一一对应的本地地址
+                std::vector<Address> GetProviders(const std::string &method, std::vector<LocalAddress> &locals)
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
                     auto it = _providers.find(method);
@@ -89,6 +93,7 @@ namespace Rpc
                         for(auto &provider : it->second)
                         {
                             hosts.emplace_back(provider->host);
+                            locals.emplace_back(provider->local);
                         }
                         return hosts;
                         //std::vector<Address> result(it->second.begin(), it->second.end());
@@ -140,7 +145,7 @@ namespace Rpc
                             discoverer = std::make_shared<Discoverer>(conn);
                             _conns.insert(std::make_pair(conn, discoverer));
                         }
-                        auto discoverers_list = _discoverers[method];
+                        auto &discoverers_list = _discoverers[method];
                         discoverers_list.insert(discoverer);
                     }
                     discoverer->AppendMethod(method);
@@ -162,17 +167,17 @@ namespace Rpc
                     _conns.erase(conn);
                 }
 
-                void OnlineNotify(const std::string &method, const Address &host)
+                void OnlineNotify(const std::string &method, const Address &host, const LocalAddress &local)
                 {
-                   return Notify(method,host,ServiceOptype::SERVICE_ONLINE);   
+                   return Notify(method,host,local,ServiceOptype::SERVICE_ONLINE);   
                 }
 
-                void OfflineNotify(const std::string &method, const Address &host)
+                void OfflineNotify(const std::string &method, const Address &host, const LocalAddress &local)
                 {
-                    return Notify(method,host,ServiceOptype::SERVICE_OFFLINE);
+                    return Notify(method,host,local,ServiceOptype::SERVICE_OFFLINE);
                 }
             private:
-                void Notify(const std::string &method, const Address &host, ServiceOptype optype)
+                void Notify(const std::string &method, const Address &host, const LocalAddress &local, ServiceOptype optype)
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
                     auto it = _discoverers.find(method);
@@ -182,7 +187,7 @@ namespace Rpc
                     auto msg_req = MessageFactory::CreateMessage<ServiceRequest>();
                     msg_req->SetId(UUID::Uuid());
                     msg_req->SetMethod(method);
-                    msg_req->SetHost(host);
+                    msg_req->SetHost(host, local);
                     msg_req->SetType(MType::REQ_SERVICE);
                     msg_req->SetOptype(optype);
                      
@@ -214,8 +219,8 @@ namespace Rpc
                     ServiceOptype optype = msg->GetOptype();
                     if(optype == ServiceOptype::SERVICE_REGISTRY)
                     {
-                        _providers->AddProvider(conn, msg->GetHost(), msg->GetMethod());
-                        _discovers->OnlineNotify(msg->GetMethod(), msg->GetHost());
+                        _providers->AddProvider(conn, msg->GetHost(), msg->GetLocalHost(), msg->GetMethod());
+                        _discovers->OnlineNotify(msg->GetMethod(), msg->GetHost(), msg->GetLocalHost());
                         return RegistryResponse(conn, msg);
                     }
                     else if(optype == ServiceOptype::SERVICE_DISCOVERY)
@@ -233,7 +238,7 @@ namespace Rpc
                     {
                         for(auto &method : provider->methods)
                         {
-                            _discovers->OfflineNotify(method, provider->host);
+                            _discovers->OfflineNotify(method, provider->host, provider->local);
                         }
                         _providers->DelProvider(conn);
                     }
@@ -262,7 +267,8 @@ namespace Rpc
                 void DiscoverResponse(const BaseConnection::ptr &conn,const ServiceRequest::ptr &msg)
                 {
                     auto msg_rsp = MessageFactory::CreateMessage<ServiceResponse>();
-                    std::vector<Address> hosts = _providers->GetProviders(msg->GetMethod());
+                    std::vector<LocalAddress> locals;
+                    std::vector<Address> hosts = _providers->GetProviders(msg->GetMethod(), locals);
                     msg_rsp->SetId(msg->GetId());
                     msg_rsp->SetType(MType::RSP_SERVICE);
                     msg_rsp->SetOptype(ServiceOptype::SERVICE_DISCOVERY);
@@ -273,7 +279,7 @@ namespace Rpc
                     }
                     
                     msg_rsp->SetRcode(RCode::RCODE_OK);
-                    msg_rsp->SetHost(hosts);   
+                    msg_rsp->SetHost(hosts, locals);   
                     msg_rsp->SetMethod(msg->GetMethod());
 
                     
@@ -2,6 +2,7 @@
 #include "../Common/Message.hpp"
 #include "../Common/Net.hpp"
 #include "../Common/Log.hpp"
+#include "../Common/Executor.hpp"
 
 namespace Rpc
 {
@@ -22,13 +23,24 @@ namespace Rpc
         public:
             using ptr = std::shared_ptr<ServerDescribe>;
             using ServiceCallback = std::function<void(const Json::Value &, Json::Value &)>;
+            // 类型化的服务：直接从请求中解码参数结构体、把结果结构体写进响应，返回响应码
+            using TypedCallback = std::function<RCode(const RpcRequest::ptr &, const RpcResponse::ptr &)>;
             using ParamDescribe = std::pair<std::string, VType>;
             ServerDescribe(std::string &&method, ServiceCallback &&callback,
                            VType &&return_type, std::vector<ParamDescribe> &&params_desc)
                 : _method(std::move(method)), _callback(std::move(callback)),
                   _return_type(std::move(return_type)), _params_desc(std::move(params_desc)) {}
+            ServerDescribe(std::string &&method, TypedCallback &&typed_callback)
+                : _method(std::move(method)), _typed_callback(std::move(typed_callback)),
+                  _return_type(VType::OBJECT) {}
 
             const std::string GetMethod() { return _method; }
+            bool Typed() const { return (bool)_typed_callback; }
+            // 参数校验在解码中完成
+            RCode CallTyped(const RpcRequest::ptr &req, const RpcResponse::ptr &rsp)
+            {
+                return _typed_callback(req, rsp);
+            }
 
             // 对收到的请求进行校验
             bool ParamCheck(const Json::Value &params)
@@ -92,6 +104,7 @@ namespace Rpc
         private:
             std::string _method;
             ServiceCallback _callback;
+            TypedCallback _typed_callback;
             std::vector<ParamDescribe> _params_desc;
             VType _return_type;
         };
@@ -110,8 +123,28 @@ namespace Rpc
                 //_params_desc.emplace_back(name,vtype);
             }
 
+            // 参数和结果都是RPC_SCHEMA声明过的结构体，代替SetCallback、SetVType和SetParamsDesc
+            // 字段的存在和类型由结构体的声明决定，不需要逐个描述
+            template <typename Req, typename Rsp>
+            void SetTypedCallback(const std::function<void(const Req &, Rsp &)> &callback)
+            {
+                static_assert(IsSchema<Req>::value && IsSchema<Rsp>::value, "Req and Rsp must be declared by RPC_SCHEMA");
+                _typed_callback = [callback](const RpcRequest::ptr &req, const RpcResponse::ptr &rsp)
+                {
+                    Req params;
+                    if (req->GetParamsAs(params) == false)
+                        return RCode::RCODE_INVALID_PARAMS;
+                    Rsp result;
+                    callback(params, result);
+                    rsp->SetResultAs(result);
+                    return RCode::RCODE_OK;
+                };
+            }
+
             ServerDescribe::ptr Build()
             {
+                if (_typed_callback)
+                    return std::make_shared<ServerDescribe>(std::move(_method), std::move(_typed_callback));
                 return std::make_shared<ServerDescribe>(std::move(_method), std::move(_callback)
                 , std::move(_return_type), std::move(_params_desc));
             }
@@ -119,6 +152,7 @@ namespace Rpc
         private:
             std::string _method;
             ServerDescribe::ServiceCallback _callback;
+            ServerDescribe::TypedCallback _typed_callback;
             std::vector<ServerDescribe::ParamDescribe> _params_desc;
             VType _return_type;
         };
@@ -159,9 +193,56 @@ namespace Rpc
         {
         public:
             using ptr = std::shared_ptr<RpcRouter>;
-            RpcRouter() : _server_manager(std::make_shared<ServerManager>()) {}
+            RpcRouter() : _server_manager(std::make_shared<ServerManager>()), _inflight(0) {}
             // 这是注册到Dispatcher模块针对RpcRequest消息的处理函数
+            // 配置了业务线程池时这里只做投递，服务回调在业务线程上执行，响应由连接交回IO线程发送
             void OnRpcRequest(const BaseConnection::ptr &conn, const RpcRequest::ptr &msg)
+            {
+                // 这个连接上的响应还积压着没写出去，不再接收新的请求
+                if (conn->RejectRequests())
+                    return Response(conn, msg, Json::Value(), RCode::RCODE_OVERLOADED);
+                _inflight++;
+                if (_workers.get() == nullptr)
+                {
+                    Process(conn, msg);
+                    return Done();
+                }
+                bool ret = _workers->Submit([this, conn, msg]()
+                                            {
+                                                Process(conn, msg);
+                                                Done(); });
+                if (ret == false)
+                {
+                    LOG(LogLevel::WARNING) << "业务线程池队列已满，拒绝请求";
+                    Response(conn, msg, Json::Value(), RCode::RCODE_OVERLOADED);
+                    return Done();
+                }
+            }
+            // 等待已经收到的请求全部处理完、响应交给连接，超过timeout_ms返回false；服务端停止时使用
+            bool WaitIdle(int timeout_ms)
+            {
+                std::unique_lock<std::mutex> lock(_idle_mutex);
+                return _idle_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]()
+                                           { return _inflight.load() == 0; });
+            }
+            size_t Inflight() const { return _inflight.load(); }
+            void RegisterMethod(const ServerDescribe::ptr &service)
+            {
+                return _server_manager->insert(service);
+            }
+            // 需要在服务端启动之前设置
+            void SetWorkerPool(const WorkerPool::ptr &workers) { _workers = workers; }
+
+        private:
+            void Done()
+            {
+                if (--_inflight == 0)
+                {
+                    std::unique_lock<std::mutex> lock(_idle_mutex);
+                    _idle_cond.notify_all();
+                }
+            }
+            void Process(const BaseConnection::ptr &conn, const RpcRequest::ptr &msg)
             {
                 // 1.收到RpcRequest消息，查询客户端请求的方法 -- 判断是否能提供服务
                 auto service = _server_manager->Select(msg->GetMethod());
@@ -170,6 +251,8 @@ namespace Rpc
                     LOG(LogLevel::DEBUG) << "服务不存在";
                     return Response(conn, msg, Json::Value(), RCode::RCODE_NOT_FOUND_SERVICE);
                 }
+                if (service->Typed())
+                    return ProcessTyped(conn, msg, service);
                 // 2.进行参数校验，确定能否提供
                 if (service->ParamCheck(msg->GetParams()) == false)
                 {
@@ -187,12 +270,21 @@ namespace Rpc
                 // 4.如果服务的回调函数返回值，则将返回值封装成RpcResponse消息，发送给客户端
                 Response(conn, msg, result, RCode::RCODE_OK);
             }
-            void RegisterMethod(const ServerDescribe::ptr &service)
+            // 类型化的服务不经过Json::Value，参数从请求直接解码成结构体，结果结构体直接编码进响应
+            void ProcessTyped(const BaseConnection::ptr &conn, const RpcRequest::ptr &msg, const ServerDescribe::ptr &service)
             {
-                return _server_manager->insert(service);
+                auto rsp = MessageFactory::CreateMessage<RpcResponse>();
+                RCode rcode = service->CallTyped(msg, rsp);
+                if (rcode != RCode::RCODE_OK)
+                {
+                    LOG(LogLevel::DEBUG) << "参数校验失败";
+                    return Response(conn, msg, Json::Value(), rcode);
+                }
+                rsp->SetId(msg->GetId());
+                rsp->SetRcode(rcode);
+                rsp->SetType(MType::RSP_RPC);
+                conn->Send(rsp);
             }
-
-        private:
             void Response(const BaseConnection::ptr &conn, const RpcRequest::ptr &req,
                           const Json::Value &result, RCode rcode)
             {
@@ -206,6 +298,12 @@ namespace Rpc
 
         private:
             ServerManager::ptr _server_manager;
+            // 正在处理(包括在业务线程池中排队)的请求数
+            std::atomic<size_t> _inflight;
+            std::mutex _idle_mutex;
+            std::condition_variable _idle_cond;
+            // 声明在最后，析构时先等待业务线程退出，再释放它们用到的成员
+            WorkerPool::ptr _workers;
         };
     }
 
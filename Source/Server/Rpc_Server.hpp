@@ -11,25 +11,28 @@ namespace Rpc
         {
         public:
             using ptr = std::shared_ptr<RegistryServer>;
-            RegistryServer(int port) : _pd_manager(std::make_shared<PDManager>()),
+            RegistryServer(int port, const ServerOptions &options = ServerOptions()) : _pd_manager(std::make_shared<PDManager>()),
                                        _dispatcher(std::make_shared<Dispatcher>())
             {
                 auto server_cb = std::bind(&PDManager::OnServiceRequest,
                                            _pd_manager, std::placeholders::_1, std::placeholders::_2);
                 _dispatcher->RegisterHandler<ServiceRequest>(MType::REQ_SERVICE, server_cb);
 
-                _server = ServerFactory::Create(port);
+                _server = ServerFactory::Create(port, options);
                 auto message_cb = std::bind(&Dispatcher::OnMessage, _dispatcher,
                                             std::placeholders::_1, std::placeholders::_2);
                 _server->SetMessageCallback(message_cb);
                 auto close_cb = std::bind(&RegistryServer::OnConnShutdown, this, std::placeholders::_1);
                 _server->SetCloseCallback(close_cb);
-                _server->Start();
             }
             void Start()
             {
                 _server->Start();
             }
+            void Stop(int timeout_ms)
+            {
+                _server->Stop(timeout_ms);
+            }
 
         private:
             void OnConnShutdown(const BaseConnection::ptr &conn)
@@ -48,22 +51,36 @@ namespace Rpc
         public:
             using ptr = std::shared_ptr<RpcServer>;
 
+            // registry_options用于连接注册中心，和RpcClient一样只沿用消息体编码和压缩
             RpcServer(const Address &access_addr, bool enableRegistry = false,
-                      const Address &registry_addr = Address()) : _router(std::make_shared<RpcRouter>()),
+                      const Address &registry_addr = Address(),
+                      const ServerOptions &options = ServerOptions(),
+                      const ClientOptions &registry_options = ClientOptions()) : _router(std::make_shared<RpcRouter>()),
                                                                   _dispatcher(std::make_shared<Dispatcher>()),
                                                                   _enableregistry(enableRegistry),
                                                                   _access_addr(access_addr)
             {
+                // 同时监听unix socket时把它公布给注册中心，同一台机器上的调用方会自动改用它
+                if (options.unix_path.empty() == false)
+                    _local_addr = LocalAddress(Host::Name(), options.unix_path);
                 if (enableRegistry)
                 {
+                    ClientOptions reg_options;
+                    reg_options.codec = registry_options.codec;
+                    reg_options.compress = registry_options.compress;
                     _reg_client = std::make_shared<Client::RegistryClient>(
-                        registry_addr.first, registry_addr.second);
+                        registry_addr.first, registry_addr.second, reg_options);
+                }
+                if (options.worker_threads > 0)
+                {
+                    _router->SetWorkerPool(std::make_shared<WorkerPool>(options.worker_threads,
+                                                                        options.worker_queue_size));
                 }
                 auto server_cb = std::bind(&RpcRouter::OnRpcRequest, _router,
                                            std::placeholders::_1, std::placeholders::_2);
                 _dispatcher->RegisterHandler<RpcRequest>(MType::REQ_RPC, server_cb);
 
-                _server = ServerFactory::Create(access_addr.second);
+                _server = ServerFactory::Create(access_addr.second, options);
                 auto message_cb = std::bind(&Dispatcher::OnMessage, _dispatcher,
                                             std::placeholders::_1, std::placeholders::_2);
                 _server->SetMessageCallback(message_cb);
@@ -72,7 +89,7 @@ namespace Rpc
             {
                 if (_enableregistry)
                 {
-                    _reg_client->RegisterMethod(service->GetMethod(), _access_addr);
+                    _reg_client->RegisterMethod(service->GetMethod(), _access_addr, _local_addr);
                 }
                 _router->RegisterMethod(service);
             }
@@ -80,10 +97,28 @@ namespace Rpc
             {
                 _server->Start();
             }
+            // 优雅停止(滚动发布时使用)，可以在任意线程调用，Start随后返回：
+            // 1.断开和注册中心的连接，注册中心通知调用方这个提供者已经下线
+            // 2.不再接受新连接，已有连接上的请求照常处理
+            // 3.等待在途的请求处理完
+            // 4.发送缓冲区写空之后关闭连接，退出事件循环
+            // 2到4总共最多等待timeout_ms
+            void Stop(int timeout_ms)
+            {
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+                if (_enableregistry)
+                    _reg_client->Shutdown();
+                _server->StopAccept();
+                if (_router->WaitIdle(timeout_ms) == false)
+                    LOG(LogLevel::WARNING) << "等待在途请求超时，还有" << _router->Inflight() << "个请求没有处理完";
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                _server->Stop(std::max<int>(0, (int)left.count()));
+            }
 
         private:
             bool _enableregistry;
             Address _access_addr;
+            LocalAddress _local_addr;
             RpcRouter::ptr _router;
             Client::RegistryClient::ptr _reg_client;
             Dispatcher::ptr _dispatcher;
@@ -94,14 +129,14 @@ namespace Rpc
         {
         public:
             using ptr = std::shared_ptr<TopicServer>;
-            TopicServer(int port) : _topic_manager(std::make_shared<TopicManager>()),
+            TopicServer(int port, const ServerOptions &options = ServerOptions()) : _topic_manager(std::make_shared<TopicManager>()),
                                     _dispatcher(std::make_shared<Dispatcher>())
             {
                 auto topic_cb = std::bind(&TopicManager::OnTopicRequest,
                                            _topic_manager, std::placeholders::_1, std::placeholders::_2);
                 _dispatcher->RegisterHandler<TopicRequest>(MType::REQ_TOPIC, topic_cb); 
 
-                _server = ServerFactory::Create(port);
+                _server = ServerFactory::Create(port, options);
                 auto message_cb = std::bind(&Dispatcher::OnMessage, _dispatcher,
                                             std::placeholders::_1, std::placeholders::_2);
                 _server->SetMessageCallback(message_cb);
@@ -117,6 +152,10 @@ namespace Rpc
             {
                 _server->Start();
             }
+            void Stop(int timeout_ms)
+            {
+                _server->Stop(timeout_ms);
+            }
 
         private:
             void OnConnShutdown(const BaseConnection::ptr &conn)
@@ -20,6 +20,8 @@ namespace Rpc
                 // 主题的订阅
                 // 主题的取消订阅
                 // 主题消息的发布
+                if (conn->RejectRequests())
+                    return ErrorResponse(conn, msg, RCode::RCODE_OVERLOADED);
                 TopicOptype topic_optype = msg->GetOptype();
                 bool ret = true;
                 switch (topic_optype)
@@ -73,13 +75,31 @@ namespace Rpc
             }
 
 
+            static constexpr int64_t dropLogIntervalUs = 1000000;
             struct Subscriber
             {
                 using ptr = std::shared_ptr<Subscriber>;
                 std::unordered_set<std::string> topics;
                 std::mutex mutex;
                 BaseConnection::ptr conn;
+                std::atomic<uint64_t> dropped{0}; // 积压过多时被丢弃的主题消息总数
+                uint64_t dropped_since_log = 0;
+                int64_t last_log_us = 0;
                 Subscriber(const BaseConnection::ptr &conn) : conn(conn) {}
+                // 记一次丢弃；每个订阅者每秒最多汇总一条日志，需要打日志时返回上次日志之后丢弃的条数，否则返回0
+                uint64_t Drop()
+                {
+                    dropped++;
+                    std::unique_lock<std::mutex> lock(mutex);
+                    dropped_since_log++;
+                    int64_t now = Clock::NowUs();
+                    if (now - last_log_us < dropLogIntervalUs)
+                        return 0;
+                    uint64_t count = dropped_since_log;
+                    dropped_since_log = 0;
+                    last_log_us = now;
+                    return count;
+                }
                 void AppendTopic(const std::string &topic_name)
                 {
                     std::unique_lock<std::mutex> lock(mutex);
@@ -113,17 +133,28 @@ namespace Rpc
 
                 void Publish(const BaseMessage::ptr &msg)
                 {
-                    std::unique_lock<std::mutex> lock(mutex);
-                    for (auto &subscriber : subscribers)
+                    std::vector<std::pair<Subscriber::ptr, uint64_t>> drops;
                     {
-                        for (auto &topic_name : subscriber->topics)
+                        std::unique_lock<std::mutex> lock(mutex);
+                        // 在subscribers集合中就说明订阅了该主题(取消订阅时会同时从集合中移除)
+                        // 不再遍历subscriber->topics，多IO线程下它可能正被其他线程修改
+                        for (auto &subscriber : subscribers)
                         {
-                            if (topic_name == this->topic_name)
+                            // 慢订阅者的积压超过高水位时丢弃发给它的消息，不让它拖垮整个服务端的内存
+                            if (subscriber->conn->Overloaded())
                             {
-                                subscriber->conn->Send(msg);
+                                uint64_t count = subscriber->Drop();
+                                if (count > 0)
+                                    drops.emplace_back(subscriber, count);
+                                continue;
                             }
+                            subscriber->conn->Send(msg);
                         }
                     }
+                    // 日志在锁外打，不拖慢同一主题上的其他发布
+                    for (auto &drop : drops)
+                        LOG(LogLevel::WARNING) << "订阅者积压过多，最近一段时间丢弃了" << drop.second << "条主题消息: "
+                                               << topic_name << "，累计丢弃" << drop.first->dropped.load();
                 }
             };
 
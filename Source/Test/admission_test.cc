@@ -0,0 +1,196 @@
+// 连接准入控制的测试：三项上限各自的判断、关闭后归还名额，以及服务端在accept之后直接关闭被拒绝的连接
+// 用法：./admission_test [muduo|io_uring]，不带参数时两个后端都测(不支持io_uring的环境退回muduo)
+#include "../Common/Net.hpp"
+#include <thread>
+
+using namespace Rpc;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static int64_t NowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 向内核要一个当前空闲的端口
+static int FreePort()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    ::getsockname(fd, (struct sockaddr *)&addr, &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// 等cond成立，最多等timeout_ms
+template <typename F>
+static bool WaitFor(int timeout_ms, F &&cond)
+{
+    int64_t deadline = NowMs() + timeout_ms;
+    while (cond() == false)
+    {
+        if (NowMs() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+// 阻塞地连上本机端口，失败返回-1
+static int ConnectTo(int port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// timeout_ms之内对端关闭了连接(读到EOF或RST)
+static bool ClosedByPeer(int fd, int timeout_ms)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (::poll(&pfd, 1, timeout_ms) <= 0)
+        return false;
+    char c;
+    return ::recv(fd, &c, 1, 0) <= 0;
+}
+
+// 在后台线程中运行的服务端
+class TestServer
+{
+public:
+    TestServer(int port, const ServerOptions &options)
+    {
+        _server = ServerFactory::Create(port, options);
+        _thread = std::thread([this]()
+                              { _server->Start(); });
+    }
+    ~TestServer()
+    {
+        _server->Stop(0);
+        _thread.join();
+    }
+
+private:
+    BaseServer::ptr _server;
+    std::thread _thread;
+};
+
+// 三项都不限制时不创建；连接总数和单个IP的上限，关闭后归还名额
+static void TestLimits()
+{
+    CHECK(AdmissionControl::Create(0, 0, 0).get() == nullptr);
+
+    AdmissionControl total(2, 0, 0);
+    CHECK(total.Admit(1));
+    CHECK(total.Admit(2));
+    CHECK(total.Admit(3) == false);
+    CHECK(total.Connections() == 2 && total.Rejected() == 1);
+    total.Release(1);
+    CHECK(total.Admit(3));
+    CHECK(total.Connections() == 2);
+
+    uint32_t a = htonl(0x0A000001), b = htonl(0x0A000002);
+    AdmissionControl per_ip(0, 2, 0);
+    CHECK(per_ip.Admit(a));
+    CHECK(per_ip.Admit(a));
+    CHECK(per_ip.Admit(a) == false);
+    CHECK(per_ip.Admit(b));
+    // unix域套接字不按IP限制
+    CHECK(per_ip.Admit(0) && per_ip.Admit(0) && per_ip.Admit(0));
+    per_ip.Release(a);
+    CHECK(per_ip.Admit(a));
+    CHECK(per_ip.Rejected() == 1);
+}
+
+// 新建连接速率：一秒的突发用完之后拒绝，令牌随时间补充
+static void TestRate()
+{
+    AdmissionControl rate(0, 0, 50);
+    int admitted = 0;
+    for (int i = 0; i < 100; i++)
+        admitted += rate.Admit(0) ? 1 : 0;
+    // 循环期间补充的令牌不到一个，机器很慢时允许多出几个
+    CHECK(admitted >= 50 && admitted < 55);
+    CHECK(rate.Rejected() == (uint64_t)(100 - admitted));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(rate.Admit(0));
+}
+
+// 连接数达到上限时，新连接在accept之后被直接关闭，已有连接不受影响；已有连接关闭后又能连上
+static void TestServerReject(NetBackend backend)
+{
+    int port = FreePort();
+    ServerOptions options;
+    options.backend = backend;
+    options.admission = std::make_shared<AdmissionControl>(1, 0, 0);
+    AdmissionControl::ptr admission = options.admission;
+    TestServer server(port, options);
+    int first = -1;
+    WaitFor(2000, [&]()
+            { return (first = ConnectTo(port)) >= 0; });
+    CHECK(first >= 0);
+    CHECK(WaitFor(2000, [&]()
+                  { return admission->Connections() == 1; }));
+
+    int second = ConnectTo(port);
+    CHECK(second >= 0);
+    CHECK(ClosedByPeer(second, 2000));
+    CHECK(admission->Rejected() == 1);
+    CHECK(ClosedByPeer(first, 100) == false);
+    ::close(second);
+
+    ::close(first);
+    CHECK(WaitFor(2000, [&]()
+                  { return admission->Connections() == 0; }));
+    int third = ConnectTo(port);
+    CHECK(third >= 0);
+    CHECK(WaitFor(2000, [&]()
+                  { return admission->Connections() == 1; }));
+    CHECK(ClosedByPeer(third, 100) == false);
+    CHECK(admission->Rejected() == 1);
+    ::close(third);
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::pair<std::string, NetBackend>> backends = {{"muduo", NetBackend::BACKEND_MUDUO},
+                                                                {"io_uring", NetBackend::BACKEND_IO_URING}};
+    TestLimits();
+    TestRate();
+    for (auto &backend : backends)
+    {
+        if (argc > 1 && backend.first != argv[1])
+            continue;
+        TestServerReject(backend.second);
+    }
+    if (failures != 0)
+    {
+        std::cerr << "admission_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "admission_test: 通过" << std::endl;
+    return 0;
+}
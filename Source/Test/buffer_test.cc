@@ -0,0 +1,119 @@
+// 连接缓冲区池的测试：按容量分档借还、每档的缓存上限、超过最大一档的缓冲区不入池，
+// 峰值过后的收缩，以及连接和池两项内存统计
+#include "../Common/Net.hpp"
+
+using namespace Rpc;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+// 还回去的缓冲区被下一次Get复用，数据被清空；能放下hint的缓冲区才会被取出
+static void TestReuse()
+{
+    BufferPool pool;
+    int64_t pooled = BufferStats::PooledBytes();
+    BufferPool::BufferPtr buf = pool.Get(10000);
+    CHECK(buf->writableBytes() >= 10000);
+    buf->append("hello", 5);
+    muduo::net::Buffer *raw = buf.get();
+    size_t capacity = buf->internalCapacity();
+    pool.Put(std::move(buf));
+    CHECK(BufferStats::PooledBytes() == pooled + (int64_t)capacity);
+
+    // 比它小的请求可以用它
+    BufferPool::BufferPtr again = pool.Get(100);
+    CHECK(again.get() == raw);
+    CHECK(again->readableBytes() == 0);
+    CHECK(BufferStats::PooledBytes() == pooled);
+    pool.Put(std::move(again));
+
+    // 比它所在的档大的请求不用它，新建一个
+    BufferPool::BufferPtr bigger = pool.Get(40000);
+    CHECK(bigger.get() != raw);
+    CHECK(bigger->writableBytes() >= 40000);
+    pool.Put(std::move(bigger));
+    pool.Put(BufferPool::BufferPtr());
+}
+
+// 超过最大一档的缓冲区直接释放；每档缓存的个数有上限，多出来的直接释放
+static void TestLimits()
+{
+    int64_t pooled = BufferStats::PooledBytes();
+    {
+        BufferPool pool;
+        BufferPool::BufferPtr huge = pool.Get(1 << 20);
+        pool.Put(std::move(huge));
+        CHECK(BufferStats::PooledBytes() == pooled);
+
+        std::vector<BufferPool::BufferPtr> bufs;
+        for (int i = 0; i < 100; i++)
+            bufs.push_back(pool.Get(20 << 10));
+        size_t capacity = bufs[0]->internalCapacity();
+        for (auto &buf : bufs)
+            pool.Put(std::move(buf));
+        int64_t kept = BufferStats::PooledBytes() - pooled;
+        CHECK(kept > 0 && kept < (int64_t)(100 * capacity));
+    }
+    // 池析构时归还统计
+    CHECK(BufferStats::PooledBytes() == pooled);
+}
+
+// 容量超过阈值、可读数据不到1/4时收缩到刚好放下剩余数据，否则不动
+static void TestShrink()
+{
+    muduo::net::Buffer buf;
+    std::string data(1 << 20, 'x');
+    buf.append(data.data(), data.size());
+    BufferPool::Shrink(&buf);
+    CHECK(buf.internalCapacity() >= data.size());
+    buf.retrieve(data.size() - 100);
+    BufferPool::Shrink(&buf);
+    CHECK(buf.internalCapacity() < BufferPool::shrinkThreshold);
+    CHECK(buf.readableBytes() == 100);
+    CHECK(buf.retrieveAllAsString() == std::string(100, 'x'));
+
+    muduo::net::Buffer small;
+    small.append("abc", 3);
+    size_t capacity = small.internalCapacity();
+    BufferPool::Shrink(&small);
+    CHECK(small.internalCapacity() == capacity);
+}
+
+// 每个连接的占用变化累加到总数，连接析构时减掉
+static void TestUsage()
+{
+    int64_t total = BufferStats::ConnectionBytes();
+    {
+        BufferUsage a, b;
+        a.Set(1000);
+        b.Set(500);
+        CHECK(BufferStats::ConnectionBytes() == total + 1500);
+        a.Set(200);
+        CHECK(a.Get() == 200);
+        CHECK(BufferStats::ConnectionBytes() == total + 700);
+    }
+    CHECK(BufferStats::ConnectionBytes() == total);
+}
+
+int main()
+{
+    TestReuse();
+    TestLimits();
+    TestShrink();
+    TestUsage();
+    if (failures != 0)
+    {
+        std::cerr << "buffer_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "buffer_test: 通过" << std::endl;
+    return 0;
+}
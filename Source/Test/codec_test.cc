@@ -0,0 +1,265 @@
+// 消息体二进制编码(JsonBinary)和JSON的往返测试：各种类型的值编码后解码回原值，
+// 二进制编码的帧和JSON编码的帧解析出同样的消息，截断和损坏的数据被拒绝而不会崩溃，
+// 以及附在第一条请求上的编码协商提议
+#include "../Common/Net.hpp"
+
+using namespace Rpc;
+
+namespace demo
+{
+    struct Point
+    {
+        int32_t x;
+        double y;
+    };
+    struct AddReq
+    {
+        int num1;
+        int num2;
+        std::string tag;
+        std::vector<Point> pts;
+    };
+}
+RPC_SCHEMA(demo::Point, x, y)
+RPC_SCHEMA(demo::AddReq, num1, num2, tag, pts)
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static Json::Value SampleValue()
+{
+    Json::Value val;
+    val[KEY_METHOD] = "Add";
+    Json::Value &params = val[KEY_PARAMS];
+    params["zero"] = 0;
+    params["neg"] = -5;
+    params["int64_min"] = Json::Int64(INT64_MIN);
+    params["int64_max"] = Json::Int64(INT64_MAX);
+    params["uint64_max"] = Json::UInt64(UINT64_MAX);
+    params["real"] = 3.25;
+    params["tiny"] = -1e-300;
+    params["flag"] = true;
+    params["off"] = false;
+    params["null"] = Json::Value();
+    params["nul"] = std::string("a\0b", 3);
+    params["utf8"] = "中文";
+    params["empty_str"] = "";
+    params["empty_arr"] = Json::Value(Json::arrayValue);
+    params["empty_obj"] = Json::Value(Json::objectValue);
+    params["long"] = std::string(100000, 'z');
+    for (int i = 0; i < 10; i++)
+        params["list"].append(i % 2 ? Json::Value(i * 1.5) : Json::Value(std::to_string(i)));
+    params["nested"]["a"]["b"]["c"].append(Json::Value(Json::objectValue));
+    return val;
+}
+
+static RpcRequest::ptr MakeRequest(const std::string &id)
+{
+    auto msg = MessageFactory::CreateMessage<RpcRequest>();
+    msg->SetId(id);
+    msg->SetType(MType::REQ_RPC);
+    msg->SetMethod("Add");
+    msg->SetParams(SampleValue()[KEY_PARAMS]);
+    return msg;
+}
+
+// 把一条消息的全部报文(超过单帧上限时是多个分片)交给接收端的协议对象
+static BaseMessage::ptr Parse(LVProtocol &protocol, const std::string &frames)
+{
+    muduo::net::Buffer buf;
+    MuduoBuffer mbuf(&buf);
+    BaseBuffer::ptr buffer = BufferFactory::Borrow(mbuf);
+    buf.append(frames.data(), frames.size());
+    BaseMessage::ptr msg;
+    while (msg.get() == nullptr && protocol.IsProcessable(buffer))
+    {
+        if (protocol.OnMessage(buffer, msg) == false)
+            return BaseMessage::ptr();
+    }
+    return msg;
+}
+
+static uint32_t TypeField(const std::string &frame)
+{
+    uint32_t be32 = 0;
+    memcpy(&be32, frame.data() + 4, 4);
+    return ntohl(be32);
+}
+
+// 各种类型的值编码后解码回原值
+static void TestValues()
+{
+    Json::Value val = SampleValue();
+    std::string bin;
+    JsonBinary::Encode(val, bin);
+    Json::Value out;
+    CHECK(JsonBinary::Decode(bin, out));
+    CHECK(out == val);
+    CHECK(out[KEY_PARAMS]["int64_min"].asInt64() == INT64_MIN);
+    CHECK(out[KEY_PARAMS]["uint64_max"].asUInt64() == UINT64_MAX);
+    CHECK(out[KEY_PARAMS]["nul"].asString() == std::string("a\0b", 3));
+    CHECK(JsonBinary::IsObject(bin));
+
+    // 和JSON文本往返的结果一致，协议字段的键名不占空间，编码结果更短
+    std::string text;
+    CHECK(JSON::Serialize(val, text));
+    Json::Value from_text;
+    CHECK(JSON::Deserialize(text, from_text));
+    CHECK(from_text == out);
+    CHECK(bin.size() < text.size());
+}
+
+// 截断和损坏的数据返回false，不会越界读
+static void TestMalformed()
+{
+    Json::Value val = SampleValue();
+    val[KEY_PARAMS].removeMember("long");
+    std::string bin;
+    JsonBinary::Encode(val, bin);
+    for (size_t len = 0; len < bin.size(); len++)
+    {
+        Json::Value out;
+        CHECK(JsonBinary::Decode(std::string_view(bin.data(), len), out) == false);
+    }
+    Json::Value out;
+    CHECK(JsonBinary::Decode(bin + "x", out) == false);
+    // 逐字节改写：结果可能合法也可能不合法，只要求不崩溃
+    for (size_t i = 0; i < bin.size(); i++)
+    {
+        std::string bad = bin;
+        bad[i] = (char)(bad[i] ^ 0xA5);
+        Json::Value tmp;
+        JsonBinary::Decode(bad, tmp);
+    }
+    // 嵌套过深
+    Json::Value nested;
+    Json::Value *cur = &nested;
+    for (int i = 0; i < 1000; i++)
+        cur = &cur->append(Json::Value(Json::arrayValue));
+    std::string deep;
+    JsonBinary::Encode(nested, deep);
+    CHECK(JsonBinary::Decode(deep, out) == false);
+}
+
+// 同一条消息分别用两种编码发送，接收端按帧头的标志位解码出相同的内容
+static void TestProtocol()
+{
+    LVProtocol json_sender, binary_sender, receiver;
+    binary_sender.SetCodec(Codec::CODEC_BINARY);
+    auto req = MakeRequest("codec-1");
+    std::string json_frame = json_sender.Serialize(req);
+    std::string binary_frame = binary_sender.Serialize(req);
+    CHECK(json_frame.empty() == false && binary_frame.empty() == false);
+    CHECK(TypeField(binary_frame) != TypeField(json_frame));
+    CHECK((MType)(TypeField(binary_frame) & 0xFFFF) == MType::REQ_RPC);
+    auto from_json = std::dynamic_pointer_cast<RpcRequest>(Parse(receiver, json_frame));
+    auto from_binary = std::dynamic_pointer_cast<RpcRequest>(Parse(receiver, binary_frame));
+    CHECK(from_json.get() != nullptr && from_binary.get() != nullptr);
+    if (from_json.get() == nullptr || from_binary.get() == nullptr)
+        return;
+    CHECK(from_binary->Check());
+    CHECK(from_binary->GetId() == "codec-1");
+    CHECK(from_binary->GetMethod() == from_json->GetMethod());
+    CHECK(from_binary->GetParams() == from_json->GetParams());
+    CHECK(from_binary->GetParams() == req->GetParams());
+
+    // 消息体被截断的二进制帧(长度字段改成和截断后一致)解析失败，由调用者断开连接
+    auto small = MessageFactory::CreateMessage<RpcRequest>();
+    small->SetId("codec-2");
+    small->SetType(MType::REQ_RPC);
+    small->SetMethod("Add");
+    Json::Value small_params;
+    small_params["num"] = 42;
+    small->SetParams(small_params);
+    std::string broken = binary_sender.Serialize(small);
+    CHECK(Parse(receiver, broken).get() != nullptr);
+    broken.resize(broken.size() - 1);
+    uint32_t be32 = htonl(broken.size() - 4);
+    memcpy(&broken[0], &be32, 4);
+    CHECK(Parse(receiver, broken).get() == nullptr);
+}
+
+// 类型化的参数：二进制编码的连接上原样发出，JSON编码时展开，两端都能取回同样的结构体
+static void TestTyped()
+{
+    demo::AddReq params{3, -4, "typed", {{1, 2.5}, {-3, 0}}};
+    auto req = MessageFactory::CreateMessage<RpcRequest>();
+    req->SetId("typed-1");
+    req->SetType(MType::REQ_RPC);
+    req->SetMethod("Add");
+    req->SetParamsAs(params);
+    LVProtocol json_sender, binary_sender, receiver;
+    binary_sender.SetCodec(Codec::CODEC_BINARY);
+    for (LVProtocol *sender : {&json_sender, &binary_sender})
+    {
+        auto msg = std::dynamic_pointer_cast<RpcRequest>(Parse(receiver, sender->Serialize(req)));
+        CHECK(msg.get() != nullptr);
+        if (msg.get() == nullptr)
+            continue;
+        CHECK(msg->Check());
+        demo::AddReq out{};
+        CHECK(msg->GetParamsAs(out));
+        CHECK(out.num1 == 3 && out.num2 == -4 && out.tag == "typed");
+        CHECK(out.pts.size() == 2 && out.pts[0].y == 2.5 && out.pts[1].x == -3);
+        CHECK(msg->GetParams()["tag"].asString() == "typed");
+    }
+}
+
+// 协商提议只附在第一条请求上，以JSON发出；接收端取出提议后请求和没有提议时一样
+static void TestOffer()
+{
+    LVProtocol sender, receiver;
+    sender.Offer(Codec::CODEC_BINARY);
+    // 响应不带提议
+    auto rsp = MessageFactory::CreateMessage<RpcResponse>();
+    rsp->SetId("rsp");
+    rsp->SetType(MType::RSP_RPC);
+    rsp->SetRcode(RCode::RCODE_OK);
+    CHECK(sender.Serialize(rsp).find(KEY_NEGOTIATE) == std::string::npos);
+
+    auto req = MakeRequest("offer-1");
+    std::string first = sender.Serialize(req);
+    std::string second = sender.Serialize(req);
+    CHECK(first.find(KEY_NEGOTIATE) != std::string::npos);
+    CHECK(second.find(KEY_NEGOTIATE) == std::string::npos);
+    // 发送的消息对象没有被修改
+    CHECK(req->Serialize().find(KEY_NEGOTIATE) == std::string::npos);
+
+    auto msg = std::dynamic_pointer_cast<RpcRequest>(Parse(receiver, first));
+    CHECK(msg.get() != nullptr);
+    if (msg.get() == nullptr)
+        return;
+    // 不认识提议的老版本对端看到的请求依然合法
+    CHECK(msg->Check());
+    auto offer = MessageFactory::CreateMessage<HeartbeatMessage>();
+    CHECK(msg->TakeOffer(*offer));
+    CHECK(offer->Check());
+    Codec codec = Codec::CODEC_JSON;
+    CHECK(offer->GetCodecOffer(codec) && codec == Codec::CODEC_BINARY);
+    CHECK(msg->TakeOffer(*offer) == false);
+    CHECK(msg->GetParams() == req->GetParams());
+}
+
+int main()
+{
+    TestValues();
+    TestMalformed();
+    TestProtocol();
+    TestTyped();
+    TestOffer();
+    if (failures != 0)
+    {
+        std::cerr << "codec_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "codec_test: 通过" << std::endl;
+    return 0;
+}
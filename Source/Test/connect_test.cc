@@ -0,0 +1,180 @@
+// 客户端主动连接的测试：连接被拒绝、连接超时、自连接的识别、服务端重启后的自动重连
+// 用法：./connect_test [muduo|io_uring]，不带参数时两个后端都测(不支持io_uring的环境退回muduo)
+#include "../Common/Net.hpp"
+#include <thread>
+
+using namespace Rpc;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static int64_t NowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 向内核要一个当前空闲的端口
+static int FreePort()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    ::getsockname(fd, (struct sockaddr *)&addr, &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// 等cond成立，最多等timeout_ms
+template <typename F>
+static bool WaitFor(int timeout_ms, F &&cond)
+{
+    int64_t deadline = NowMs() + timeout_ms;
+    while (cond() == false)
+    {
+        if (NowMs() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+// 在后台线程中运行的服务端
+class TestServer
+{
+public:
+    TestServer(int port, NetBackend backend)
+    {
+        ServerOptions options;
+        options.backend = backend;
+        _server = ServerFactory::Create(port, options);
+        _thread = std::thread([this]()
+                              { _server->Start(); });
+    }
+    ~TestServer()
+    {
+        _server->Stop(0);
+        _thread.join();
+    }
+
+private:
+    BaseServer::ptr _server;
+    std::thread _thread;
+};
+
+// 没有监听的端口：Connect在超时之后返回false，不会提前返回true，也不会一直阻塞
+static void TestRefused(NetBackend backend)
+{
+    ClientOptions options;
+    options.backend = backend;
+    options.connect_timeout_ms = 500;
+    options.auto_reconnect = false;
+    auto client = ClientFactory::Create("127.0.0.1", FreePort(), options);
+    int64_t start = NowMs();
+    CHECK(client->Connect() == false);
+    int64_t elapsed = NowMs() - start;
+    CHECK(elapsed >= 400 && elapsed < 3000);
+    CHECK(client->Connected() == false);
+}
+
+// 不可路由的地址上握手一直没有结果(或者立即报网络不可达)，Connect都按connect_timeout_ms返回
+static void TestTimeout(NetBackend backend)
+{
+    ClientOptions options;
+    options.backend = backend;
+    options.connect_timeout_ms = 300;
+    options.auto_reconnect = false;
+    auto client = ClientFactory::Create("10.255.255.1", 9, options);
+    int64_t start = NowMs();
+    CHECK(client->Connect() == false);
+    int64_t elapsed = NowMs() - start;
+    CHECK(elapsed >= 250 && elapsed < 3000);
+}
+
+// socket绑定到它要连接的地址上时内核让它连上自己，必须被识别出来；正常的连接不受影响
+static void TestSelfConnect()
+{
+    int port = FreePort();
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    CHECK(::bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    CHECK(::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    CHECK(SocketOps::IsSelfConnect(fd));
+    ::close(fd);
+
+    int listenfd = SocketOps::ListenTcp(port, SocketOptions());
+    CHECK(listenfd >= 0);
+    fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    CHECK(SocketOps::IsSelfConnect(fd) == false);
+    ::close(fd);
+    ::close(listenfd);
+}
+
+// 服务端停止后客户端发现断开，服务端在同一端口重新启动后客户端自动连上
+static void TestReconnect(NetBackend backend)
+{
+    int port = FreePort();
+    std::atomic<int> connected(0), closed(0);
+    ClientOptions options;
+    options.backend = backend;
+    options.connect_timeout_ms = 3000;
+    auto client = ClientFactory::Create("127.0.0.1", port, options);
+    client->SetConnectionCallback([&](const BaseConnection::ptr &)
+                                  { connected++; });
+    client->SetCloseCallback([&](const BaseConnection::ptr &)
+                             { closed++; });
+    {
+        TestServer server(port, backend);
+        CHECK(client->Connect());
+        CHECK(connected == 1);
+    }
+    CHECK(WaitFor(3000, [&]()
+                  { return client->Connected() == false; }));
+    CHECK(closed == 1);
+    {
+        TestServer server(port, backend);
+        CHECK(WaitFor(10000, [&]()
+                      { return client->Connected(); }));
+        CHECK(connected == 2);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::pair<std::string, NetBackend>> backends = {{"muduo", NetBackend::BACKEND_MUDUO},
+                                                                {"io_uring", NetBackend::BACKEND_IO_URING}};
+    TestSelfConnect();
+    for (auto &backend : backends)
+    {
+        if (argc > 1 && backend.first != argv[1])
+            continue;
+        TestRefused(backend.second);
+        TestTimeout(backend.second);
+        TestReconnect(backend.second);
+    }
+    if (failures != 0)
+    {
+        std::cerr << "connect_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "connect_test: 通过" << std::endl;
+    return 0;
+}
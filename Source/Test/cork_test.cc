@@ -0,0 +1,170 @@
+// 写合并(cork_writes)的测试：一次写入的一批请求，响应在IO线程里攒起来合并写出，
+// 每个响应都完整、内容正确；业务线程池处理时响应从其他线程交回，同样一个不少
+// 用法：./cork_test [muduo]，只有muduo后端支持写合并
+#include "../Server/Rpc_Server.hpp"
+#include <thread>
+#include <set>
+
+using namespace Rpc;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static const int requestCount = 500;
+
+static int64_t NowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 向内核要一个当前空闲的端口
+static int FreePort()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    ::getsockname(fd, (struct sockaddr *)&addr, &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// 阻塞地连上本机端口，服务端还没开始监听时重试，失败返回-1
+static int ConnectTo(int port, int timeout_ms)
+{
+    int64_t deadline = NowMs() + timeout_ms;
+    while (NowMs() < deadline)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        ::close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+// 在后台线程中运行的RpcServer，方法Add返回num1+num2
+class TestServer
+{
+public:
+    TestServer(int port, int worker_threads)
+    {
+        ServerOptions options;
+        options.cork_writes = true;
+        options.worker_threads = worker_threads;
+        _server = std::make_shared<Server::RpcServer>(Address("127.0.0.1", port), false, Address(), options);
+        Server::SDescribeFactory factory;
+        factory.SetMethod("Add");
+        factory.SetParamsDesc("num1", Server::VType::INTEGRAL);
+        factory.SetParamsDesc("num2", Server::VType::INTEGRAL);
+        factory.SetVType(Server::VType::INTEGRAL);
+        factory.SetCallback([](const Json::Value &params, Json::Value &result)
+                            { result = params["num1"].asInt() + params["num2"].asInt(); });
+        _server->RegisterMethod(factory.Build());
+        _thread = std::thread([this]()
+                              { _server->Start(); });
+    }
+    ~TestServer()
+    {
+        _server->Stop(0);
+        _thread.join();
+    }
+
+private:
+    Server::RpcServer::ptr _server;
+    std::thread _thread;
+};
+
+// 一次写出全部请求，读回同样多的响应，检查每个结果
+static void Run(int worker_threads)
+{
+    int port = FreePort();
+    TestServer server(port, worker_threads);
+    int fd = ConnectTo(port, 2000);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    LVProtocol protocol;
+    std::string data;
+    for (int i = 0; i < requestCount; i++)
+    {
+        auto req = MessageFactory::CreateMessage<RpcRequest>();
+        req->SetId(std::to_string(i));
+        req->SetType(MType::REQ_RPC);
+        req->SetMethod("Add");
+        Json::Value params;
+        params["num1"] = i;
+        params["num2"] = 1;
+        req->SetParams(params);
+        data += protocol.Serialize(req);
+    }
+    CHECK(::send(fd, data.data(), data.size(), MSG_NOSIGNAL) == (ssize_t)data.size());
+
+    muduo::net::Buffer buf;
+    MuduoBuffer mbuf(&buf);
+    BaseBuffer::ptr buffer = BufferFactory::Borrow(mbuf);
+    std::set<int> seen;
+    char chunk[64 * 1024];
+    while ((int)seen.size() < requestCount)
+    {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (::poll(&pfd, 1, 2000) <= 0)
+            break;
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+            break;
+        buf.append(chunk, n);
+        while (protocol.IsProcessable(buffer))
+        {
+            BaseMessage::ptr msg;
+            if (protocol.OnMessage(buffer, msg) == false)
+                break;
+            auto rsp = std::dynamic_pointer_cast<RpcResponse>(msg);
+            CHECK(rsp.get() != nullptr);
+            if (rsp.get() == nullptr)
+                continue;
+            int id = std::stoi(rsp->GetId());
+            CHECK(rsp->GetRcode() == RCode::RCODE_OK);
+            CHECK(rsp->GetResult().asInt() == id + 1);
+            // 没有业务线程池时在IO线程中按顺序处理，响应的顺序和请求一致
+            if (worker_threads == 0)
+                CHECK(id == (int)seen.size());
+            CHECK(seen.insert(id).second);
+        }
+    }
+    CHECK((int)seen.size() == requestCount);
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc <= 1 || std::string(argv[1]) == "muduo")
+    {
+        Run(0);
+        Run(4);
+    }
+    if (failures != 0)
+    {
+        std::cerr << "cork_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "cork_test: 通过" << std::endl;
+    return 0;
+}
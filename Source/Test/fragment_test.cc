@@ -0,0 +1,194 @@
+// LVProtocol分片与重组的往返测试：消息体长度取在单帧上限附近的各个边界，
+// 检查每一帧都不超过maxFrameSize、重组出的消息和原消息一致，以及重组占用内存的上限
+#include "../Common/Net.hpp"
+
+using namespace Rpc;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static RpcRequest::ptr MakeRequest(const std::string &id, size_t payload_len)
+{
+    auto msg = MessageFactory::CreateMessage<RpcRequest>();
+    msg->SetId(id);
+    msg->SetType(MType::REQ_RPC);
+    msg->SetMethod("Echo");
+    Json::Value params;
+    std::string payload(payload_len, 'x');
+    for (size_t i = 0; i < payload_len; i++)
+        payload[i] = 'a' + (i * 7) % 26;
+    params["payload"] = payload;
+    msg->SetParams(params);
+    return msg;
+}
+
+// 把序列化结果按长度字段切成一个个报文
+static std::vector<std::string> SplitFrames(const std::string &data)
+{
+    std::vector<std::string> frames;
+    size_t offset = 0;
+    while (offset + 4 <= data.size())
+    {
+        uint32_t be32;
+        memcpy(&be32, data.data() + offset, 4);
+        size_t len = 4 + ntohl(be32);
+        frames.push_back(data.substr(offset, len));
+        offset += len;
+    }
+    return frames;
+}
+
+// 依次喂给接收端的协议对象，返回解析出的完整消息
+static std::vector<BaseMessage::ptr> Feed(LVProtocol &protocol, const std::vector<std::string> &frames, bool &ok)
+{
+    std::vector<BaseMessage::ptr> msgs;
+    muduo::net::Buffer buf;
+    MuduoBuffer mbuf(&buf);
+    BaseBuffer::ptr buffer = BufferFactory::Borrow(mbuf);
+    ok = true;
+    for (auto &frame : frames)
+    {
+        buf.append(frame.data(), frame.size());
+        while (protocol.IsProcessable(buffer))
+        {
+            BaseMessage::ptr msg;
+            if (protocol.OnMessage(buffer, msg) == false)
+            {
+                ok = false;
+                return msgs;
+            }
+            if (msg.get() != nullptr)
+                msgs.push_back(msg);
+        }
+    }
+    return msgs;
+}
+
+static bool SameRequest(const BaseMessage::ptr &msg, const RpcRequest::ptr &expect)
+{
+    auto req = std::dynamic_pointer_cast<RpcRequest>(msg);
+    return req.get() != nullptr && req->GetId() == expect->GetId() && req->GetType() == expect->GetType() &&
+           req->GetMethod() == expect->GetMethod() && req->GetParams() == expect->GetParams();
+}
+
+// 消息体长度逐字节扫过1、2、3个分片的边界
+static void TestBoundaries()
+{
+    LVProtocol sender, receiver;
+    // |--Len--|--flags|mtype--|--idlen--|--id--|--body--|，每个分片都带完整的头部
+    std::string id = "boundary";
+    size_t header_len = 4 + 4 + id.size();
+    size_t max_piece = LVProtocol::maxFrameSize - 4 - header_len;
+    size_t empty_body = sender.Serialize(MakeRequest(id, 0)).size() - 4 - header_len;
+    for (size_t pieces = 1; pieces <= 3; pieces++)
+    {
+        // payload为edge时消息体正好填满pieces个分片
+        size_t edge = pieces * max_piece - empty_body;
+        for (size_t len = edge - 40; len <= edge + 40; len++)
+        {
+            auto req = MakeRequest(id, len);
+            std::string data = sender.Serialize(req);
+            CHECK(data.empty() == false);
+            auto frames = SplitFrames(data);
+            size_t total = 0;
+            for (auto &frame : frames)
+            {
+                CHECK(frame.size() <= LVProtocol::maxFrameSize);
+                total += frame.size();
+            }
+            CHECK(total == data.size());
+            CHECK(frames.size() == (len <= edge ? pieces : pieces + 1));
+            bool ok = false;
+            auto msgs = Feed(receiver, frames, ok);
+            CHECK(ok);
+            CHECK(msgs.size() == 1);
+            if (msgs.size() == 1)
+                CHECK(SameRequest(msgs[0], req));
+        }
+    }
+}
+
+// 两条大消息的分片交错到达，按id分别重组
+static void TestInterleaved()
+{
+    LVProtocol sender, receiver;
+    auto a = MakeRequest("stream-a", 300 * 1024);
+    auto b = MakeRequest("stream-b", 200 * 1024 + 17);
+    auto fa = SplitFrames(sender.Serialize(a));
+    auto fb = SplitFrames(sender.Serialize(b));
+    std::vector<std::string> frames;
+    for (size_t i = 0; i < std::max(fa.size(), fb.size()); i++)
+    {
+        if (i < fa.size())
+            frames.push_back(fa[i]);
+        if (i < fb.size())
+            frames.push_back(fb[i]);
+    }
+    bool ok = false;
+    auto msgs = Feed(receiver, frames, ok);
+    CHECK(ok);
+    CHECK(msgs.size() == 2);
+    if (msgs.size() == 2)
+    {
+        CHECK(SameRequest(msgs[0], b)); // b的分片少，先收齐
+        CHECK(SameRequest(msgs[1], a));
+    }
+}
+
+// 所有进行中的重组加起来超过上限时断开，单条不超限也一样
+static void TestReassemblyLimit()
+{
+    LVProtocol sender;
+    auto a = MakeRequest("limit-a", 150 * 1024);
+    auto b = MakeRequest("limit-b", 150 * 1024);
+    auto fa = SplitFrames(sender.Serialize(a));
+    auto fb = SplitFrames(sender.Serialize(b));
+    {
+        LVProtocol receiver(200 * 1024);
+        bool ok = false;
+        auto msgs = Feed(receiver, fa, ok);
+        CHECK(ok && msgs.size() == 1);
+        msgs = Feed(receiver, fb, ok);
+        CHECK(ok && msgs.size() == 1);
+    }
+    {
+        // 两条交错：任何时刻都没有一条超限，但合计超过200KB
+        LVProtocol receiver(200 * 1024);
+        std::vector<std::string> frames;
+        for (size_t i = 0; i + 1 < fa.size(); i++)
+        {
+            frames.push_back(fa[i]);
+            frames.push_back(fb[i]);
+        }
+        bool ok = true;
+        Feed(receiver, frames, ok);
+        CHECK(ok == false);
+    }
+    {
+        // 发送端拒绝超过上限的消息
+        LVProtocol small(100 * 1024);
+        CHECK(small.Serialize(a).empty());
+    }
+}
+
+int main()
+{
+    TestBoundaries();
+    TestInterleaved();
+    TestReassemblyLimit();
+    if (failures != 0)
+    {
+        std::cerr << "fragment_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "fragment_test: 通过" << std::endl;
+    return 0;
+}
@@ -0,0 +1,292 @@
+// 协议层心跳的测试：心跳请求原样应答、响应更新往返时间、第一条请求上的协商提议被确认；
+// 客户端在服务端确认之后开始发心跳，对端不再应答时在heartbeat_timeout_ms之后断开，没有确认过的老版本服务端不发心跳
+// 用法：./heartbeat_test [muduo]，只有muduo后端的客户端主动发心跳
+#include "../Common/Net.hpp"
+#include <thread>
+
+using namespace Rpc;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static const int heartbeatIntervalMs = 100;
+static const int heartbeatTimeoutMs = 400;
+
+static int64_t NowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 等cond成立，最多等timeout_ms
+template <typename F>
+static bool WaitFor(int timeout_ms, F &&cond)
+{
+    int64_t deadline = NowMs() + timeout_ms;
+    while (cond() == false)
+    {
+        if (NowMs() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+// 只记录发出的消息
+class FakeConnection : public BaseConnection
+{
+public:
+    using ptr = std::shared_ptr<FakeConnection>;
+    FakeConnection() : _protocol(ProtocolFactory::Create()) {}
+    virtual void Send(const BaseMessage::ptr &msg) override { sent.push_back(msg); }
+    virtual bool Connected() override { return true; }
+    virtual void Shutdown() override {}
+    virtual const BaseProtocol::ptr &Protocol() override { return _protocol; }
+    virtual void SetHighWaterMark(size_t, OverloadPolicy, const HighWaterMarkCallback &) override {}
+    virtual bool Overloaded() override { return false; }
+    virtual size_t BacklogBytes() override { return 0; }
+    virtual size_t BufferBytes() override { return 0; }
+
+    std::vector<BaseMessage::ptr> sent;
+
+private:
+    BaseProtocol::ptr _protocol;
+};
+
+static RpcRequest::ptr MakeRequest()
+{
+    auto req = MessageFactory::CreateMessage<RpcRequest>();
+    req->SetId(UUID::Uuid());
+    req->SetType(MType::REQ_RPC);
+    req->SetMethod("Add");
+    req->SetParams(Json::Value(Json::objectValue));
+    return req;
+}
+
+// 把buf中完整的消息都解析出来
+static std::vector<BaseMessage::ptr> Parse(LVProtocol &protocol, muduo::net::Buffer &buf)
+{
+    std::vector<BaseMessage::ptr> msgs;
+    MuduoBuffer mbuf(&buf);
+    BaseBuffer::ptr buffer = BufferFactory::Borrow(mbuf);
+    while (protocol.IsProcessable(buffer))
+    {
+        BaseMessage::ptr msg;
+        if (protocol.OnMessage(buffer, msg) == false)
+            break;
+        if (msg.get() != nullptr)
+            msgs.push_back(msg);
+    }
+    return msgs;
+}
+
+// 只接受一个连接的服务端：confirm为true时像新版本服务端一样确认第一条请求上的协商提议，之后不回任何数据；
+// 为false时像不认识提议的老版本服务端一样什么都不回。记录收到的心跳请求和连接被对端关闭的时刻
+class RawServer
+{
+public:
+    explicit RawServer(bool confirm) : _confirm(confirm), _port(0), _connfd(-1), _stop(false), _heartbeats(0), _closed_ms(0)
+    {
+        _listenfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        ::bind(_listenfd, (struct sockaddr *)&addr, sizeof(addr));
+        ::listen(_listenfd, 16);
+        ::getsockname(_listenfd, (struct sockaddr *)&addr, &len);
+        _port = ntohs(addr.sin_port);
+        _thread = std::thread(std::bind(&RawServer::Run, this));
+    }
+    ~RawServer()
+    {
+        _stop = true;
+        _thread.join();
+        if (_connfd >= 0)
+            ::close(_connfd);
+        ::close(_listenfd);
+    }
+    int Port() const { return _port; }
+    int Heartbeats() const { return _heartbeats; }
+    // 连接被对端关闭的时刻，还没有关闭时为0
+    int64_t ClosedMs() const { return _closed_ms; }
+
+private:
+    void Run()
+    {
+        struct pollfd pfd = {_listenfd, POLLIN, 0};
+        while (_stop == false && _connfd < 0)
+        {
+            if (::poll(&pfd, 1, 50) > 0)
+                _connfd = ::accept4(_listenfd, nullptr, nullptr, SOCK_CLOEXEC);
+        }
+        LVProtocol protocol;
+        muduo::net::Buffer buf;
+        bool confirmed = false;
+        char data[4096];
+        pfd.fd = _connfd;
+        while (_stop == false && _closed_ms == 0)
+        {
+            if (::poll(&pfd, 1, 50) <= 0)
+                continue;
+            ssize_t n = ::recv(_connfd, data, sizeof(data), 0);
+            if (n <= 0)
+            {
+                _closed_ms = NowMs();
+                break;
+            }
+            buf.append(data, n);
+            for (auto &msg : Parse(protocol, buf))
+            {
+                if (msg->GetType() == MType::REQ_HEARTBEAT)
+                {
+                    _heartbeats++;
+                    continue;
+                }
+                auto json = dynamic_cast<JsonMessage *>(msg.get());
+                auto offer = MessageFactory::CreateMessage<HeartbeatMessage>();
+                if (_confirm && confirmed == false && json != nullptr && json->TakeOffer(*offer))
+                {
+                    confirmed = true;
+                    offer->SetType(MType::RSP_HEARTBEAT);
+                    std::string frame = protocol.Serialize(offer);
+                    ::send(_connfd, frame.data(), frame.size(), MSG_NOSIGNAL);
+                }
+            }
+        }
+    }
+
+private:
+    bool _confirm;
+    int _port;
+    int _listenfd;
+    int _connfd;
+    std::atomic<bool> _stop;
+    std::atomic<int> _heartbeats;
+    std::atomic<int64_t> _closed_ms;
+    std::thread _thread;
+};
+
+// 心跳请求原样回一个响应；响应让连接记下对端支持心跳并更新往返时间；其他消息不处理
+static void TestHandle()
+{
+    auto conn = std::make_shared<FakeConnection>();
+    CHECK(Heartbeat::Handle(conn, MakeRequest()) == false);
+
+    auto req = MessageFactory::CreateMessage<HeartbeatMessage>();
+    req->SetType(MType::REQ_HEARTBEAT);
+    req->SetTimestamp(12345);
+    CHECK(Heartbeat::Handle(conn, req));
+    CHECK(conn->sent.size() == 1);
+    auto echo = std::dynamic_pointer_cast<HeartbeatMessage>(conn->sent.back());
+    CHECK(echo && echo->GetType() == MType::RSP_HEARTBEAT && echo->GetTimestamp() == 12345);
+    CHECK(conn->PeerHeartbeat() == false);
+
+    auto rsp = MessageFactory::CreateMessage<HeartbeatMessage>();
+    rsp->SetType(MType::RSP_HEARTBEAT);
+    rsp->SetTimestamp(Clock::NowUs() - 2000);
+    CHECK(Heartbeat::Handle(conn, rsp));
+    CHECK(conn->PeerHeartbeat());
+    CHECK(conn->RttUs() >= 2000);
+    CHECK(conn->sent.size() == 1);
+
+    // 缺少时间戳的心跳被丢弃，不回应也不交给业务
+    auto bad = MessageFactory::CreateMessage<HeartbeatMessage>();
+    bad->SetType(MType::REQ_HEARTBEAT);
+    CHECK(Heartbeat::Handle(conn, bad));
+    CHECK(conn->sent.size() == 1);
+}
+
+// 第一条请求上的提议被确认：回一个心跳响应；没有提议的请求不回
+static void TestAccept()
+{
+    LVProtocol sender, receiver;
+    sender.Offer(Codec::CODEC_JSON);
+    muduo::net::Buffer buf;
+    std::string frames = sender.Serialize(MakeRequest());
+    frames += sender.Serialize(MakeRequest());
+    buf.append(frames.data(), frames.size());
+    auto msgs = Parse(receiver, buf);
+    CHECK(msgs.size() == 2);
+    if (msgs.size() != 2)
+        return;
+    auto conn = std::make_shared<FakeConnection>();
+    Heartbeat::Accept(conn, msgs[0]);
+    CHECK(conn->sent.size() == 1);
+    auto ack = std::dynamic_pointer_cast<HeartbeatMessage>(conn->sent.back());
+    CHECK(ack && ack->GetType() == MType::RSP_HEARTBEAT);
+    Heartbeat::Accept(conn, msgs[1]);
+    CHECK(conn->sent.size() == 1);
+}
+
+static BaseClient::ptr MakeClient(int port, std::atomic<int64_t> &closed_ms)
+{
+    ClientOptions options;
+    options.heartbeat_interval_ms = heartbeatIntervalMs;
+    options.heartbeat_timeout_ms = heartbeatTimeoutMs;
+    options.auto_reconnect = false;
+    BaseClient::ptr client = ClientFactory::Create("127.0.0.1", port, options);
+    client->SetCloseCallback([&closed_ms](const BaseConnection::ptr &)
+                             { closed_ms = NowMs(); });
+    return client;
+}
+
+// 服务端确认之后不再回任何数据：客户端发出心跳，超时之后主动断开
+static void TestTimeout()
+{
+    RawServer server(true);
+    std::atomic<int64_t> closed_ms(0);
+    BaseClient::ptr client = MakeClient(server.Port(), closed_ms);
+    CHECK(client->Connect());
+    CHECK(client->Send(MakeRequest()));
+    int64_t start = NowMs();
+    CHECK(WaitFor(heartbeatTimeoutMs * 5, [&]()
+                  { return closed_ms != 0; }));
+    CHECK(closed_ms - start >= heartbeatTimeoutMs - 50);
+    CHECK(client->Connected() == false);
+    CHECK(server.Heartbeats() > 0);
+    CHECK(WaitFor(1000, [&]()
+                  { return server.ClosedMs() != 0; }));
+}
+
+// 老版本服务端不确认提议：不发心跳，也不做超时检测，连接一直保持
+static void TestOldServer()
+{
+    RawServer server(false);
+    std::atomic<int64_t> closed_ms(0);
+    BaseClient::ptr client = MakeClient(server.Port(), closed_ms);
+    CHECK(client->Connect());
+    CHECK(client->Send(MakeRequest()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(heartbeatTimeoutMs * 3));
+    CHECK(client->Connected());
+    CHECK(closed_ms == 0);
+    CHECK(server.Heartbeats() == 0);
+    CHECK(server.ClosedMs() == 0);
+    client->Shutdown();
+}
+
+int main(int argc, char *argv[])
+{
+    TestHandle();
+    TestAccept();
+    if (argc <= 1 || std::string(argv[1]) == "muduo")
+    {
+        TestTimeout();
+        TestOldServer();
+    }
+    if (failures != 0)
+    {
+        std::cerr << "heartbeat_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "heartbeat_test: 通过" << std::endl;
+    return 0;
+}
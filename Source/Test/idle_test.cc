@@ -0,0 +1,198 @@
+// 空闲连接回收的测试：时间轮在一整圈没有刷新之后回调，刷新推迟过期；
+// 服务端关闭超过idle_timeout_ms没有收到数据的连接，持续有请求的连接不受影响
+// 用法：./idle_test [muduo|io_uring]，不带参数时两个后端都测(不支持io_uring的环境退回muduo)
+#include "../Server/Rpc_Server.hpp"
+#include <thread>
+
+using namespace Rpc;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static const int idleTimeoutMs = 300;
+
+static int64_t NowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 向内核要一个当前空闲的端口
+static int FreePort()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    ::getsockname(fd, (struct sockaddr *)&addr, &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// 阻塞地连上本机端口，服务端还没开始监听时重试，失败返回-1
+static int ConnectTo(int port, int timeout_ms)
+{
+    int64_t deadline = NowMs() + timeout_ms;
+    while (NowMs() < deadline)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        ::close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+// 读掉已经到达的响应，对端关闭了连接时返回true
+static bool DrainClosed(int fd, int timeout_ms)
+{
+    char data[4096];
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (::poll(&pfd, 1, timeout_ms) > 0)
+    {
+        if (::recv(fd, data, sizeof(data), 0) <= 0)
+            return true;
+        timeout_ms = 0;
+    }
+    return false;
+}
+
+static void SendRequest(int fd)
+{
+    LVProtocol protocol;
+    auto req = MessageFactory::CreateMessage<RpcRequest>();
+    req->SetId(UUID::Uuid());
+    req->SetType(MType::REQ_RPC);
+    req->SetMethod("Ping");
+    req->SetParams(Json::Value(Json::objectValue));
+    std::string data = protocol.Serialize(req);
+    ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+}
+
+// 在后台线程中运行的RpcServer，没有注册方法，请求都以RCODE_NOT_FOUND_SERVICE响应
+class TestServer
+{
+public:
+    TestServer(int port, NetBackend backend)
+    {
+        ServerOptions options;
+        options.backend = backend;
+        options.idle_timeout_ms = idleTimeoutMs;
+        _server = std::make_shared<Server::RpcServer>(Address("127.0.0.1", port), false, Address(), options);
+        _thread = std::thread([this]()
+                              { _server->Start(); });
+    }
+    ~TestServer()
+    {
+        _server->Stop(0);
+        _thread.join();
+    }
+
+private:
+    Server::RpcServer::ptr _server;
+    std::thread _thread;
+};
+
+// 超时3秒时tick为1秒、共4格：加入后第4次Tick才过期，Touch从当前格子重新计时
+static void TestWheel()
+{
+    TimingWheel wheel(3000);
+    CHECK(wheel.TickMs() == 1000);
+    int idle = 0;
+    {
+        auto entry = wheel.Add([&idle]()
+                               { idle++; });
+        for (int i = 0; i < 3; i++)
+            wheel.Tick();
+        CHECK(idle == 0);
+        wheel.Touch(entry);
+        for (int i = 0; i < 3; i++)
+            wheel.Tick();
+        CHECK(idle == 0);
+        wheel.Tick();
+        CHECK(idle == 1);
+        CHECK(entry.expired());
+        // 过期之后Touch没有作用
+        wheel.Touch(entry);
+        for (int i = 0; i < 4; i++)
+            wheel.Tick();
+        CHECK(idle == 1);
+    }
+    // 超时不超过1秒时tick等于超时时间，共2格
+    TimingWheel fast(200);
+    CHECK(fast.TickMs() == 200);
+    idle = 0;
+    fast.Add([&idle]()
+             { idle++; });
+    fast.Tick();
+    CHECK(idle == 0);
+    fast.Tick();
+    CHECK(idle == 1);
+}
+
+// 不发数据的连接在一到两个超时之间被关闭；一直有请求的连接超过多个超时依然保持
+static void TestServerReap(NetBackend backend)
+{
+    int port = FreePort();
+    TestServer server(port, backend);
+    int idle = ConnectTo(port, 2000);
+    int active = ConnectTo(port, 2000);
+    CHECK(idle >= 0 && active >= 0);
+    if (idle < 0 || active < 0)
+        return;
+    int64_t start = NowMs();
+    bool idle_closed = false;
+    int64_t closed_at = 0;
+    while (NowMs() - start < idleTimeoutMs * 5)
+    {
+        SendRequest(active);
+        CHECK(DrainClosed(active, 50) == false);
+        if (idle_closed == false && DrainClosed(idle, 50))
+        {
+            idle_closed = true;
+            closed_at = NowMs() - start;
+        }
+    }
+    CHECK(idle_closed);
+    CHECK(closed_at >= idleTimeoutMs - 50 && closed_at <= idleTimeoutMs * 3);
+    // 停止发送之后活跃的连接也会被关闭
+    CHECK(DrainClosed(active, idleTimeoutMs * 3));
+    ::close(idle);
+    ::close(active);
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::pair<std::string, NetBackend>> backends = {{"muduo", NetBackend::BACKEND_MUDUO},
+                                                                {"io_uring", NetBackend::BACKEND_IO_URING}};
+    TestWheel();
+    for (auto &backend : backends)
+    {
+        if (argc > 1 && backend.first != argv[1])
+            continue;
+        TestServerReap(backend.second);
+    }
+    if (failures != 0)
+    {
+        std::cerr << "idle_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "idle_test: 通过" << std::endl;
+    return 0;
+}
@@ -0,0 +1,95 @@
+// JSON消息体序列化的性能对比：LVProtocol::Serialize在旧实现(每次调用创建builder和writer、带缩进输出)
+// 和当前实现(线程局部的writer、紧凑输出)下的耗时与报文大小，以及jsoncpp和SimdJson的解析耗时
+#include "../Common/Net.hpp"
+#include <chrono>
+
+using namespace Rpc;
+
+// 按旧实现序列化消息体的RpcRequest
+class LegacyRpcRequest : public RpcRequest
+{
+public:
+    virtual bool SerializeTo(std::ostream &out) override
+    {
+        Json::StreamWriterBuilder builder;
+        std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+        return writer->write(_body, &out) == 0 && out.good();
+    }
+};
+
+static bool LegacyDeserialize(std::string_view body, Json::Value &val)
+{
+    std::string errs;
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    return reader->parse(body.data(), body.data() + body.size(), &val, &errs);
+}
+
+template <typename Msg>
+static std::shared_ptr<Msg> MakeRequest()
+{
+    auto msg = MessageFactory::CreateMessage<Msg>();
+    msg->SetId(UUID::Uuid());
+    msg->SetType(MType::REQ_RPC);
+    msg->SetMethod("Add");
+    Json::Value params;
+    params["num1"] = 11;
+    params["num2"] = 22;
+    params["name"] = "json_bench";
+    for (int i = 0; i < 8; i++)
+        params["list"].append(i * 1.5);
+    msg->SetParams(params);
+    return msg;
+}
+
+template <typename F>
+static double NsPerOp(int n, F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+        f();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return (double)ns / n;
+}
+
+static double BenchSerialize(const BaseMessage::ptr &msg, int n, size_t &frame_len)
+{
+    LVProtocol protocol;
+    muduo::net::Buffer frame;
+    MuduoBuffer buf(&frame);
+    BaseBuffer::ptr buffer = BufferFactory::Borrow(buf);
+    protocol.Serialize(msg, buffer);
+    frame_len = frame.readableBytes();
+    frame.retrieveAll();
+    return NsPerOp(n, [&]()
+                   {
+                       protocol.Serialize(msg, buffer);
+                       frame.retrieveAll(); });
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+    size_t legacy_len = 0, current_len = 0;
+    double legacy_ns = BenchSerialize(MakeRequest<LegacyRpcRequest>(), n, legacy_len);
+    double current_ns = BenchSerialize(MakeRequest<RpcRequest>(), n, current_len);
+    std::cout << "LVProtocol::Serialize  legacy: " << legacy_ns << " ns/op, " << legacy_len << " bytes/frame" << std::endl;
+    std::cout << "LVProtocol::Serialize current: " << current_ns << " ns/op, " << current_len << " bytes/frame" << std::endl;
+
+    std::stringstream ss;
+    MakeRequest<LegacyRpcRequest>()->SerializeTo(ss);
+    std::string legacy_body = ss.str();
+    std::string current_body = MakeRequest<RpcRequest>()->Serialize();
+    Json::Value val;
+    double legacy_parse_ns = NsPerOp(n, [&]()
+                                     { LegacyDeserialize(legacy_body, val); });
+    double current_parse_ns = NsPerOp(n, [&]()
+                                      { JSON::Deserialize(current_body, val); });
+    std::string err;
+    double simd_parse_ns = NsPerOp(n, [&]()
+                                   { SimdJson::Parse(current_body, val, err); });
+    std::cout << "JSON deserialize       legacy: " << legacy_parse_ns << " ns/op" << std::endl;
+    std::cout << "JSON deserialize      current: " << current_parse_ns << " ns/op" << std::endl;
+    std::cout << "JSON deserialize SimdJson(" << SimdJson::Backend() << "): " << simd_parse_ns << " ns/op" << std::endl;
+    return 0;
+}
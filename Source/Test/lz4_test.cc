@@ -0,0 +1,234 @@
+// LZ4块压缩的往返测试：各种数据在带字典和不带字典时压缩后解压回原文，截断、损坏的数据和超过上限的长度被拒绝而不会崩溃，
+// 以及LVProtocol协商压缩之后的报文
+#include "../Common/Net.hpp"
+#include <random>
+
+using namespace Rpc;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static const size_t maxLen = 1 << 20;
+
+static std::string Dictionary()
+{
+    return *CompressOptions::DefaultDictionary();
+}
+
+// kind决定数据的特征：随机字节、两个字符、协议风格的JSON、单一字符
+static std::string MakeData(std::mt19937_64 &rng, int kind, size_t len)
+{
+    std::string data;
+    while (data.size() < len)
+    {
+        switch (kind)
+        {
+        case 0:
+            data.push_back((char)rng());
+            break;
+        case 1:
+            data.push_back("ab"[rng() % 2]);
+            break;
+        case 2:
+            data += "{\"method\":\"Add\",\"parameters\":{\"num1\":" + std::to_string(rng() % 100) + "}}";
+            break;
+        default:
+            data.push_back('x');
+            break;
+        }
+    }
+    data.resize(len);
+    return data;
+}
+
+// 压缩后能解压回原文；不可压缩的数据Compress返回false，但结果依然合法
+static void TestRoundTrip()
+{
+    std::mt19937_64 rng(1);
+    std::string dict = Dictionary();
+    for (int i = 0; i < 4000; i++)
+    {
+        int kind = i % 4;
+        // 长度覆盖空串、短于最小匹配、块尾规则附近以及超过64KB窗口的情况
+        size_t len = i < 40 ? i : rng() % (i % 50 == 0 ? 200000 : 5000);
+        std::string data = MakeData(rng, kind, len);
+        for (bool use_dict : {false, true})
+        {
+            std::string_view dv = use_dict ? std::string_view(dict) : std::string_view();
+            std::string packed, plain;
+            bool smaller = Lz4::Compress(data, dv, packed);
+            CHECK(Lz4::Decompress(packed, dv, maxLen, plain));
+            CHECK(plain == data);
+            if (kind == 3 && len > 100)
+                CHECK(smaller);
+        }
+    }
+    std::string random = MakeData(rng, 0, 4096), packed;
+    CHECK(Lz4::Compress(random, std::string_view(), packed) == false);
+}
+
+// 协议字段组成的短消息体：字典让第一次出现的键名也能被压缩
+static void TestDictionary()
+{
+    std::string dict = Dictionary();
+    std::string body = "{\"method\":\"Add\",\"parameters\":{\"num1\":11,\"num2\":22}}";
+    std::string with_dict, without_dict, plain;
+    Lz4::Compress(body, std::string_view(), without_dict);
+    CHECK(Lz4::Compress(body, dict, with_dict));
+    CHECK(with_dict.size() < without_dict.size());
+    // 用字典压缩的数据在没有字典时不能还原
+    CHECK(Lz4::Decompress(with_dict, std::string_view(), maxLen, plain) == false || plain != body);
+    CHECK(Lz4::Decompress(with_dict, dict, maxLen, plain) && plain == body);
+    // 两端同一份字典得到同一个校验和，内容不同时不同
+    auto other = std::make_shared<const std::string>(dict + " ");
+    CHECK(CompressOptions::DictionaryId(CompressOptions::DefaultDictionary()) != 0);
+    CHECK(CompressOptions::DictionaryId(CompressOptions::DefaultDictionary()) != CompressOptions::DictionaryId(other));
+    CHECK(CompressOptions::DictionaryId(nullptr) == 0);
+}
+
+// 截断的数据一定被拒绝；损坏的数据可能被拒绝，也可能解出别的内容，只要求不崩溃、不超过声明的长度
+static void TestMalformed()
+{
+    std::mt19937_64 rng(2);
+    std::string dict = Dictionary();
+    for (int kind = 0; kind < 4; kind++)
+    {
+        std::string data = MakeData(rng, kind, 3000);
+        for (bool use_dict : {false, true})
+        {
+            std::string_view dv = use_dict ? std::string_view(dict) : std::string_view();
+            std::string packed, plain;
+            Lz4::Compress(data, dv, packed);
+            for (size_t len = 0; len < packed.size(); len++)
+                CHECK(Lz4::Decompress(std::string_view(packed.data(), len), dv, maxLen, plain) == false);
+            for (int k = 0; k < 2000; k++)
+            {
+                std::string bad = packed;
+                bad[4 + rng() % (bad.size() - 4)] ^= (char)(1 << (rng() % 8));
+                if (Lz4::Decompress(bad, dv, maxLen, plain))
+                    CHECK(plain.size() == data.size());
+            }
+        }
+    }
+    // 原始长度超过上限时不分配内存，直接拒绝
+    std::string data(100000, 'x'), packed, plain;
+    CHECK(Lz4::Compress(data, std::string_view(), packed));
+    CHECK(Lz4::Decompress(packed, std::string_view(), data.size() - 1, plain) == false);
+    CHECK(Lz4::Decompress(packed, std::string_view(), data.size(), plain) && plain == data);
+    // 声明的长度和实际解出的长度不一致
+    uint32_t be32 = htonl(data.size() + 1);
+    memcpy(&packed[0], &be32, 4);
+    CHECK(Lz4::Decompress(packed, std::string_view(), maxLen, plain) == false);
+}
+
+static RpcResponse::ptr MakeResponse(const std::string &id)
+{
+    auto rsp = MessageFactory::CreateMessage<RpcResponse>();
+    rsp->SetId(id);
+    rsp->SetType(MType::RSP_RPC);
+    rsp->SetRcode(RCode::RCODE_OK);
+    Json::Value result;
+    for (int i = 0; i < 200; i++)
+    {
+        Json::Value item;
+        item["id"] = i;
+        item["name"] = "user" + std::to_string(i);
+        item["enabled"] = true;
+        result["items"].append(item);
+    }
+    rsp->SetResult(result);
+    return rsp;
+}
+
+static BaseMessage::ptr Parse(LVProtocol &protocol, const std::string &frames)
+{
+    muduo::net::Buffer buf;
+    MuduoBuffer mbuf(&buf);
+    BaseBuffer::ptr buffer = BufferFactory::Borrow(mbuf);
+    buf.append(frames.data(), frames.size());
+    BaseMessage::ptr msg;
+    while (msg.get() == nullptr && protocol.IsProcessable(buffer))
+    {
+        if (protocol.OnMessage(buffer, msg) == false)
+            return BaseMessage::ptr();
+    }
+    return msg;
+}
+
+// 协商之后超过阈值的消息体压缩发送，接收端按帧头的标志位解压
+static void TestProtocol()
+{
+    CompressOptions options;
+    options.compression = Compression::COMPRESS_LZ4;
+    auto rsp = MakeResponse("lz4-1");
+    for (bool use_dict : {false, true})
+    {
+        CompressOptions sender_options = options;
+        if (use_dict == false)
+            sender_options.dictionary.reset();
+        LVProtocol plain_sender, sender(LVProtocol::defaultMaxMessageSize, sender_options),
+            receiver(LVProtocol::defaultMaxMessageSize, options);
+        // 协商：接收端接受同样的算法，字典不一致时不用字典
+        uint32_t dict_id = 0;
+        Compression offer = sender.CompressOffer(dict_id);
+        Compression accepted = receiver.AcceptCompress(offer, dict_id);
+        CHECK(accepted == Compression::COMPRESS_LZ4);
+        CHECK((dict_id != 0) == use_dict);
+        sender.EnableCompress(accepted, dict_id);
+
+        std::string plain_frame = plain_sender.Serialize(rsp);
+        std::string packed_frame = sender.Serialize(rsp);
+        CHECK(packed_frame.size() < plain_frame.size());
+        auto msg = std::dynamic_pointer_cast<RpcResponse>(Parse(receiver, packed_frame));
+        CHECK(msg.get() != nullptr);
+        if (msg.get() != nullptr)
+            CHECK(msg->GetResult() == rsp->GetResult());
+
+        // 低于阈值的消息体不压缩
+        auto small = MessageFactory::CreateMessage<RpcResponse>();
+        small->SetId("lz4-2");
+        small->SetType(MType::RSP_RPC);
+        small->SetRcode(RCode::RCODE_OK);
+        CHECK(sender.Serialize(small) == plain_sender.Serialize(small));
+
+        // 压缩数据损坏时整条消息解析失败
+        std::string bad = packed_frame;
+        bad.resize(bad.size() - 5);
+        uint32_t be32 = htonl(bad.size() - 4);
+        memcpy(&bad[0], &be32, 4);
+        CHECK(Parse(receiver, bad).get() == nullptr);
+    }
+    // 接收端没有配置字典时拒绝带字典标志的帧
+    LVProtocol sender(LVProtocol::defaultMaxMessageSize, options);
+    sender.EnableCompress(Compression::COMPRESS_LZ4, CompressOptions::DictionaryId(options.dictionary));
+    CompressOptions no_dict = options;
+    no_dict.dictionary.reset();
+    LVProtocol receiver(LVProtocol::defaultMaxMessageSize, no_dict);
+    CHECK(Parse(receiver, sender.Serialize(rsp)).get() == nullptr);
+    // 解压后超过接收端消息上限的帧被拒绝
+    LVProtocol small_receiver(4096, options);
+    CHECK(Parse(small_receiver, sender.Serialize(rsp)).get() == nullptr);
+}
+
+int main()
+{
+    TestRoundTrip();
+    TestDictionary();
+    TestMalformed();
+    TestProtocol();
+    if (failures != 0)
+    {
+        std::cerr << "lz4_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "lz4_test: 通过" << std::endl;
+    return 0;
+}
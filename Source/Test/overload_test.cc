@@ -0,0 +1,236 @@
+// 发送积压超过高水位的测试：一个不读响应的客户端连续发出请求，服务端按三种策略处理
+// REJECT：积压期间的请求以RCODE_OVERLOADED拒绝，积压写完后恢复；STOP_PEER_READ：不再读这个对端，请求都被正常处理；
+// DISCONNECT：直接断开连接
+// 用法：./overload_test [muduo|io_uring]，不带参数时两个后端都测(不支持io_uring的环境退回muduo)
+#include "../Server/Rpc_Server.hpp"
+#include <thread>
+
+using namespace Rpc;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static const int requestCount = 200;
+static const size_t resultSize = 64 * 1024;
+
+static int64_t NowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 向内核要一个当前空闲的端口
+static int FreePort()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    ::getsockname(fd, (struct sockaddr *)&addr, &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// 阻塞地连上本机端口，接收缓冲区设得很小，服务端的响应很快就会积压；失败返回-1
+static int ConnectTo(int port, int timeout_ms)
+{
+    int64_t deadline = NowMs() + timeout_ms;
+    while (NowMs() < deadline)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int rcvbuf = 4096;
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        ::close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+// 在后台线程中运行的RpcServer，方法Big返回resultSize字节的结果
+class TestServer
+{
+public:
+    TestServer(int port, NetBackend backend, OverloadPolicy policy)
+    {
+        ServerOptions options;
+        options.backend = backend;
+        options.high_water_mark = 256 * 1024;
+        options.overload_policy = policy;
+        options.socket.sndbuf = 16 * 1024;
+        _server = std::make_shared<Server::RpcServer>(Address("127.0.0.1", port), false, Address(), options);
+        Server::SDescribeFactory factory;
+        factory.SetMethod("Big");
+        factory.SetVType(Server::VType::OBJECT);
+        factory.SetCallback([](const Json::Value &, Json::Value &result)
+                            { result["data"] = std::string(resultSize, 'x'); });
+        _server->RegisterMethod(factory.Build());
+        _thread = std::thread([this]()
+                              { _server->Start(); });
+    }
+    ~TestServer()
+    {
+        _server->Stop(0);
+        _thread.join();
+    }
+
+private:
+    Server::RpcServer::ptr _server;
+    std::thread _thread;
+};
+
+static void SendRequests(int fd, int count)
+{
+    LVProtocol protocol;
+    std::string data;
+    for (int i = 0; i < count; i++)
+    {
+        auto req = MessageFactory::CreateMessage<RpcRequest>();
+        req->SetId(std::to_string(i));
+        req->SetType(MType::REQ_RPC);
+        req->SetMethod("Big");
+        req->SetParams(Json::Value(Json::objectValue));
+        data += protocol.Serialize(req);
+    }
+    ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+}
+
+// 读出count个响应，连接被关闭或者timeout_ms之内没有新数据时提前返回，closed表示是否被对端关闭
+static std::vector<RpcResponse::ptr> ReadResponses(int fd, int count, int timeout_ms, bool &closed)
+{
+    std::vector<RpcResponse::ptr> rsps;
+    LVProtocol protocol;
+    muduo::net::Buffer buf;
+    MuduoBuffer mbuf(&buf);
+    BaseBuffer::ptr buffer = BufferFactory::Borrow(mbuf);
+    closed = false;
+    char data[64 * 1024];
+    while ((int)rsps.size() < count)
+    {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (::poll(&pfd, 1, timeout_ms) <= 0)
+            break;
+        ssize_t n = ::recv(fd, data, sizeof(data), 0);
+        if (n <= 0)
+        {
+            closed = true;
+            break;
+        }
+        buf.append(data, n);
+        while (protocol.IsProcessable(buffer))
+        {
+            BaseMessage::ptr msg;
+            if (protocol.OnMessage(buffer, msg) == false)
+                return rsps;
+            auto rsp = std::dynamic_pointer_cast<RpcResponse>(msg);
+            if (rsp)
+                rsps.push_back(rsp);
+        }
+    }
+    return rsps;
+}
+
+// 统计各个响应码的个数
+static int Count(const std::vector<RpcResponse::ptr> &rsps, RCode rcode)
+{
+    int count = 0;
+    for (auto &rsp : rsps)
+        count += rsp->GetRcode() == rcode ? 1 : 0;
+    return count;
+}
+
+static void TestReject(NetBackend backend)
+{
+    int port = FreePort();
+    TestServer server(port, backend, OverloadPolicy::OVERLOAD_REJECT);
+    int fd = ConnectTo(port, 2000);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    SendRequests(fd, requestCount);
+    // 等服务端把请求都读完，积压停在高水位之上
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    bool closed = false;
+    auto rsps = ReadResponses(fd, requestCount, 2000, closed);
+    CHECK(closed == false);
+    CHECK((int)rsps.size() == requestCount);
+    int ok = Count(rsps, RCode::RCODE_OK), rejected = Count(rsps, RCode::RCODE_OVERLOADED);
+    CHECK(ok > 0 && rejected > 0 && ok + rejected == (int)rsps.size());
+    // 积压写完之后解除过载，新请求照常处理
+    SendRequests(fd, 1);
+    rsps = ReadResponses(fd, 1, 2000, closed);
+    CHECK(rsps.size() == 1 && rsps[0]->GetRcode() == RCode::RCODE_OK);
+    ::close(fd);
+}
+
+static void TestStopPeerRead(NetBackend backend)
+{
+    int port = FreePort();
+    TestServer server(port, backend, OverloadPolicy::OVERLOAD_STOP_PEER_READ);
+    int fd = ConnectTo(port, 2000);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    SendRequests(fd, requestCount);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    bool closed = false;
+    auto rsps = ReadResponses(fd, requestCount, 2000, closed);
+    CHECK(closed == false);
+    CHECK((int)rsps.size() == requestCount);
+    CHECK(Count(rsps, RCode::RCODE_OK) == (int)rsps.size());
+    ::close(fd);
+}
+
+static void TestDisconnect(NetBackend backend)
+{
+    int port = FreePort();
+    TestServer server(port, backend, OverloadPolicy::OVERLOAD_DISCONNECT);
+    int fd = ConnectTo(port, 2000);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    SendRequests(fd, requestCount);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    bool closed = false;
+    auto rsps = ReadResponses(fd, requestCount, 2000, closed);
+    CHECK(closed);
+    CHECK((int)rsps.size() < requestCount);
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::pair<std::string, NetBackend>> backends = {{"muduo", NetBackend::BACKEND_MUDUO},
+                                                                {"io_uring", NetBackend::BACKEND_IO_URING}};
+    for (auto &backend : backends)
+    {
+        if (argc > 1 && backend.first != argv[1])
+            continue;
+        TestReject(backend.second);
+        TestStopPeerRead(backend.second);
+        TestDisconnect(backend.second);
+    }
+    if (failures != 0)
+    {
+        std::cerr << "overload_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "overload_test: 通过" << std::endl;
+    return 0;
+}
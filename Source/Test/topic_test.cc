@@ -0,0 +1,141 @@
+// 主题推送遇到慢订阅者的测试：积压超过高水位的订阅者收不到消息，丢弃的条数被累计，日志按订阅者限速，
+// 其他订阅者照常收到每一条消息
+#include "../Server/Rpc_Topic.hpp"
+
+using namespace Rpc;
+
+static int failures = 0;
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << " 失败: " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+// 只记录发出的消息，Overloaded由测试直接设置
+class FakeConnection : public BaseConnection
+{
+public:
+    using ptr = std::shared_ptr<FakeConnection>;
+    FakeConnection() : _protocol(ProtocolFactory::Create()) {}
+    virtual void Send(const BaseMessage::ptr &msg) override { sent.push_back(msg); }
+    virtual bool Connected() override { return true; }
+    virtual void Shutdown() override {}
+    virtual const BaseProtocol::ptr &Protocol() override { return _protocol; }
+    virtual void SetHighWaterMark(size_t, OverloadPolicy, const HighWaterMarkCallback &) override {}
+    virtual bool Overloaded() override { return overloaded; }
+    virtual size_t BacklogBytes() override { return 0; }
+    virtual size_t BufferBytes() override { return 0; }
+    // 发给订阅者的主题消息条数(不含请求的响应)
+    size_t Published(const std::string &topic) const
+    {
+        size_t count = 0;
+        for (auto &msg : sent)
+        {
+            auto req = std::dynamic_pointer_cast<TopicRequest>(msg);
+            if (req && req->GetTopicKey() == topic)
+                count++;
+        }
+        return count;
+    }
+
+    std::vector<BaseMessage::ptr> sent;
+    bool overloaded = false;
+
+private:
+    BaseProtocol::ptr _protocol;
+};
+
+static TopicRequest::ptr MakeRequest(const std::string &topic, TopicOptype optype)
+{
+    auto req = MessageFactory::CreateMessage<TopicRequest>();
+    req->SetId(UUID::Uuid());
+    req->SetType(MType::REQ_TOPIC);
+    req->SetTopicKey(topic);
+    req->SetOptype(optype);
+    if (optype == TopicOptype::TOPIC_PUBLISH)
+    {
+        Json::Value msg;
+        msg["text"] = "hello";
+        req->SetTopicMsg(msg);
+    }
+    return req;
+}
+
+static RCode LastRcode(const FakeConnection::ptr &conn)
+{
+    auto rsp = std::dynamic_pointer_cast<TopicResponse>(conn->sent.back());
+    return rsp ? rsp->GetRcode() : RCode::RCODE_INVALID_MSG;
+}
+
+// 经过TopicManager发布：慢订阅者的消息被丢弃，其他订阅者不受影响，慢订阅者恢复后继续收到
+static void TestSlowSubscriber()
+{
+    Server::TopicManager manager;
+    auto publisher = std::make_shared<FakeConnection>();
+    auto fast = std::make_shared<FakeConnection>();
+    auto slow = std::make_shared<FakeConnection>();
+    manager.OnTopicRequest(publisher, MakeRequest("news", TopicOptype::TOPIC_CREATE));
+    manager.OnTopicRequest(fast, MakeRequest("news", TopicOptype::TOPIC_SUBSCRIBE));
+    manager.OnTopicRequest(slow, MakeRequest("news", TopicOptype::TOPIC_SUBSCRIBE));
+    CHECK(LastRcode(slow) == RCode::RCODE_OK);
+
+    slow->overloaded = true;
+    for (int i = 0; i < 1000; i++)
+        manager.OnTopicRequest(publisher, MakeRequest("news", TopicOptype::TOPIC_PUBLISH));
+    CHECK(LastRcode(publisher) == RCode::RCODE_OK);
+    CHECK(fast->Published("news") == 1000);
+    CHECK(slow->Published("news") == 0);
+
+    slow->overloaded = false;
+    manager.OnTopicRequest(publisher, MakeRequest("news", TopicOptype::TOPIC_PUBLISH));
+    CHECK(fast->Published("news") == 1001);
+    CHECK(slow->Published("news") == 1);
+}
+
+// 丢弃计数：每条都计入总数，日志每个订阅者每秒最多一条，汇总上次日志之后的条数
+static void TestDropCounter()
+{
+    using Server::TopicManager;
+    auto slow = std::make_shared<FakeConnection>();
+    auto fast = std::make_shared<FakeConnection>();
+    auto slow_sub = std::make_shared<TopicManager::Subscriber>(slow);
+    auto fast_sub = std::make_shared<TopicManager::Subscriber>(fast);
+    TopicManager::Topic topic("news");
+    topic.AppendSubscriber(slow_sub);
+    topic.AppendSubscriber(fast_sub);
+    slow->overloaded = true;
+    auto msg = MakeRequest("news", TopicOptype::TOPIC_PUBLISH);
+    for (int i = 0; i < 500; i++)
+        topic.Publish(msg);
+    CHECK(slow_sub->dropped == 500);
+    CHECK(fast_sub->dropped == 0);
+    CHECK(fast->Published("news") == 500);
+
+    // 新的订阅者第一次丢弃时打日志，一秒之内再丢弃只计数
+    TopicManager::Subscriber sub(slow);
+    CHECK(sub.Drop() == 1);
+    CHECK(sub.Drop() == 0);
+    CHECK(sub.Drop() == 0);
+    CHECK(sub.dropped == 3);
+    // 过了日志间隔之后汇总这段时间内的条数
+    sub.last_log_us -= TopicManager::dropLogIntervalUs;
+    CHECK(sub.Drop() == 3);
+    CHECK(sub.dropped == 4);
+}
+
+int main()
+{
+    TestSlowSubscriber();
+    TestDropCounter();
+    if (failures != 0)
+    {
+        std::cerr << "topic_test: " << failures << " 项检查失败" << std::endl;
+        return 1;
+    }
+    std::cout << "topic_test: 通过" << std::endl;
+    return 0;
+}